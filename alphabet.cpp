@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include <intrin.h>
+#include "alphabet.h"
+
+/*
+ * Alphabet definitions: one tile per line, canonical spelling first, then
+ * any other spellings that normalize to the same tile (accents, uppercase
+ * UTF-8) and optionally the tile's score as a number. ASCII case is folded
+ * automatically. Tile codes follow line order, which is also the sort
+ * order of -a.
+ */
+static const char* builtin_alphabets[][2] = {
+    { "english",
+      "a 1\nb 3\nc 3\nd 2\ne 1\nf 4\ng 2\nh 4\ni 1\nj 8\nk 5\nl 1\nm 3\nn 1\no 1\np 3\nq 10\n"
+      "r 1\ns 1\nt 1\nu 1\nv 4\nw 4\nx 8\ny 4\nz 10\n" },
+
+    { "french",
+      "a à â ä À Â Ä 1\nb 3\nc ç Ç 3\nd 2\ne é è ê ë É È Ê Ë 1\nf 4\ng 2\nh 4\ni î ï Î Ï 1\nj 8\n"
+      "k 10\nl 1\nm 2\nn 1\no ô ö Ô Ö 1\np 3\nq 8\nr 1\ns 1\nt 1\nu ù û ü Ù Û Ü 1\nv 4\nw 10\n"
+      "x 10\ny ÿ Ÿ 10\nz 10\n" },
+
+    { "spanish",
+      "a á Á 1\nb 3\nc 3\nch 5\nd 2\ne é É 1\nf 4\ng 2\nh 4\ni í Í 1\nj 8\nl 1\nll 8\nm 3\n"
+      "n 1\nñ Ñ 8\no ó Ó 1\np 3\nq 5\nr 1\nrr 8\ns 1\nt 1\nu ú ü Ú Ü 1\nv 4\nx 8\ny 4\nz 10\n" },
+
+    { "polish",
+      "a 1\ną Ą 5\nb 3\nc 2\nć Ć 6\nd 2\ne 1\nę Ę 5\nf 5\ng 3\nh 3\ni 1\nj 3\nk 2\nl 2\nł Ł 3\n"
+      "m 2\nn 1\nń Ń 7\no 1\nó Ó 5\np 2\nr 1\ns 1\nś Ś 5\nt 2\nu 3\nw 1\ny 2\nz 1\nź Ź 9\nż Ż 5\n" },
+};
+
+static uint8_t
+fold_ascii(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? (uint8_t) (c - 'A' + 'a') : c;
+}
+
+static int
+add_spelling(alphabet* Alphabet, const char* text, size_t length, uint8_t code)
+{
+    if (!length || length >= MAX_TILE_BYTES || Alphabet->spelling_count >= MAX_TILE_SPELLINGS)
+        return 0;
+
+    tile_spelling* Spelling = Alphabet->spellings + Alphabet->spelling_count++;
+    memset(Spelling, 0, sizeof(*Spelling));
+    Spelling->length = (uint8_t) length;
+    Spelling->code = code;
+
+    for (size_t i = 0; i < length; ++i)
+        Spelling->text[i] = (char) fold_ascii((uint8_t) text[i]);
+
+    return 1;
+}
+
+static int
+parse_tile_value(const char* text, size_t length, uint8_t* value)
+{
+    uint32_t result = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] < '0' || text[i] > '9')
+            return 0;
+
+        result = result * 10 + (uint32_t) (text[i] - '0');
+
+        if (result > MAX_TILE_VALUE)
+            return 0;
+    }
+
+    *value = (uint8_t) result;
+
+    return length > 0;
+}
+
+static int
+parse_alphabet(alphabet* Alphabet, const char* definition)
+{
+    const char* ptr = definition;
+
+    while (*ptr) {
+        const char* line_end = ptr;
+
+        while (*line_end && *line_end != '\n' && *line_end != '\r')
+            ++line_end;
+
+        uint8_t first = 1;
+
+        if (*ptr != '#') {
+            while (ptr < line_end) {
+                while (ptr < line_end && (*ptr == ' ' || *ptr == '\t'))
+                    ++ptr;
+
+                const char* token = ptr;
+
+                while (ptr < line_end && *ptr != ' ' && *ptr != '\t')
+                    ++ptr;
+
+                size_t length = (size_t) (ptr - token);
+
+                if (!length)
+                    continue;
+
+                if (first) {
+                    if (Alphabet->size >= MAX_ALPHABET_SIZE || length >= MAX_TILE_BYTES)
+                        return 0;
+
+                    memcpy(Alphabet->tiles[Alphabet->size], token, length);
+                    Alphabet->tiles[Alphabet->size][length] = 0;
+                    Alphabet->values[Alphabet->size] = DEFAULT_TILE_VALUE;
+                    ++Alphabet->size;
+                    first = 0;
+                } else if (parse_tile_value(token, length, &Alphabet->values[Alphabet->size - 1])) {
+                    continue;
+                }
+
+                if (!add_spelling(Alphabet, token, length, (uint8_t) (Alphabet->size - 1)))
+                    return 0;
+            }
+        }
+
+        ptr = line_end;
+
+        while (*ptr == '\n' || *ptr == '\r')
+            ++ptr;
+    }
+
+    return Alphabet->size > 0;
+}
+
+static void
+build_alphabet_tables(alphabet* Alphabet)
+{
+    // NOTE: insertion sort, longest spelling first so digraphs win over
+    // their first letter
+    for (uint32_t i = 1; i < Alphabet->spelling_count; ++i) {
+        tile_spelling Spelling = Alphabet->spellings[i];
+        uint32_t j = i;
+
+        while (j > 0 && Alphabet->spellings[j - 1].length < Spelling.length) {
+            Alphabet->spellings[j] = Alphabet->spellings[j - 1];
+            --j;
+        }
+
+        Alphabet->spellings[j] = Spelling;
+    }
+
+    for (uint32_t i = 0; i < Alphabet->spelling_count; ++i) {
+        tile_spelling* Spelling = Alphabet->spellings + i;
+        uint8_t first = (uint8_t) Spelling->text[0];
+        uint8_t upper = (first >= 'a' && first <= 'z') ? (uint8_t) (first - 'a' + 'A') : first;
+
+        if (Spelling->length == 1) {
+            Alphabet->byte_code[first] = Spelling->code + 1;
+            Alphabet->byte_code[upper] = Spelling->code + 1;
+        } else {
+            Alphabet->multi_byte_start[first] = 1;
+            Alphabet->multi_byte_start[upper] = 1;
+        }
+    }
+
+    Alphabet->identity = Alphabet->size <= 26;
+
+    for (uint32_t code = 0; code < Alphabet->size; ++code) {
+        char* tile = Alphabet->tiles[code];
+
+        if (tile[0] != TILE_CODE_BASE + (int) code || tile[1] || Alphabet->multi_byte_start[(uint8_t) tile[0]])
+            Alphabet->identity = 0;
+    }
+}
+
+/*
+ * name_or_path is either a built-in alphabet (english, french, spanish,
+ * polish) or a definition file in the same format.
+ */
+int
+load_alphabet(alphabet* Alphabet, const char* name_or_path)
+{
+    memset(Alphabet, 0, sizeof(*Alphabet));
+
+    const char* definition = NULL;
+    char* file_definition = NULL;
+
+    for (size_t i = 0; i < sizeof(builtin_alphabets) / sizeof(builtin_alphabets[0]); ++i) {
+        if (!strcmp(name_or_path, builtin_alphabets[i][0]))
+            definition = builtin_alphabets[i][1];
+    }
+
+    if (!definition) {
+        FILE* file = fopen(name_or_path, "rb");
+
+        if (!file)
+            return 0;
+
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        file_definition = (char*) malloc((size_t) size + 1);
+        size_t bytes_read = fread(file_definition, 1, (size_t) size, file);
+        file_definition[bytes_read] = 0;
+        fclose(file);
+
+        definition = file_definition;
+    }
+
+    snprintf(Alphabet->name, sizeof(Alphabet->name), "%s", name_or_path);
+
+    int Result = parse_alphabet(Alphabet, definition);
+
+    if (Result)
+        build_alphabet_tables(Alphabet);
+
+    free(file_definition);
+
+    return Result;
+}
+
+static int
+match_tile(alphabet* Alphabet, const uint8_t** at, const uint8_t* end)
+{
+    uint8_t c = **at;
+
+    if (!Alphabet->multi_byte_start[c]) {
+        ++*at;
+        return (int) Alphabet->byte_code[c] - 1;
+    }
+
+    for (uint32_t i = 0; i < Alphabet->spelling_count; ++i) {
+        tile_spelling* Spelling = Alphabet->spellings + i;
+
+        if (Spelling->length > end - *at)
+            continue;
+
+        uint8_t match = 1;
+
+        for (uint32_t j = 0; j < Spelling->length && match; ++j)
+            match = fold_ascii((*at)[j]) == (uint8_t) Spelling->text[j];
+
+        if (match) {
+            *at += Spelling->length;
+            return Spelling->code;
+        }
+    }
+
+    ++*at;
+
+    return -1;
+}
+
+/*
+ * Reads a "tile=number,tile=number" list into values, indexed by tile
+ * code. With allow_blank, '?' names the blank at MAX_ALPHABET_SIZE.
+ */
+static int
+parse_tile_list(alphabet* Alphabet, const char* spec, uint8_t* values, uint8_t allow_blank)
+{
+    const char* ptr = spec;
+
+    while (*ptr) {
+        const char* tile = ptr;
+
+        while (*ptr && *ptr != '=')
+            ++ptr;
+
+        if (*ptr != '=')
+            return 0;
+
+        int code;
+
+        if (allow_blank && ptr == tile + 1 && *tile == BLANK_TILE) {
+            code = MAX_ALPHABET_SIZE;
+        } else {
+            const uint8_t* tile_ptr = (const uint8_t*) tile;
+            code = match_tile(Alphabet, &tile_ptr, (const uint8_t*) ptr);
+
+            if (code < 0 || tile_ptr != (const uint8_t*) ptr)
+                return 0;
+        }
+
+        const char* value = ++ptr;
+
+        while (*ptr && *ptr != ',')
+            ++ptr;
+
+        if (!parse_tile_value(value, (size_t) (ptr - value), &values[code]))
+            return 0;
+
+        if (*ptr == ',')
+            ++ptr;
+    }
+
+    return 1;
+}
+
+/*
+ * Overrides tile scores from a "tile=value,tile=value" list, e.g.
+ * "q=10,z=10".
+ */
+int
+set_tile_values(alphabet* Alphabet, const char* spec)
+{
+    return parse_tile_list(Alphabet, spec, Alphabet->values, 0);
+}
+
+/*
+ * Reads a bag from a "tile=count,tile=count" list, e.g. "a=9,b=2,?=2".
+ * counts has MAX_ALPHABET_SIZE + 1 entries, the blank's last, and tiles
+ * the list leaves out count 0.
+ */
+int
+parse_tile_counts(alphabet* Alphabet, const char* spec, uint8_t* counts)
+{
+    memset(counts, 0, MAX_ALPHABET_SIZE + 1);
+
+    return parse_tile_list(Alphabet, spec, counts, 1);
+}
+
+/*
+ * Converts text (a rack or -i/-o argument) to tile codes, '?' becoming
+ * BLANK_CODE. Returns the code count, or -1 if a character is not in the
+ * alphabet.
+ */
+int
+get_tile_codes(alphabet* Alphabet, const char* text, uint8_t* codes, uint32_t max_codes)
+{
+    const uint8_t* ptr = (const uint8_t*) text;
+    const uint8_t* end = ptr + strlen(text);
+    uint32_t count = 0;
+
+    while (ptr < end && count < max_codes) {
+        if (*ptr == BLANK_TILE) {
+            codes[count++] = BLANK_CODE;
+            ++ptr;
+            continue;
+        }
+
+        int code = match_tile(Alphabet, &ptr, end);
+
+        if (code < 0)
+            return -1;
+
+        codes[count++] = (uint8_t) code;
+    }
+
+    return (int) count;
+}
+
+static uint8_t
+is_normalize_delim(uint8_t c)
+{
+    return c == '\n' || c == '\r' || c == ' ';
+}
+
+/*
+ * Rewrites the dictionary in place as one word of tile code bytes per
+ * line. Every tile spelling is at least one byte, so the output never
+ * overtakes the input. Words with characters outside the alphabet
+ * (apostrophes, digits, unknown accents) are dropped, which is what makes
+ * it safe for the kernels to index histograms by code without checks.
+ * Returns the normalized size.
+ *
+ * For identity alphabets, runs of 32 bytes that are already lowercase
+ * letters or newlines, with no empty line, are moved with one load/store.
+ */
+uint32_t
+normalize_dictionary(alphabet* Alphabet, char* contents, uint32_t size, normalize_stats* Stats)
+{
+    const uint8_t* read = (const uint8_t*) contents;
+    const uint8_t* end = read + size;
+    uint8_t* write = (uint8_t*) contents;
+    uint8_t* word_start = write;
+    uint8_t word_valid = 1;
+
+    const __m256i First = _mm256_set1_epi8((char) (TILE_CODE_BASE - 1));
+    const __m256i Last = _mm256_set1_epi8((char) (TILE_CODE_BASE + Alphabet->size));
+    const __m256i Newline = _mm256_set1_epi8('\n');
+
+    while (read < end) {
+        if (Alphabet->identity && word_valid) {
+            while (end - read >= 32) {
+                __m256i V = _mm256_loadu_si256((__m256i*) read);
+                __m256i Letters = _mm256_and_si256(_mm256_cmpgt_epi8(V, First), _mm256_cmpgt_epi8(Last, V));
+                __m256i Newlines = _mm256_cmpeq_epi8(V, Newline);
+                uint32_t valid = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(Letters, Newlines));
+
+                if (valid != 0xFFFFFFFF)
+                    break;
+
+                uint32_t newline_mask = (uint32_t) _mm256_movemask_epi8(Newlines);
+                uint32_t after_newline_mask = (newline_mask << 1) | (write == word_start);
+
+                // NOTE: an empty line has to be dropped, the scalar path does that
+                if (newline_mask & after_newline_mask)
+                    break;
+
+                _mm256_storeu_si256((__m256i*) write, V);
+
+                if (newline_mask) {
+                    Stats->word_count += __popcnt(newline_mask);
+                    word_start = write + 32 - __lzcnt(newline_mask);
+                }
+
+                read += 32;
+                write += 32;
+            }
+
+            if (read >= end)
+                break;
+        }
+
+        uint8_t c = *read;
+
+        if (is_normalize_delim(c)) {
+            ++read;
+
+            if (!word_valid) {
+                write = word_start;
+                ++Stats->dropped_word_count;
+                word_valid = 1;
+            } else if (write > word_start) {
+                *write++ = '\n';
+                ++Stats->word_count;
+            }
+
+            word_start = write;
+            continue;
+        }
+
+        if (!word_valid) {
+            ++read;
+            continue;
+        }
+
+        int code = match_tile(Alphabet, &read, end);
+
+        if (code < 0)
+            word_valid = 0;
+        else
+            *write++ = (uint8_t) (TILE_CODE_BASE + code);
+    }
+
+    if (!word_valid) {
+        write = word_start;
+        ++Stats->dropped_word_count;
+    } else if (write > word_start) {
+        ++Stats->word_count;
+    }
+
+    return (uint32_t) (write - (uint8_t*) contents);
+}
+
+/*
+ * Writes a normalized word back as text, NUL terminated and truncated to
+ * size like snprintf. Returns the full text length.
+ */
+int
+decode_word(alphabet* Alphabet, const char* word, int length, char* buffer, size_t size)
+{
+    if (Alphabet->identity)
+        return snprintf(buffer, size, "%.*s", length, word);
+
+    size_t written = 0;
+
+    for (int i = 0; i < length; ++i) {
+        const char* tile = Alphabet->tiles[(uint8_t) word[i] - TILE_CODE_BASE];
+
+        for (; *tile; ++tile, ++written) {
+            if (written + 1 < size)
+                buffer[written] = *tile;
+        }
+    }
+
+    if (size)
+        buffer[(written < size) ? written : size - 1] = 0;
+
+    return (int) written;
+}
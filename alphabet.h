@@ -0,0 +1,49 @@
+#if !defined(ALPHABET_H__)
+#define ALPHABET_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_ALPHABET_SIZE 64
+#define MAX_TILE_BYTES 8
+#define MAX_TILE_SPELLINGS 256
+
+// NOTE: normalized words store tile code k as the byte TILE_CODE_BASE + k,
+// which keeps English byte-for-byte identical to its source text
+#define TILE_CODE_BASE 'a'
+#define BLANK_TILE '?'
+#define BLANK_CODE 0xFF
+#define DEFAULT_TILE_VALUE 1
+#define MAX_TILE_VALUE 127
+
+struct tile_spelling {
+    char text[MAX_TILE_BYTES];
+    uint8_t length;
+    uint8_t code;
+};
+
+struct alphabet {
+    char name[64];
+    uint32_t size;
+    uint8_t identity;                       // every tile is spelled 'a' + code, no decoding needed
+    char tiles[MAX_ALPHABET_SIZE][MAX_TILE_BYTES];
+    uint8_t values[MAX_ALPHABET_SIZE];      // tile score, blanks always score 0
+    uint8_t byte_code[256];                 // code + 1 for single-byte spellings, 0 if none
+    uint8_t multi_byte_start[256];          // byte starts a digraph or UTF-8 spelling
+    uint32_t spelling_count;
+    tile_spelling spellings[MAX_TILE_SPELLINGS];    // longest first
+};
+
+struct normalize_stats {
+    uint64_t word_count;
+    uint64_t dropped_word_count;            // words with characters outside the alphabet
+};
+
+extern int load_alphabet(alphabet* Alphabet, const char* name_or_path);
+extern int set_tile_values(alphabet* Alphabet, const char* spec);
+extern int parse_tile_counts(alphabet* Alphabet, const char* spec, uint8_t* counts);
+extern int get_tile_codes(alphabet* Alphabet, const char* text, uint8_t* codes, uint32_t max_codes);
+extern uint32_t normalize_dictionary(alphabet* Alphabet, char* contents, uint32_t size, normalize_stats* Stats);
+extern int decode_word(alphabet* Alphabet, const char* word, int length, char* buffer, size_t size);
+
+#endif
@@ -18,6 +18,7 @@ set CommonCompilerFlags=      ^
     /Qvec-report:2            ^
     /arch:AVX512              ^
     /nologo                   ^
+    /utf-8                    ^
     /FC                       ^
     /WX                       ^
     /W4                       ^
@@ -45,12 +46,39 @@ set CommonLinkerFlags=^
     user32.lib        ^
     gdi32.lib         ^
     winmm.lib         ^
+    advapi32.lib      ^
+    psapi.lib         ^
+    synchronization.lib ^
     /time
 
 del *.pdb > NUL 2> NUL
 
-cl.exe %CommonCompilerFlags% /Fe:sch.exe ..\main.cpp ..\getopt.cpp -link %CommonLinkerFlags%
+REM NOTE: libsch is everything but the command line; embedders link sch.lib and include sch.h
+cl.exe %CommonCompilerFlags% /c ..\sch.cpp ..\alphabet.cpp ..\leaves.cpp ..\wordset.cpp ..\racks.cpp ..\classes.cpp ..\hooks.cpp ..\hash.cpp ..\build.cpp
+if errorlevel 1 goto :built
 
+lib.exe /nologo /LTCG /OUT:sch.lib sch.obj alphabet.obj leaves.obj wordset.obj racks.obj classes.obj hooks.obj hash.obj build.obj
+if errorlevel 1 goto :built
+
+REM NOTE: "build.bat embed" normalizes dictionary.txt and its hook table into an index once and links it into sch.exe
+set EmbeddedIndex=
+
+if /i "%1" == "embed" (
+    cl.exe %CommonCompilerFlags% /Fe:embed.exe ..\embed.cpp alphabet.obj hooks.obj hash.obj build.obj -link %CommonLinkerFlags%
+    if errorlevel 1 goto :built
+
+    .\embed.exe ..\dictionary.txt dictionary.idx
+    if errorlevel 1 goto :built
+
+    rc.exe /nologo /i .. /fo sch.res ..\sch.rc
+    if errorlevel 1 goto :built
+
+    set EmbeddedIndex=sch.res
+)
+
+cl.exe %CommonCompilerFlags% /Fe:sch.exe ..\main.cpp ..\getopt.cpp sch.lib %EmbeddedIndex% -link %CommonLinkerFlags%
+
+:built
 set LastError=%ERRORLEVEL%
 popd
 
@@ -0,0 +1,84 @@
+#include <windows.h>
+#include <string.h>
+#include "build.h"
+
+/*
+ * Cuts a normalized dictionary into range_count ranges of about equal
+ * size, each moved forward to the next line start, and sets up the
+ * zeroed [range][shard] counts.
+ */
+int
+begin_staged_build(staged_build* Stages, const char* contents, uint32_t size, uint32_t range_count, uint32_t shard_count)
+{
+    size_t range_starts_size = ((size_t) range_count + 1) * sizeof(uint32_t);
+    size_t counts_size = (size_t) range_count * shard_count * sizeof(uint32_t);
+
+    memset(Stages, 0, sizeof(*Stages));
+    Stages->range_count = range_count;
+    Stages->shard_count = shard_count;
+    Stages->range_shard_counts = (uint32_t*) VirtualAlloc(NULL, counts_size + range_starts_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Stages->range_shard_counts)
+        return 0;
+
+    uint32_t* range_starts = (uint32_t*) ((char*) Stages->range_shard_counts + counts_size);
+
+    for (uint32_t r = 1; r < range_count; ++r) {
+        uint32_t start = (uint32_t) ((uint64_t) size * r / range_count);
+
+        if (start < range_starts[r - 1])
+            start = range_starts[r - 1];
+
+        while (start && start < size && contents[start - 1] != '\n')
+            ++start;
+
+        range_starts[r] = start;
+    }
+
+    range_starts[range_count] = size;
+    Stages->range_starts = range_starts;
+
+    return 1;
+}
+
+/*
+ * Turns the counts into where each range starts writing each shard:
+ * shards take their entries in shard order, and every range's entries
+ * of a shard follow the previous range's. shard_starts gets the first
+ * entry of each shard and the total. Returns the total.
+ */
+uint32_t
+assign_shard_starts(staged_build* Stages, uint32_t* shard_starts)
+{
+    uint32_t entry = 0;
+
+    for (uint32_t s = 0; s < Stages->shard_count; ++s) {
+        shard_starts[s] = entry;
+
+        for (uint32_t r = 0; r < Stages->range_count; ++r) {
+            uint32_t* count = Stages->range_shard_counts + (size_t) r * Stages->shard_count + s;
+            uint32_t range_entry_count = *count;
+
+            *count = entry;
+            entry += range_entry_count;
+        }
+    }
+
+    shard_starts[Stages->shard_count] = entry;
+
+    return entry;
+}
+
+void
+end_staged_build(staged_build* Stages)
+{
+    if (Stages->range_shard_counts)
+        VirtualFree(Stages->range_shard_counts, 0, MEM_RELEASE);
+
+    if (Stages->scratch)
+        VirtualFree(Stages->scratch, 0, MEM_RELEASE);
+
+    Stages->range_shard_counts = NULL;
+    Stages->range_starts = NULL;
+    Stages->scratch = NULL;
+}
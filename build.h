@@ -0,0 +1,28 @@
+#if !defined(BUILD_H__)
+#define BUILD_H__
+
+#include <windows.h>
+#include <stdint.h>
+
+/*
+ * What the staged table builds (word set, anagram classes, rack table,
+ * hook table) share. The dictionary is cut into range_count ranges at
+ * line starts, and range_shard_counts holds what each range has for
+ * each of shard_count shards until assign_shard_starts turns it into
+ * where each range writes into each shard. Ranges write a shard in
+ * range order, so a shard's entries keep dictionary order. The counts
+ * are fixed, so a build comes out the same on any number of threads.
+ */
+struct staged_build {
+    uint32_t range_count;
+    uint32_t shard_count;
+    uint32_t* range_starts;         // range_count + 1, on word starts
+    uint32_t* range_shard_counts;   // [range][shard]
+    char* scratch;                  // the build's own arrays, freed with the rest
+};
+
+extern int begin_staged_build(staged_build* Stages, const char* contents, uint32_t size, uint32_t range_count, uint32_t shard_count);
+extern uint32_t assign_shard_starts(staged_build* Stages, uint32_t* shard_starts);
+extern void end_staged_build(staged_build* Stages);
+
+#endif
@@ -0,0 +1,94 @@
+"""
+Checks --words against a brute force over the dictionary: every way of
+using the whole rack in 2 to N words, found by trying each word the rack
+can spell, then each word what it leaves can spell, and so on.
+
+    python check_anagrams.py [sch] [dictionary]
+
+Prints one line per rack and exits with 1 if any differs.
+"""
+
+import sys
+from collections import Counter
+
+from check_common import read_words, run_sch
+
+# NOTE: dictionary.txt has no words under 4 letters, so racks of 6 and 7
+# tiles have no combinations and are there to show nothing is made up
+RACKS = [
+    ("parsed", 2),
+    ("aestrnl", 3),
+    ("painters", 2),
+    ("tradesman", 2),
+    ("dormitory", 3),
+    ("constraint", 3),
+    ("aeeilnorstcd", 2),
+    ("aeeilnorstcd", 3),
+]
+
+
+def fits(counts, rest):
+    return all(rest[c] >= n for c, n in counts.items())
+
+
+def brute_force(words, rack, max_words):
+    rack_counts = Counter(rack)
+    candidates = [(w, Counter(w)) for w in words if len(w) < len(rack) and fits(Counter(w), rack_counts)]
+    found = set()
+
+    def extend(start, rest, combination):
+        left = sum(rest.values())
+
+        if not left:
+            found.add(tuple(sorted(combination)))
+            return
+
+        if len(combination) == max_words:
+            return
+
+        for i in range(start, len(candidates)):
+            word, counts = candidates[i]
+
+            # NOTE: the last word has to use up the rack
+            if len(word) > left or (len(combination) + 1 == max_words and len(word) != left):
+                continue
+
+            if fits(counts, rest):
+                extend(i, rest - counts, combination + [word])
+
+    extend(0, rack_counts, [])
+
+    return found
+
+
+def get_combinations(sch, dictionary, rack, max_words):
+    lines = run_sch(sch, dictionary, rack, "--words", str(max_words))
+
+    return set(tuple(sorted(line.split())) for line in lines if line.strip() and not line.startswith("**"))
+
+
+def main():
+    sch = sys.argv[1] if len(sys.argv) > 1 else "./sch"
+    dictionary = sys.argv[2] if len(sys.argv) > 2 else "dictionary.txt"
+    words = read_words(dictionary)
+    failed = 0
+
+    for rack, max_words in RACKS:
+        expected = brute_force(words, rack, max_words)
+        got = get_combinations(sch, dictionary, rack, max_words)
+        ok = got == expected
+        failed += not ok
+
+        print("%-14s %u words: %6u combinations  %s" % (rack, max_words, len(expected), "ok" if ok else "DIFF"))
+
+        for combination in sorted(expected - got)[:5]:
+            print("    missing  " + " ".join(combination))
+
+        for combination in sorted(got - expected)[:5]:
+            print("    extra    " + " ".join(combination))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
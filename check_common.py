@@ -0,0 +1,20 @@
+"""
+What the check_*.py scripts share: reading the dictionary the way sch
+does and running sch over it. Words are the dictionary lines the english
+alphabet keeps, a-z only.
+"""
+
+import re
+import subprocess
+
+
+def read_words(path):
+    with open(path, encoding="latin-1") as f:
+        return sorted(set(w for w in f.read().split() if re.fullmatch("[a-z]+", w)))
+
+
+def run_sch(sch, dictionary, *args):
+    output = subprocess.run([sch] + list(args) + ["-d", dictionary],
+                            capture_output=True, text=True, check=True).stdout
+
+    return output.splitlines()
@@ -0,0 +1,165 @@
+"""
+Replays --simulate in Python and checks its histograms. The draws are
+the engine's: racks come in orders of SIMULATION_ORDER_SAMPLES, order i
+draws from its own splitmix64 stream seeded with seed ^ i * 0xD1B54A32D192ED03
+and shuffles its own copy of the bag in place, a partial Fisher-Yates
+with multiply-shift range reduction. Each rack is then scored word by
+word, blanks filling in for missing letters, instead of through the rack
+table. Words of up to 7 letters are grouped by the set of letters they
+use, and a rack only scores the sets it holds but for at most one letter
+per blank.
+
+    python check_simulation.py [sch] [dictionary] [count] [leave] [seed]
+
+count defaults to a little over one order, so two streams are replayed.
+Prints both histograms and exits with 1 if they differ.
+"""
+
+import itertools
+import re
+import sys
+from collections import Counter
+
+from check_common import read_words, run_sch
+
+MASK = (1 << 64) - 1
+ORDER_SAMPLES = 4096
+RACK_TILES = 7
+SCORE_BUCKETS = 128
+VALUES = dict(zip("abcdefghijklmnopqrstuvwxyz", [1, 3, 3, 2, 1, 4, 2, 4, 1, 8, 5, 1, 3, 1, 1, 3, 10, 1, 1, 1, 1, 4, 4, 8, 4, 10]))
+BAG = "a=9,b=2,c=2,d=4,e=12,f=2,g=3,h=2,i=9,j=1,k=1,l=4,m=2,n=6,o=8,p=2,q=1,r=6,s=4,t=6,u=4,v=2,w=2,x=1,y=2,z=1,?=2"
+
+
+def group_words(words):
+    groups = {}
+
+    for w in words:
+        if len(w) <= RACK_TILES:
+            groups.setdefault(frozenset(w), []).append((len(w), list(Counter(w).items())))
+
+    return groups
+
+
+def next_random(state):
+    state[0] = (state[0] + 0x9E3779B97F4A7C15) & MASK
+    z = state[0]
+    z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK
+    z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK
+
+    return z ^ (z >> 31)
+
+
+# NOTE: tiles in code order with blanks last, as the engine lays them out
+def make_bag(leave):
+    counts = dict(kv.split("=") for kv in BAG.split(","))
+    counts = {tile: int(n) for tile, n in counts.items()}
+
+    for tile in leave:
+        counts[tile] -= 1
+
+    return [tile for tile in "abcdefghijklmnopqrstuvwxyz?" for _ in range(counts.get(tile, 0))]
+
+
+def play(groups, rack):
+    blank_count = rack["?"]
+    held = [letter for letter in rack if letter != "?" and rack[letter]]
+    missing = [letter for letter in VALUES if not rack[letter]]
+    best_length = 0
+    best_score = 0
+
+    letter_sets = set()
+
+    for n in range(len(held) + 1):
+        for letters in itertools.combinations(held, n):
+            for b in range(blank_count + 1):
+                for extra in itertools.combinations(missing, b):
+                    letter_sets.add(frozenset(letters + extra))
+
+    words = [word for letters in letter_sets for word in groups.get(letters, [])]
+
+    for length, counts in words:
+        blanks_used = 0
+        score = 0
+
+        for letter, n in counts:
+            if n > rack[letter]:
+                blanks_used += n - rack[letter]
+                score += rack[letter] * VALUES[letter]
+            else:
+                score += n * VALUES[letter]
+
+        if blanks_used <= blank_count:
+            best_length = max(best_length, length)
+            best_score = max(best_score, score)
+
+    return best_length, best_score
+
+
+def replay(groups, count, leave, seed):
+    bag = make_bag(leave)
+    draw_count = RACK_TILES - len(leave)
+    lengths = [0] * (RACK_TILES + 1)
+    scores = [0] * SCORE_BUCKETS
+
+    for order in range((count + ORDER_SAMPLES - 1) // ORDER_SAMPLES):
+        state = [(seed ^ (order * 0xD1B54A32D192ED03)) & MASK]
+        tiles = bag[:]
+
+        for _ in range(min(ORDER_SAMPLES, count - order * ORDER_SAMPLES)):
+            for i in range(draw_count):
+                j = i + (((next_random(state) & 0xFFFFFFFF) * (len(tiles) - i)) >> 32)
+                tiles[i], tiles[j] = tiles[j], tiles[i]
+
+            length, score = play(groups, Counter(leave + "".join(tiles[:draw_count])))
+            lengths[length] += 1
+            scores[min(score, SCORE_BUCKETS - 1)] += 1
+
+    # NOTE: scores are printed in buckets of 5, and only those with racks
+    score_rows = {}
+
+    for b in range(0, SCORE_BUCKETS, 5):
+        if sum(scores[b:b + 5]):
+            score_rows[b] = sum(scores[b:b + 5])
+
+    return lengths, score_rows
+
+
+def get_histograms(sch, dictionary, count, leave, seed):
+    lengths = [0] * (RACK_TILES + 1)
+    score_rows = {}
+
+    for line in run_sch(sch, dictionary, leave, "--simulate", str(count), "--seed", str(seed)):
+        m = re.match(r"\*\* LongestWord (\d+)\s*:\s*(\d+)", line)
+
+        if m:
+            lengths[int(m.group(1))] = int(m.group(2))
+
+        m = re.match(r"\*\* BestScore\s+(\d+)\+\s*:\s*(\d+)", line)
+
+        if m and int(m.group(2)):
+            score_rows[int(m.group(1))] = int(m.group(2))
+
+    return lengths, score_rows
+
+
+def main():
+    sch = sys.argv[1] if len(sys.argv) > 1 else "./sch"
+    dictionary = sys.argv[2] if len(sys.argv) > 2 else "dictionary.txt"
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else ORDER_SAMPLES + 200
+    leave = sys.argv[4] if len(sys.argv) > 4 else ""
+    seed = int(sys.argv[5]) if len(sys.argv) > 5 else 1
+    expected = replay(group_words(read_words(dictionary)), count, leave, seed)
+    got = get_histograms(sch, dictionary, count, leave, seed)
+    ok = got == expected
+
+    print("%u racks, leave \"%s\", seed %u  %s" % (count, leave, seed, "ok" if ok else "DIFF"))
+    print("    longest word  expected %s" % expected[0])
+    print("                  got      %s" % got[0])
+    print("    best score    expected %s" % sorted(expected[1].items()))
+    print("                  got      %s" % sorted(got[1].items()))
+
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
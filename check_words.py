@@ -0,0 +1,95 @@
+"""
+Checks --check against a Python set of the dictionary. The list holds a
+sample of dictionary words, and as many near misses made from them (one
+letter changed, dropped or added, or the word doubled), plus the cases
+that trip up hashing: single letters and words longer than any in the
+dictionary.
+
+    python check_words.py [sch] [dictionary] [count] [seed]
+
+Prints the counts and exits with 1 if any answer differs.
+"""
+
+import os
+import random
+import string
+import sys
+import tempfile
+
+from check_common import read_words, run_sch
+
+
+def near_miss(rng, word):
+    i = rng.randrange(len(word))
+    kind = rng.randrange(4)
+
+    if kind == 0:
+        return word[:i] + rng.choice(string.ascii_lowercase) + word[i + 1:]
+
+    if kind == 1:
+        return word[:i] + word[i + 1:]
+
+    if kind == 2:
+        return word[:i] + rng.choice(string.ascii_lowercase) + word[i:]
+
+    return word + word
+
+
+def make_list(words, count, seed):
+    rng = random.Random(seed)
+    longest = max(len(w) for w in words)
+    sample = rng.sample(words, min(count, len(words)))
+    checks = sample + [near_miss(rng, w) for w in sample]
+    checks += list(string.ascii_lowercase) + ["a" * (longest + 1), "z" * 300]
+    rng.shuffle(checks)
+
+    return checks
+
+
+def get_answers(sch, dictionary, path):
+    answers = []
+
+    for line in run_sch(sch, dictionary, "a", "--check", path):
+        if line.startswith("valid  ") or line.startswith("phony  "):
+            answers.append((line[7:], line.startswith("valid")))
+
+    return answers
+
+
+def main():
+    sch = sys.argv[1] if len(sys.argv) > 1 else "./sch"
+    dictionary = sys.argv[2] if len(sys.argv) > 2 else "dictionary.txt"
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else 50000
+    seed = int(sys.argv[4]) if len(sys.argv) > 4 else 1
+    words = read_words(dictionary)
+    word_set = set(words)
+    checks = make_list(words, count, seed)
+
+    with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as f:
+        f.write("\n".join(checks) + "\n")
+        path = f.name
+
+    try:
+        answers = get_answers(sch, dictionary, path)
+    finally:
+        os.remove(path)
+
+    expected = [(w, w in word_set) for w in checks]
+    valid_count = sum(valid for _, valid in expected)
+    wrong = [(w, valid) for (w, valid), answer in zip(expected, answers) if (w, valid) != answer]
+
+    if len(answers) != len(expected):
+        print("%u answers for %u words  DIFF" % (len(answers), len(expected)))
+        return 1
+
+    print("%u words (%u valid, %u phony), %u wrong  %s" %
+          (len(expected), valid_count, len(expected) - valid_count, len(wrong), "DIFF" if wrong else "ok"))
+
+    for w, valid in wrong[:10]:
+        print("    %s  %s" % ("valid" if valid else "phony", w))
+
+    return 1 if wrong else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,310 @@
+#include <windows.h>
+#include <string.h>
+#include "classes.h"
+#include "hash.h"
+
+/*
+ * Sets up a build over a normalized dictionary, which has to stay mapped
+ * for as long as the classes are used.
+ */
+int
+begin_word_class_build(word_class_build* Build, word_classes* Classes, alphabet* Alphabet, const char* contents, uint32_t size)
+{
+    memset(Build, 0, sizeof(*Build));
+    memset(Classes, 0, sizeof(*Classes));
+    Build->Classes = Classes;
+    Build->contents = contents;
+    Build->size = size;
+    Build->alphabet_size = Alphabet->size;
+    Classes->freq_size = (Alphabet->size > 32) ? 64 : 32;
+
+    return begin_staged_build(&Build->Stages, contents, size, WORD_CLASS_RANGE_COUNT, WORD_CLASS_SHARD_COUNT);
+}
+
+uint32_t
+get_word_class_stage_size(word_class_build* Build)
+{
+    return (Build->stage == WORD_CLASS_STAGE_GROUP) ? WORD_CLASS_SHARD_COUNT : WORD_CLASS_RANGE_COUNT;
+}
+
+static uint32_t
+get_shard(uint64_t hash)
+{
+    return (uint32_t) (hash >> (64 - WORD_CLASS_SHARD_BITS));
+}
+
+/*
+ * Goes through one shard's words in dictionary order, finding each
+ * one's class through a hash on the histogram. The first word of a
+ * histogram opens its class, and the ones after it count themselves in
+ * as members. Every class opened is counted against the range its first
+ * word is in, in this shard's column of range_shard_counts.
+ */
+static void
+group_shard(word_class_build* Build, uint32_t shard)
+{
+    uint32_t freq_size = Build->Classes->freq_size;
+    uint32_t first_word = Build->shard_words[shard];
+    uint32_t word_count = Build->shard_words[shard + 1] - first_word;
+    uint32_t* slots = Build->slots + Build->shard_slots[shard];
+    uint32_t slot_mask = Build->shard_slots[shard + 1] - Build->shard_slots[shard] - 1;
+    uint32_t range = 0;
+
+    for (uint32_t r = 0; r < WORD_CLASS_RANGE_COUNT; ++r)
+        Build->Stages.range_shard_counts[(size_t) r * WORD_CLASS_SHARD_COUNT + shard] = 0;
+
+    for (uint32_t i = 0; i < word_count; ++i) {
+        uint32_t word = Build->sharded_words[first_word + i];
+        const uint8_t* freq = Build->freqs + (size_t) word * freq_size;
+        uint32_t slot = (uint32_t) Build->hashes[word] & slot_mask;
+
+        while (slots[slot] && memcmp(Build->freqs + (size_t) (slots[slot] - 1) * freq_size, freq, freq_size))
+            slot = (slot + 1) & slot_mask;
+
+        if (slots[slot]) {
+            uint32_t first = slots[slot] - 1;
+
+            Build->first_words[word] = first;
+            Build->ranks[word] = Build->member_counts[first]++;
+            continue;
+        }
+
+        slots[slot] = word + 1;
+        Build->first_words[word] = word;
+        Build->member_counts[word] = 1;
+
+        while (word >= Build->range_words[range + 1])
+            ++range;
+
+        ++Build->Stages.range_shard_counts[(size_t) range * WORD_CLASS_SHARD_COUNT + shard];
+    }
+}
+
+// NOTE: index is a range for every stage but GROUP, which takes a shard
+void
+run_word_class_stage(word_class_build* Build, uint32_t index)
+{
+    word_classes* Classes = Build->Classes;
+    const char* contents = Build->contents;
+    uint32_t freq_size = Classes->freq_size;
+
+    switch (Build->stage) {
+    case WORD_CLASS_STAGE_SPLIT: {
+        uint32_t word_count = 0;
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < Build->Stages.range_starts[index + 1]; ++i)
+            word_count += contents[i] != '\n' && (i + 1 == Build->size || contents[i + 1] == '\n');
+
+        Build->range_words[index + 1] = word_count;
+    } break;
+
+    case WORD_CLASS_STAGE_HASH: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * WORD_CLASS_SHARD_COUNT;
+        uint32_t word = Build->range_words[index];
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < Build->Stages.range_starts[index + 1];) {
+            uint32_t start = i;
+            uint8_t* freq = Build->freqs + (size_t) word * freq_size;
+
+            for (; i < Build->size && contents[i] != '\n'; ++i)
+                freq[(uint8_t) contents[i] - TILE_CODE_BASE]++;
+
+            if (i++ == start)
+                continue;
+
+            Build->offsets[word] = start;
+            Build->hashes[word] = hash_bytes(freq, freq_size, 0);
+            ++shard_counts[get_shard(Build->hashes[word])];
+            ++word;
+        }
+    } break;
+
+    case WORD_CLASS_STAGE_SCATTER: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * WORD_CLASS_SHARD_COUNT;
+
+        for (uint32_t word = Build->range_words[index]; word < Build->range_words[index + 1]; ++word)
+            Build->sharded_words[shard_counts[get_shard(Build->hashes[word])]++] = word;
+    } break;
+
+    case WORD_CLASS_STAGE_GROUP:
+        group_shard(Build, index);
+        break;
+
+    case WORD_CLASS_STAGE_NUMBER: {
+        uint32_t c = Build->range_classes[index];
+
+        for (uint32_t word = Build->range_words[index]; word < Build->range_words[index + 1]; ++word) {
+            if (Build->first_words[word] != word)
+                continue;
+
+            const uint8_t* freq = Build->freqs + (size_t) word * freq_size;
+
+            memcpy(Classes->freqs + (size_t) c * freq_size, freq, freq_size);
+
+            for (uint32_t k = 0; k < Build->alphabet_size; ++k)
+                Classes->masks[c] |= (uint64_t) (freq[k] != 0) << k;
+
+            Classes->first_members[c + 1] = Build->member_counts[word];
+            Build->classes[word] = c++;
+        }
+    } break;
+
+    case WORD_CLASS_STAGE_PLACE:
+        for (uint32_t word = Build->range_words[index]; word < Build->range_words[index + 1]; ++word) {
+            uint32_t c = Build->classes[Build->first_words[word]];
+            Classes->members[Classes->first_members[c] + Build->ranks[word]] = Build->offsets[word];
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+// NOTE: sized once the words are counted; shards get at most twice
+// their words in slots, rounded up to a power of two
+static int
+allocate_word_class_build(word_class_build* Build)
+{
+    uint32_t word_count = Build->Classes->word_count;
+    size_t freqs_size = (size_t) word_count * Build->Classes->freq_size;
+    size_t hashes_size = (size_t) word_count * sizeof(uint64_t);
+    size_t index_size = (size_t) word_count * sizeof(uint32_t);
+    size_t slots_size = ((size_t) 4 * word_count + 16 * WORD_CLASS_SHARD_COUNT) * sizeof(uint32_t);
+
+    Build->Stages.scratch = (char*) VirtualAlloc(NULL, freqs_size + hashes_size + 6 * index_size + slots_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Build->Stages.scratch)
+        return 0;
+
+    char* scratch = Build->Stages.scratch;
+    Build->freqs = (uint8_t*) scratch;
+    Build->hashes = (uint64_t*) (scratch += freqs_size);
+    Build->offsets = (uint32_t*) (scratch += hashes_size);
+    Build->sharded_words = (uint32_t*) (scratch += index_size);
+    Build->first_words = (uint32_t*) (scratch += index_size);
+    Build->ranks = (uint32_t*) (scratch += index_size);
+    Build->member_counts = (uint32_t*) (scratch += index_size);
+    Build->classes = (uint32_t*) (scratch += index_size);
+    Build->slots = (uint32_t*) (scratch + index_size);
+
+    return 1;
+}
+
+// NOTE: shards take their slots in shard order too, at least twice as
+// many as they have words
+static void
+assign_shards(word_class_build* Build)
+{
+    uint32_t slot = 0;
+
+    assign_shard_starts(&Build->Stages, Build->shard_words);
+
+    for (uint32_t s = 0; s < WORD_CLASS_SHARD_COUNT; ++s) {
+        uint32_t slot_count = 16;
+
+        while (slot_count < 2 * (Build->shard_words[s + 1] - Build->shard_words[s]))
+            slot_count *= 2;
+
+        Build->shard_slots[s] = slot;
+        slot += slot_count;
+    }
+
+    Build->shard_slots[WORD_CLASS_SHARD_COUNT] = slot;
+}
+
+// NOTE: ranges number their classes in range order, so classes go in
+// order of their first words
+static int
+allocate_word_classes(word_class_build* Build)
+{
+    word_classes* Classes = Build->Classes;
+
+    for (uint32_t r = 0; r < WORD_CLASS_RANGE_COUNT; ++r) {
+        uint32_t range_class_count = 0;
+
+        for (uint32_t s = 0; s < WORD_CLASS_SHARD_COUNT; ++s)
+            range_class_count += Build->Stages.range_shard_counts[(size_t) r * WORD_CLASS_SHARD_COUNT + s];
+
+        Build->range_classes[r + 1] = Build->range_classes[r] + range_class_count;
+    }
+
+    Classes->class_count = Build->range_classes[WORD_CLASS_RANGE_COUNT];
+
+    size_t freqs_size = (size_t) Classes->class_count * Classes->freq_size;
+    size_t masks_size = (size_t) Classes->class_count * sizeof(uint64_t);
+    size_t first_members_size = ((size_t) Classes->class_count + 1) * sizeof(uint32_t);
+    size_t members_size = (size_t) Classes->word_count * sizeof(uint32_t);
+    char* memory = (char*) VirtualAlloc(NULL, freqs_size + masks_size + first_members_size + members_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!memory)
+        return 0;
+
+    Classes->freqs = (uint8_t*) memory;
+    Classes->masks = (uint64_t*) (memory + freqs_size);
+    Classes->first_members = (uint32_t*) (memory + freqs_size + masks_size);
+    Classes->members = (uint32_t*) (memory + freqs_size + masks_size + first_members_size);
+
+    return 1;
+}
+
+// NOTE: returns 0 when the build cannot go on
+int
+finish_word_class_stage(word_class_build* Build)
+{
+    word_classes* Classes = Build->Classes;
+
+    switch (Build->stage) {
+    case WORD_CLASS_STAGE_SPLIT:
+        for (uint32_t r = 0; r < WORD_CLASS_RANGE_COUNT; ++r)
+            Build->range_words[r + 1] += Build->range_words[r];
+
+        Classes->word_count = Build->range_words[WORD_CLASS_RANGE_COUNT];
+
+        return allocate_word_class_build(Build);
+
+    case WORD_CLASS_STAGE_HASH:
+        assign_shards(Build);
+        return 1;
+
+    case WORD_CLASS_STAGE_GROUP:
+        return allocate_word_classes(Build);
+
+    case WORD_CLASS_STAGE_NUMBER:
+        for (uint32_t c = 0; c < Classes->class_count; ++c)
+            Classes->first_members[c + 1] += Classes->first_members[c];
+
+        return 1;
+
+    default:
+        return 1;
+    }
+}
+
+int
+end_word_class_build(word_class_build* Build, int succeeded)
+{
+    end_staged_build(&Build->Stages);
+
+    if (!succeeded)
+        release_word_classes(Build->Classes);
+
+    return succeeded;
+}
+
+uint64_t
+get_word_classes_bytes(word_classes* Classes)
+{
+    return (uint64_t) Classes->class_count * (Classes->freq_size + sizeof(uint64_t)) +
+           ((uint64_t) Classes->class_count + 1) * sizeof(uint32_t) +
+           (uint64_t) Classes->word_count * sizeof(uint32_t);
+}
+
+void
+release_word_classes(word_classes* Classes)
+{
+    if (Classes->freqs)
+        VirtualFree(Classes->freqs, 0, MEM_RELEASE);
+
+    Classes->freqs = NULL;
+}
@@ -0,0 +1,79 @@
+#if !defined(CLASSES_H__)
+#define CLASSES_H__
+
+#include <windows.h>
+#include <stdint.h>
+#include "alphabet.h"
+#include "build.h"
+
+#define WORD_CLASS_SHARD_BITS 8
+#define WORD_CLASS_SHARD_COUNT (1 << WORD_CLASS_SHARD_BITS)
+#define WORD_CLASS_RANGE_COUNT 64
+
+/*
+ * The dictionary grouped by letter multiset: words that are anagrams of
+ * each other (stare, tears, rates) share one class, which keeps their
+ * histogram and letter mask once. A query tests each class and only
+ * looks at the members of the classes that pass. Histograms are
+ * freq_size bytes, the scan kernels' width for the alphabet, so a test
+ * is one aligned load.
+ */
+struct word_classes {
+    uint32_t class_count;
+    uint32_t word_count;
+    uint32_t freq_size;         // 32 or 64
+    uint8_t* freqs;             // freq_size bytes per class
+    uint64_t* masks;            // letters each class uses
+    uint32_t* first_members;    // class_count + 1 entries into members
+    uint32_t* members;          // word IDs, dictionary order within a class
+};
+
+enum word_class_stage {
+    WORD_CLASS_STAGE_SPLIT,     // per range: count its words
+    WORD_CLASS_STAGE_HASH,      // per range: histogram and hash its words, count them per shard
+    WORD_CLASS_STAGE_SCATTER,   // per range: list its words under their shards
+    WORD_CLASS_STAGE_GROUP,     // per shard: find each word's class by its first word
+    WORD_CLASS_STAGE_NUMBER,    // per range: number the classes its words open
+    WORD_CLASS_STAGE_PLACE,     // per range: lay out its words as members
+    WORD_CLASS_STAGE_COUNT
+};
+
+/*
+ * Word classes built in stages over a staged_build. Equal histograms
+ * hash to the same shard, so shards group their words independently.
+ * A class is known by its first word, and classes are numbered in order
+ * of their first words, the order the serial grouping gave them.
+ *
+ *   begin, then SPLIT, HASH, SCATTER, GROUP, NUMBER, PLACE, each followed by finish
+ */
+struct word_class_build {
+    word_classes* Classes;
+    const char* contents;
+    uint32_t size;
+    uint32_t alphabet_size;
+    word_class_stage stage;
+    staged_build Stages;            // its counts also hold the classes GROUP finds
+    uint32_t range_words[WORD_CLASS_RANGE_COUNT + 1];   // first word of each range
+    uint32_t range_classes[WORD_CLASS_RANGE_COUNT + 1]; // first class each range opens
+    uint32_t shard_words[WORD_CLASS_SHARD_COUNT + 1];   // first word of each shard
+    uint32_t shard_slots[WORD_CLASS_SHARD_COUNT + 1];   // first slot of each shard
+    uint8_t* freqs;                 // freq_size bytes per word
+    uint64_t* hashes;
+    uint32_t* offsets;
+    uint32_t* sharded_words;        // by shard, dictionary order within
+    uint32_t* first_words;          // the first word of each word's class
+    uint32_t* ranks;                // each word's place among its class's members
+    uint32_t* member_counts;        // of the class each first word opens
+    uint32_t* classes;              // of each first word
+    uint32_t* slots;                // first word + 1, 0 when empty
+};
+
+extern int begin_word_class_build(word_class_build* Build, word_classes* Classes, alphabet* Alphabet, const char* contents, uint32_t size);
+extern uint32_t get_word_class_stage_size(word_class_build* Build);
+extern void run_word_class_stage(word_class_build* Build, uint32_t index);
+extern int finish_word_class_stage(word_class_build* Build);
+extern int end_word_class_build(word_class_build* Build, int succeeded);
+extern uint64_t get_word_classes_bytes(word_classes* Classes);
+extern void release_word_classes(word_classes* Classes);
+
+#endif
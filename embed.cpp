@@ -0,0 +1,102 @@
+#include <windows.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "alphabet.h"
+#include "embedded.h"
+#include "hooks.h"
+
+/*
+ * Build step: normalizes a dictionary once, the way sch_open would,
+ * derives its hook table, and writes both out as a dictionary index for
+ * sch.rc to embed in sch.exe.
+ *
+ *   embed.exe dictionary.txt dictionary.idx [alphabet]
+ */
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("Usage: embed dictionary_file_path index_file_path [alphabet]\n");
+        return -1;
+    }
+
+    alphabet Alphabet;
+    const char* alphabet_name = (argc > 3) ? argv[3] : "english";
+
+    if (!load_alphabet(&Alphabet, alphabet_name)) {
+        printf("Error loading alphabet \"%s\"\n", alphabet_name);
+        return -1;
+    }
+
+    HANDLE hFile = CreateFileA(argv[1], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        printf("Error opening file \"%s\": %lu\n", argv[1], GetLastError());
+        return -1;
+    }
+
+    DWORD fileSize = GetFileSize(hFile, NULL);
+    char* memory = (fileSize != INVALID_FILE_SIZE) ? (char*) VirtualAlloc(NULL, sizeof(dictionary_index_header) + fileSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE) : NULL;
+    DWORD bytesRead;
+
+    if (!memory || !ReadFile(hFile, memory + sizeof(dictionary_index_header), fileSize, &bytesRead, NULL) || bytesRead != fileSize) {
+        printf("Error reading \"%s\"\n", argv[1]);
+        CloseHandle(hFile);
+        return -1;
+    }
+
+    CloseHandle(hFile);
+
+    dictionary_index_header* Header = (dictionary_index_header*) memory;
+    normalize_stats Normalized = {};
+
+    Header->magic = DICTIONARY_INDEX_MAGIC;
+    Header->version = DICTIONARY_INDEX_VERSION;
+    snprintf(Header->alphabet_name, sizeof(Header->alphabet_name), "%s", Alphabet.name);
+    Header->size = normalize_dictionary(&Alphabet, memory + sizeof(*Header), fileSize, &Normalized);
+    Header->word_count = Normalized.word_count;
+    Header->dropped_word_count = Normalized.dropped_word_count;
+
+    hook_table Hooks;
+
+    if (!create_hook_table(&Hooks, &Alphabet, memory + sizeof(*Header), Header->size)) {
+        printf("Error building the hook table\n");
+        return -1;
+    }
+
+    static const char padding[64] = {};
+    DWORD hooks_size = (DWORD) get_hook_block_size(Hooks.pair_count, Hooks.bucket_count, Hooks.mask_size);
+
+    Header->hooks_offset = (Header->size + 63) & ~63u;
+    Header->hook_pair_count = Hooks.pair_count;
+    Header->hook_bucket_count = Hooks.bucket_count;
+    Header->hook_mask_size = Hooks.mask_size;
+
+    DWORD words_size = (DWORD) sizeof(*Header) + Header->size;
+    DWORD padding_size = Header->hooks_offset - Header->size;
+    DWORD index_size = words_size + padding_size + hooks_size;
+    DWORD bytesWritten[3];
+    HANDLE hIndex = CreateFileA(argv[2], GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (hIndex == INVALID_HANDLE_VALUE ||
+        !WriteFile(hIndex, memory, words_size, bytesWritten + 0, NULL) || bytesWritten[0] != words_size ||
+        !WriteFile(hIndex, padding, padding_size, bytesWritten + 1, NULL) || bytesWritten[1] != padding_size ||
+        !WriteFile(hIndex, Hooks.memory, hooks_size, bytesWritten + 2, NULL) || bytesWritten[2] != hooks_size) {
+        printf("Error writing \"%s\"\n", argv[2]);
+
+        if (hIndex != INVALID_HANDLE_VALUE)
+            CloseHandle(hIndex);
+
+        return -1;
+    }
+
+    CloseHandle(hIndex);
+    printf("%s: %llu %s words, %llu dropped, %u hook pairs, %lu bytes\n", argv[2], Header->word_count, Alphabet.name,
+           Header->dropped_word_count, Hooks.pair_count, index_size);
+    release_hook_table(&Hooks);
+    VirtualFree(memory, 0, MEM_RELEASE);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#if !defined(EMBEDDED_H__)
+#define EMBEDDED_H__
+
+// NOTE: also included by sch.rc, which only reads the #defines
+#define DICTIONARY_INDEX_RESOURCE 101
+#define DICTIONARY_INDEX_MAGIC 0x58444953   // "SIDX"
+#define DICTIONARY_INDEX_VERSION 2
+
+#if !defined(RC_INVOKED)
+
+#include <stdint.h>
+
+/*
+ * A dictionary index as embed.exe writes it and build.bat links it into
+ * sch.exe: this header, then the dictionary normalized for the named
+ * alphabet, one word of tile codes per line, then the block of its hook
+ * table (see hooks.h). The engine scans and looks up both where they
+ * lie in the image.
+ */
+struct dictionary_index_header {
+    uint32_t magic;
+    uint32_t version;
+    char alphabet_name[64];
+    uint64_t word_count;
+    uint64_t dropped_word_count;
+    uint32_t size;                  // normalized bytes after the header
+    uint32_t hooks_offset;          // of the hook block after the header, 64-byte aligned
+    uint32_t hook_pair_count;
+    uint32_t hook_bucket_count;
+    uint32_t hook_mask_size;
+    uint32_t reserved[5];           // keeps the words 64-byte aligned
+};
+
+#endif
+
+#endif
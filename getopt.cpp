@@ -19,6 +19,14 @@ enum ENUM_ORDERING {
 #include <intrin.h>
 #include <assert.h>
 
+// NOTE: the 64-byte loads below may read past the terminator; blocks
+// that would run into the next page are handled a byte at a time so the
+// overread never touches an unmapped page (argv sits at the stack top)
+__forceinline int crosses_page(const char* P)
+{
+	return ((uintptr_t) P & 4095) > 4096 - 64;
+}
+
 size_t
 sstrlen(const char* Str)
 {
@@ -27,13 +35,23 @@ sstrlen(const char* Str)
     size_t Result = 0;
 
     for (;;) {
+        if (crosses_page(Str + Result)) {
+            for (int I = 0; I < 64; ++I) {
+                if (!Str[Result + I])
+                    return Result + I;
+            }
+
+            Result += 64;
+            continue;
+        }
+
         const __m512i V = _mm512_loadu_si512(Str + Result);
         const __m512i V1 = _mm512_sub_epi32(V, V01);
         const __m512i HasZero = _mm512_ternarylogic_epi32(V1, V, V80, 0x20);
         const __mmask16 Mask = _mm512_test_epi32_mask(HasZero, HasZero);
 
         if (Mask) {
-            const size_t N = __lzcnt(Mask);
+            const size_t N = _tzcnt_u32(Mask);
 
             if (!Str[Result + 4 * N + 0])
                 return Result + 4 * N + 0;
@@ -74,6 +92,20 @@ sstrcmp(const char* Str1, const char* Str2)
     __mmask16 Either;
 
     for (;;) {
+        if (crosses_page(C1) || crosses_page(C2)) {
+            for (int I = 0; I < 64; ++I) {
+                int A = C1[I];
+                int B = C2[I];
+
+                if (A != B || !A)
+                    return A - B;
+            }
+
+            C1 += 64;
+            C2 += 64;
+            continue;
+        }
+
         const __m512i V1 = _mm512_loadu_si512(C1);
         const __m512i V2 = _mm512_loadu_si512(C2);
 
@@ -88,7 +120,7 @@ sstrcmp(const char* Str1, const char* Str2)
         C2 += 64;
     }
 
-    const size_t N = __lzcnt(Either);
+    const size_t N = _tzcnt_u32(Either);
 
     C1 += N * 4;
     C2 += N * 4;
@@ -115,7 +147,7 @@ sstrncmp(const char* Str1, const char* Str2, size_t N)
 	__mmask16 Either;
 	size_t I = 0;
 
-	while (I < N) {
+	while (I + 64 <= N && !crosses_page(C1) && !crosses_page(C2)) {
 		const __m512i V1 = _mm512_loadu_si512(C1);
 		const __m512i V2 = _mm512_loadu_si512(C2);
 
@@ -133,16 +165,14 @@ sstrncmp(const char* Str1, const char* Str2, size_t N)
 
 	size_t Remaining = N - I;
 
-	if (Remaining > 0) {
-		const size_t N_Chunks = Remaining / 4;
+	// NOTE: the block above only skips 64 bytes with no difference and no
+	// terminator, the rest is compared byte by byte
+	for (size_t J = 0; J < Remaining; ++J) {
+		int A = C1[J];
+		int B = C2[J];
 
-		for (size_t J = 0; J < N_Chunks; ++J) {
-			int A = C1[J];
-			int B = C2[J];
-
-			if (A != B || !A)
-				return A - B;
-		}
+		if (A != B || !A)
+			return A - B;
 	}
 
 	return 0;
@@ -607,6 +637,12 @@ _getopt_internal_a (int argc, char *const *argv, const char *optstring, const st
 	return result;
 }
 
+int 
+getopt_long(int argc, char *const *argv, const char *optstring, const struct option_a *longopts, int *longind) throw()
+{
+	return _getopt_internal_a (argc, argv, optstring, longopts, longind, 0, 0);
+}
+
 int 
 getopt(int argc, char *const *argv, const char *optstring) throw()
 {
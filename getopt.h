@@ -27,5 +27,6 @@ struct option_a {
 
 extern char* optarg;
 extern int getopt(int argc, char* const* argv, const char* optstring) throw();
+extern int getopt_long(int argc, char* const* argv, const char* optstring, const struct option_a* longopts, int* longind) throw();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include <string.h>
+#include "hash.h"
+
+uint64_t
+mix_hash(uint64_t h)
+{
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+
+    return h ^ (h >> 32);
+}
+
+uint64_t
+hash_bytes(const void* data, uint32_t length, uint64_t seed)
+{
+    const char* bytes = (const char*) data;
+    uint64_t h = seed ^ ((uint64_t) length * 0x9E3779B97F4A7C15ull);
+
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, bytes, 8);
+        h = mix_hash(h ^ chunk);
+    }
+
+    if (length) {
+        uint64_t chunk = 0;
+        memcpy(&chunk, bytes, length);
+        h = mix_hash(h ^ chunk);
+    }
+
+    return h;
+}
@@ -0,0 +1,15 @@
+#if !defined(HASH_H__)
+#define HASH_H__
+
+#include <stdint.h>
+
+/*
+ * The one hash the tables share. mix_hash scrambles a 64-bit value;
+ * hash_bytes folds a run of bytes into it 8 at a time, the tail zero
+ * padded, starting from seed mixed with the length. Word set, anagram
+ * classes, rack table and hook table all hash through these.
+ */
+extern uint64_t mix_hash(uint64_t h);
+extern uint64_t hash_bytes(const void* data, uint32_t length, uint64_t seed);
+
+#endif
@@ -0,0 +1,548 @@
+#include <windows.h>
+#include <string.h>
+#include <immintrin.h>
+#include "hooks.h"
+#include "hash.h"
+
+#define HOOK_SEED 0x484F4F4Bull     // "HOOK"
+
+struct hook_key {
+    uint64_t hash;
+    uint32_t offset;
+    uint8_t gap;
+    uint8_t length;                 // of the word
+    uint8_t code;                   // the tile taken out
+};
+
+// NOTE: the fragments are hashed as one run of tiles, seeded with the
+// gap, so ("ca", "t") and ("c", "at") hash apart
+static uint64_t
+hash_fragments(const char* key, uint32_t length, uint32_t gap)
+{
+    return mix_hash(hash_bytes(key, length, HOOK_SEED ^ ((uint64_t) gap << 48)));
+}
+
+static uint32_t
+get_bucket(hook_table* Hooks, uint64_t hash)
+{
+    return (uint32_t) (((hash >> 32) * Hooks->bucket_count) >> 32);
+}
+
+static uint16_t
+get_tag(uint64_t hash, uint32_t gap)
+{
+    return (uint16_t) (gap << 8 | (uint8_t) hash);
+}
+
+static uint64_t
+get_pair_mask(hook_table* Hooks, uint32_t pair)
+{
+    if (Hooks->mask_size == 4)
+        return ((uint32_t*) Hooks->masks)[pair];
+
+    return ((uint64_t*) Hooks->masks)[pair];
+}
+
+static int
+is_same_pair(const char* contents, hook_key* A, hook_key* B)
+{
+    return A->hash == B->hash && A->gap == B->gap && A->length == B->length &&
+           !memcmp(contents + A->offset, contents + B->offset, A->gap) &&
+           !memcmp(contents + A->offset + A->gap + 1, contents + B->offset + B->gap + 1, A->length - A->gap - 1);
+}
+
+uint64_t
+get_hook_block_size(uint32_t pair_count, uint32_t bucket_count, uint32_t mask_size)
+{
+    return (uint64_t) pair_count * mask_size + ((uint64_t) bucket_count + 1) * sizeof(uint32_t) +
+           (uint64_t) pair_count * (sizeof(uint32_t) + sizeof(uint16_t));
+}
+
+// NOTE: widest arrays first, so each one starts aligned to its width
+void
+place_hook_table(hook_table* Hooks, const char* block, uint32_t pair_count, uint32_t bucket_count, uint32_t mask_size,
+                 const char* contents, uint32_t size)
+{
+    char* memory = (char*) block;
+
+    Hooks->pair_count = pair_count;
+    Hooks->bucket_count = bucket_count;
+    Hooks->mask_size = mask_size;
+    Hooks->masks = (uint8_t*) memory;
+    memory += (size_t) pair_count * mask_size;
+    Hooks->bucket_starts = (uint32_t*) memory;
+    memory += ((size_t) bucket_count + 1) * sizeof(uint32_t);
+    Hooks->offsets = (uint32_t*) memory;
+    memory += (size_t) pair_count * sizeof(uint32_t);
+    Hooks->tags = (uint16_t*) memory;
+    Hooks->contents = contents;
+    Hooks->contents_size = size;
+}
+
+/*
+ * Sets up a build over a normalized dictionary, which has to stay mapped
+ * for as long as the table is used.
+ */
+int
+begin_hook_table_build(hook_table_build* Build, hook_table* Hooks, alphabet* Alphabet, const char* contents, uint32_t size)
+{
+    memset(Build, 0, sizeof(*Build));
+    memset(Hooks, 0, sizeof(*Hooks));
+    Build->Hooks = Hooks;
+    Build->contents = contents;
+    Build->size = size;
+    Build->mask_size = (Alphabet->size > 32) ? 8 : 4;
+
+    return begin_staged_build(&Build->Stages, contents, size, HOOK_RANGE_COUNT, HOOK_SHARD_COUNT);
+}
+
+uint32_t
+get_hook_stage_size(hook_table_build* Build)
+{
+    return (Build->stage >= HOOK_STAGE_MERGE) ? HOOK_SHARD_COUNT : HOOK_RANGE_COUNT;
+}
+
+static uint32_t
+get_shard(hook_table_build* Build, uint64_t hash)
+{
+    return get_bucket(Build->Hooks, hash) / Build->shard_bucket_count;
+}
+
+/*
+ * Counting-sorts one shard's pairs into buckets, in dictionary order,
+ * then merges the equal pairs of each bucket (cat, bat, eat all leave
+ * _ + at), ORing the tiles they were missing into one mask. Merging
+ * compacts the shard's order in place, since a bucket never keeps more
+ * pairs than it was given.
+ */
+static void
+merge_shard(hook_table_build* Build, uint32_t shard)
+{
+    uint32_t first_key = Build->shard_keys[shard];
+    uint32_t key_count = Build->shard_keys[shard + 1] - first_key;
+    uint32_t bucket_count = Build->shard_bucket_count;
+    uint32_t first_bucket = shard * bucket_count;
+    uint32_t* sharded_keys = Build->sharded_keys + first_key;
+    uint32_t* order = Build->order + first_key;
+    uint64_t* pair_masks = Build->pair_masks + first_key;
+    uint32_t* bucket_starts = Build->bucket_starts + (size_t) shard * (bucket_count + 1);
+    hook_key* keys = Build->keys;
+
+    memset(bucket_starts, 0, (bucket_count + 1) * sizeof(uint32_t));
+
+    for (uint32_t k = 0; k < key_count; ++k)
+        ++bucket_starts[get_bucket(Build->Hooks, keys[sharded_keys[k]].hash) - first_bucket + 1];
+
+    for (uint32_t b = 0; b < bucket_count; ++b)
+        bucket_starts[b + 1] += bucket_starts[b];
+
+    // NOTE: scattering moves every start up to the next bucket's, and
+    // shifting them back down restores them
+    for (uint32_t k = 0; k < key_count; ++k)
+        order[bucket_starts[get_bucket(Build->Hooks, keys[sharded_keys[k]].hash) - first_bucket]++] = sharded_keys[k];
+
+    for (uint32_t b = bucket_count; b > 0; --b)
+        bucket_starts[b] = bucket_starts[b - 1];
+
+    bucket_starts[0] = 0;
+
+    uint32_t pair_count = 0;
+
+    for (uint32_t b = 0; b < bucket_count; ++b) {
+        uint32_t first_pair = pair_count;
+        uint32_t end = bucket_starts[b + 1];
+
+        for (uint32_t k = bucket_starts[b]; k < end; ++k) {
+            hook_key* Key = keys + order[k];
+            uint32_t pair = first_pair;
+
+            while (pair < pair_count && !is_same_pair(Build->contents, keys + order[pair], Key))
+                ++pair;
+
+            if (pair == pair_count) {
+                order[pair_count] = order[k];
+                pair_masks[pair_count++] = 0;
+            }
+
+            pair_masks[pair] |= (uint64_t) 1 << Key->code;
+        }
+
+        bucket_starts[b] = first_pair;
+    }
+
+    bucket_starts[bucket_count] = pair_count;
+}
+
+static void
+place_shard(hook_table_build* Build, uint32_t shard)
+{
+    hook_table* Hooks = Build->Hooks;
+    uint32_t first_key = Build->shard_keys[shard];
+    uint32_t first_pair = Build->shard_pairs[shard];
+    uint32_t pair_count = Build->shard_pairs[shard + 1] - first_pair;
+    uint32_t bucket_count = Build->shard_bucket_count;
+    uint32_t* bucket_starts = Build->bucket_starts + (size_t) shard * (bucket_count + 1);
+
+    for (uint32_t b = 0; b < bucket_count; ++b)
+        Hooks->bucket_starts[shard * bucket_count + b] = first_pair + bucket_starts[b];
+
+    for (uint32_t p = 0; p < pair_count; ++p) {
+        hook_key* Key = Build->keys + Build->order[first_key + p];
+        uint64_t mask = Build->pair_masks[first_key + p];
+        uint32_t pair = first_pair + p;
+
+        Hooks->offsets[pair] = Key->offset;
+        Hooks->tags[pair] = get_tag(Key->hash, Key->gap);
+
+        if (Hooks->mask_size == 4)
+            ((uint32_t*) Hooks->masks)[pair] = (uint32_t) mask;
+        else
+            ((uint64_t*) Hooks->masks)[pair] = mask;
+    }
+}
+
+// NOTE: index is a range for SPLIT, HASH and SCATTER, a shard after
+void
+run_hook_stage(hook_table_build* Build, uint32_t index)
+{
+    const char* contents = Build->contents;
+
+    switch (Build->stage) {
+    case HOOK_STAGE_SPLIT: {
+        uint32_t key_count = 0;
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < Build->Stages.range_starts[index + 1];) {
+            uint32_t start = i;
+
+            while (i < Build->size && contents[i] != '\n')
+                ++i;
+
+            if (i - start <= HOOK_MAX_WORD_LENGTH)
+                key_count += i - start;
+
+            ++i;
+        }
+
+        Build->range_keys[index + 1] = key_count;
+    } break;
+
+    case HOOK_STAGE_HASH: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * HOOK_SHARD_COUNT;
+        uint32_t key = Build->range_keys[index];
+        char text[HOOK_MAX_WORD_LENGTH];
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < Build->Stages.range_starts[index + 1];) {
+            uint32_t start = i;
+
+            while (i < Build->size && contents[i] != '\n')
+                ++i;
+
+            uint32_t length = i++ - start;
+
+            if (length > HOOK_MAX_WORD_LENGTH)
+                continue;
+
+            for (uint32_t gap = 0; gap < length; ++gap) {
+                hook_key* Key = Build->keys + key++;
+
+                memcpy(text, contents + start, gap);
+                memcpy(text + gap, contents + start + gap + 1, length - gap - 1);
+                Key->hash = hash_fragments(text, length - 1, gap);
+                Key->offset = start;
+                Key->gap = (uint8_t) gap;
+                Key->length = (uint8_t) length;
+                Key->code = (uint8_t) (contents[start + gap] - TILE_CODE_BASE);
+                ++shard_counts[get_shard(Build, Key->hash)];
+            }
+        }
+    } break;
+
+    case HOOK_STAGE_SCATTER: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * HOOK_SHARD_COUNT;
+
+        for (uint32_t k = Build->range_keys[index]; k < Build->range_keys[index + 1]; ++k)
+            Build->sharded_keys[shard_counts[get_shard(Build, Build->keys[k].hash)]++] = k;
+    } break;
+
+    case HOOK_STAGE_MERGE:
+        merge_shard(Build, index);
+        break;
+
+    case HOOK_STAGE_PLACE:
+        place_shard(Build, index);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// NOTE: sized once the pairs are counted, for as many as every word
+// leaves before any are merged
+static int
+allocate_hook_build(hook_table_build* Build)
+{
+    uint32_t key_count = Build->key_count;
+
+    Build->shard_bucket_count = key_count / (HOOK_BUCKET_SIZE * HOOK_SHARD_COUNT) + 1;
+    Build->Hooks->bucket_count = Build->shard_bucket_count * HOOK_SHARD_COUNT;
+
+    size_t keys_size = ((size_t) key_count + 1) * sizeof(hook_key);
+    size_t index_size = (((size_t) key_count + 2) & ~(size_t) 1) * sizeof(uint32_t);
+    size_t pair_masks_size = ((size_t) key_count + 1) * sizeof(uint64_t);
+    size_t bucket_starts_size = (size_t) HOOK_SHARD_COUNT * (Build->shard_bucket_count + 1) * sizeof(uint32_t);
+
+    Build->Stages.scratch = (char*) VirtualAlloc(NULL, keys_size + pair_masks_size + 2 * index_size + bucket_starts_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Build->Stages.scratch)
+        return 0;
+
+    char* scratch = Build->Stages.scratch;
+    Build->keys = (hook_key*) scratch;
+    Build->pair_masks = (uint64_t*) (scratch += keys_size);
+    Build->sharded_keys = (uint32_t*) (scratch += pair_masks_size);
+    Build->order = (uint32_t*) (scratch += index_size);
+    Build->bucket_starts = (uint32_t*) (scratch + index_size);
+
+    return 1;
+}
+
+// NOTE: shards take their pairs in shard order, and the table is sized
+// once they are merged
+static int
+allocate_hook_table(hook_table_build* Build)
+{
+    hook_table* Hooks = Build->Hooks;
+    uint32_t pair_count = 0;
+
+    for (uint32_t s = 0; s < HOOK_SHARD_COUNT; ++s) {
+        uint32_t shard_pair_count = Build->bucket_starts[(size_t) s * (Build->shard_bucket_count + 1) + Build->shard_bucket_count];
+
+        Build->shard_pairs[s] = pair_count;
+        pair_count += shard_pair_count;
+    }
+
+    Build->shard_pairs[HOOK_SHARD_COUNT] = pair_count;
+
+    char* memory = (char*) VirtualAlloc(NULL, get_hook_block_size(pair_count, Hooks->bucket_count, Build->mask_size), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!memory)
+        return 0;
+
+    place_hook_table(Hooks, memory, pair_count, Hooks->bucket_count, Build->mask_size, Build->contents, Build->size);
+    Hooks->memory = memory;
+    Hooks->bucket_starts[Hooks->bucket_count] = pair_count;
+
+    return 1;
+}
+
+// NOTE: returns 0 when the build cannot go on
+int
+finish_hook_stage(hook_table_build* Build)
+{
+    switch (Build->stage) {
+    case HOOK_STAGE_SPLIT:
+        for (uint32_t r = 0; r < HOOK_RANGE_COUNT; ++r)
+            Build->range_keys[r + 1] += Build->range_keys[r];
+
+        Build->key_count = Build->range_keys[HOOK_RANGE_COUNT];
+
+        return allocate_hook_build(Build);
+
+    case HOOK_STAGE_HASH:
+        assign_shard_starts(&Build->Stages, Build->shard_keys);
+        return 1;
+
+    case HOOK_STAGE_MERGE:
+        return allocate_hook_table(Build);
+
+    default:
+        return 1;
+    }
+}
+
+int
+end_hook_table_build(hook_table_build* Build, int succeeded)
+{
+    end_staged_build(&Build->Stages);
+
+    if (!succeeded)
+        release_hook_table(Build->Hooks);
+
+    return succeeded;
+}
+
+/*
+ * The same stages one item at a time on the calling thread, for
+ * embed.exe, which has no pool; the table comes out as a pooled build's.
+ */
+int
+create_hook_table(hook_table* Hooks, alphabet* Alphabet, const char* contents, uint32_t size)
+{
+    hook_table_build Build;
+    int Result = begin_hook_table_build(&Build, Hooks, Alphabet, contents, size);
+
+    for (int stage = HOOK_STAGE_SPLIT; Result && stage < HOOK_STAGE_COUNT; ++stage) {
+        Build.stage = (hook_stage) stage;
+
+        for (uint32_t i = 0; i < get_hook_stage_size(&Build); ++i)
+            run_hook_stage(&Build, i);
+
+        Result = finish_hook_stage(&Build);
+    }
+
+    return end_hook_table_build(&Build, Result);
+}
+
+static uint32_t
+find_candidate(hook_table* Hooks, uint32_t pair, uint32_t end, uint16_t tag)
+{
+    while (pair < end && Hooks->tags[pair] != tag)
+        ++pair;
+
+    return pair;
+}
+
+// NOTE: the stored word has to be exactly one tile longer than the key;
+// the key holds no line breaks, so a shorter word fails the compare
+static int
+is_pair(hook_table* Hooks, uint32_t pair, const char* key, uint32_t length, uint32_t gap)
+{
+    const char* word = Hooks->contents + Hooks->offsets[pair];
+    uint32_t word_end = Hooks->offsets[pair] + length + 1;
+
+    return word_end <= Hooks->contents_size &&
+           (word_end == Hooks->contents_size || Hooks->contents[word_end] == '\n') &&
+           !memcmp(word, key, gap) && !memcmp(word + gap + 1, key + gap, length - gap);
+}
+
+static uint64_t
+find_pair_mask(hook_table* Hooks, uint32_t pair, uint32_t end, const char* key, uint32_t length, uint32_t gap, uint16_t tag)
+{
+    for (; pair < end; pair = find_candidate(Hooks, pair + 1, end, tag)) {
+        if (is_pair(Hooks, pair, key, length, gap))
+            return get_pair_mask(Hooks, pair);
+    }
+
+    return 0;
+}
+
+// NOTE: 0 for blanks, letters outside the alphabet or words too long to
+// have been kept
+static int
+normalize_fragments(alphabet* Alphabet, const char* before, const char* after, char* key, uint32_t* length, uint32_t* gap)
+{
+    uint8_t codes[2][HOOK_MAX_WORD_LENGTH];
+    int before_count = get_tile_codes(Alphabet, before ? before : "", codes[0], HOOK_MAX_WORD_LENGTH);
+    int after_count = get_tile_codes(Alphabet, after ? after : "", codes[1], HOOK_MAX_WORD_LENGTH);
+
+    if (before_count < 0 || after_count < 0 || before_count + after_count + 1 > HOOK_MAX_WORD_LENGTH)
+        return 0;
+
+    for (int i = 0; i < before_count + after_count; ++i) {
+        uint8_t code = (i < before_count) ? codes[0][i] : codes[1][i - before_count];
+
+        if (code == BLANK_CODE)
+            return 0;
+
+        key[i] = (char) (TILE_CODE_BASE + code);
+    }
+
+    *length = (uint32_t) (before_count + after_count);
+    *gap = (uint32_t) before_count;
+
+    return 1;
+}
+
+/*
+ * One batch of keys in tile codes, the fragments back to back; a NULL
+ * key is no pair. Goes one stage at a time across the batch, each
+ * prefetching what the next reads, as word checks do: the bucket, its
+ * tags, then the first pair whose tag matches and the word it is
+ * verified against.
+ */
+static void
+look_up_pairs(hook_table* Hooks, const char* const* keys, const uint32_t* lengths, const uint32_t* gaps, uint32_t batch, uint64_t* masks)
+{
+    uint32_t buckets[HOOK_BATCH_SIZE];
+    uint32_t pairs[HOOK_BATCH_SIZE];
+    uint32_t ends[HOOK_BATCH_SIZE];
+    uint16_t tags[HOOK_BATCH_SIZE];
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        if (keys[i]) {
+            uint64_t hash = hash_fragments(keys[i], lengths[i], gaps[i]);
+            buckets[i] = get_bucket(Hooks, hash);
+            tags[i] = get_tag(hash, gaps[i]);
+            _mm_prefetch((const char*) (Hooks->bucket_starts + buckets[i]), _MM_HINT_T0);
+        }
+    }
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        pairs[i] = ends[i] = 0;
+
+        if (keys[i]) {
+            pairs[i] = Hooks->bucket_starts[buckets[i]];
+            ends[i] = Hooks->bucket_starts[buckets[i] + 1];
+            _mm_prefetch((const char*) (Hooks->tags + pairs[i]), _MM_HINT_T0);
+        }
+    }
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        pairs[i] = find_candidate(Hooks, pairs[i], ends[i], tags[i]);
+
+        if (pairs[i] < ends[i]) {
+            _mm_prefetch((const char*) (Hooks->offsets + pairs[i]), _MM_HINT_T0);
+            _mm_prefetch((const char*) (Hooks->masks + (size_t) pairs[i] * Hooks->mask_size), _MM_HINT_T0);
+        }
+    }
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        if (pairs[i] < ends[i])
+            _mm_prefetch(Hooks->contents + Hooks->offsets[pairs[i]], _MM_HINT_T0);
+    }
+
+    for (uint32_t i = 0; i < batch; ++i)
+        masks[i] = find_pair_mask(Hooks, pairs[i], ends[i], keys[i], lengths[i], gaps[i], tags[i]);
+}
+
+void
+cross_check_tiles(hook_table* Hooks, const char* const* keys, const uint32_t* lengths, const uint32_t* gaps, uint32_t count, uint64_t* masks)
+{
+    for (uint32_t first = 0; first < count; first += HOOK_BATCH_SIZE) {
+        uint32_t batch = (count - first < HOOK_BATCH_SIZE) ? count - first : HOOK_BATCH_SIZE;
+        look_up_pairs(Hooks, keys + first, lengths + first, gaps + first, batch, masks + first);
+    }
+}
+
+/*
+ * Sets masks[i] to the tiles that fit between before[i] and after[i],
+ * turning each batch into tile codes before looking it up. Read-only,
+ * so any number of threads can look up at once.
+ */
+void
+cross_check(hook_table* Hooks, alphabet* Alphabet, const char* const* before, const char* const* after, uint32_t count, uint64_t* masks)
+{
+    char text[HOOK_BATCH_SIZE][HOOK_MAX_WORD_LENGTH];
+    const char* keys[HOOK_BATCH_SIZE];
+    uint32_t lengths[HOOK_BATCH_SIZE];
+    uint32_t gaps[HOOK_BATCH_SIZE];
+
+    for (uint32_t first = 0; first < count; first += HOOK_BATCH_SIZE) {
+        uint32_t batch = (count - first < HOOK_BATCH_SIZE) ? count - first : HOOK_BATCH_SIZE;
+
+        for (uint32_t i = 0; i < batch; ++i)
+            keys[i] = normalize_fragments(Alphabet, before[first + i], after[first + i], text[i], lengths + i, gaps + i) ? text[i] : NULL;
+
+        look_up_pairs(Hooks, keys, lengths, gaps, batch, masks + first);
+    }
+}
+
+void
+release_hook_table(hook_table* Hooks)
+{
+    if (Hooks->memory)
+        VirtualFree(Hooks->memory, 0, MEM_RELEASE);
+
+    memset(Hooks, 0, sizeof(*Hooks));
+}
@@ -0,0 +1,93 @@
+#if !defined(HOOKS_H__)
+#define HOOKS_H__
+
+#include <windows.h>
+#include <stdint.h>
+#include "alphabet.h"
+#include "build.h"
+
+#define HOOK_MAX_WORD_LENGTH 255        // gaps are kept in a byte
+#define HOOK_BUCKET_SIZE 4              // average fragments per bucket, before merging
+#define HOOK_BATCH_SIZE 32
+#define HOOK_SHARD_COUNT 256
+#define HOOK_RANGE_COUNT 64
+
+/*
+ * Cross-checks for board play. Taking one tile out of a dictionary word
+ * leaves a pair of fragments, the tiles before the gap and the tiles
+ * after it; the table keeps every such pair once, with the mask of tiles
+ * that fill the gap to make a word. Front and back hooks are the pairs
+ * with an empty fragment, such as _ + at or cat + _. A mask has bit k
+ * set for tile code k, as in letter masks.
+ *
+ * Pairs are grouped by hash into buckets. Each keeps a tag, its gap and
+ * an 8-bit fingerprint, and the offset of a word it was taken from,
+ * against which a hit is compared, so answers are exact. Everything is
+ * one block of arrays with no pointers in it, which embed.exe writes
+ * into the dictionary index as it is.
+ */
+struct hook_table {
+    uint32_t pair_count;
+    uint32_t bucket_count;
+    uint32_t mask_size;             // 4 for alphabets of up to 32 tiles, 8 otherwise
+    uint8_t* masks;                 // mask_size bytes per pair
+    uint32_t* bucket_starts;        // bucket_count + 1 entries into the pairs
+    uint32_t* offsets;              // a word the pair was taken from
+    uint16_t* tags;                 // tiles before the gap << 8 | fingerprint
+    const char* contents;           // the dictionary the offsets point into
+    uint32_t contents_size;
+    char* memory;                   // NULL when the block lies in the dictionary index
+};
+
+enum hook_stage {
+    HOOK_STAGE_SPLIT,           // per range: count its fragment pairs
+    HOOK_STAGE_HASH,            // per range: hash its pairs, count them per shard
+    HOOK_STAGE_SCATTER,         // per range: list its pairs under their shards
+    HOOK_STAGE_MERGE,           // per shard: bucket its pairs, merge the equal ones
+    HOOK_STAGE_PLACE,           // per shard: write its pairs into the table
+    HOOK_STAGE_COUNT
+};
+
+struct hook_key;
+
+/*
+ * A hook table built in stages over a staged_build. Shards own runs of
+ * equal numbers of buckets, so every pair of a bucket lands in one shard
+ * and shards merge independently of each other; embed.exe and the engine
+ * write the same bytes.
+ *
+ *   begin, then SPLIT, HASH, SCATTER, MERGE, PLACE, each followed by finish
+ */
+struct hook_table_build {
+    hook_table* Hooks;
+    const char* contents;
+    uint32_t size;
+    uint32_t mask_size;
+    hook_stage stage;
+    staged_build Stages;
+    uint32_t range_keys[HOOK_RANGE_COUNT + 1];      // first key of each range
+    uint32_t shard_keys[HOOK_SHARD_COUNT + 1];      // first key of each shard
+    uint32_t shard_pairs[HOOK_SHARD_COUNT + 1];     // first pair of each shard, once merged
+    uint32_t shard_bucket_count;
+    uint32_t key_count;
+    hook_key* keys;                 // dictionary order
+    uint32_t* sharded_keys;         // by shard, dictionary order within
+    uint32_t* order;                // by bucket within a shard, then its merged pairs
+    uint64_t* pair_masks;
+    uint32_t* bucket_starts;        // shard_bucket_count + 1 per shard
+};
+
+extern int begin_hook_table_build(hook_table_build* Build, hook_table* Hooks, alphabet* Alphabet, const char* contents, uint32_t size);
+extern uint32_t get_hook_stage_size(hook_table_build* Build);
+extern void run_hook_stage(hook_table_build* Build, uint32_t index);
+extern int finish_hook_stage(hook_table_build* Build);
+extern int end_hook_table_build(hook_table_build* Build, int succeeded);
+extern int create_hook_table(hook_table* Hooks, alphabet* Alphabet, const char* contents, uint32_t size);
+extern uint64_t get_hook_block_size(uint32_t pair_count, uint32_t bucket_count, uint32_t mask_size);
+extern void place_hook_table(hook_table* Hooks, const char* block, uint32_t pair_count, uint32_t bucket_count, uint32_t mask_size,
+                             const char* contents, uint32_t size);
+extern void cross_check(hook_table* Hooks, alphabet* Alphabet, const char* const* before, const char* const* after, uint32_t count, uint64_t* masks);
+extern void cross_check_tiles(hook_table* Hooks, const char* const* keys, const uint32_t* lengths, const uint32_t* gaps, uint32_t count, uint64_t* masks);
+extern void release_hook_table(hook_table* Hooks);
+
+#endif
@@ -0,0 +1,310 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "leaves.h"
+
+static void
+init_leave_ranks(leave_table* Table, uint32_t symbol_count)
+{
+    Table->symbol_count = symbol_count;
+
+    for (uint32_t n = 0; n < MAX_LEAVE_SYMBOLS + LEAVE_MAX_TILES; ++n) {
+        Table->binomial[n][0] = 1;
+
+        for (uint32_t k = 1; k <= LEAVE_MAX_TILES; ++k)
+            Table->binomial[n][k] = n ? Table->binomial[n - 1][k - 1] + Table->binomial[n - 1][k] : 0;
+    }
+
+    // NOTE: there are C(symbols + k - 1, k) multisets of size k
+    Table->size_offsets[0] = 0;
+
+    for (uint32_t k = 0; k <= LEAVE_MAX_TILES; ++k)
+        Table->size_offsets[k + 1] = Table->size_offsets[k] + Table->binomial[symbol_count + k - 1][k];
+
+    Table->entry_count = Table->size_offsets[LEAVE_MAX_TILES + 1];
+}
+
+/*
+ * symbols must be sorted ascending. A sorted multiset c0 <= c1 <= ...
+ * maps to the strictly increasing c0 < c1 + 1 < c2 + 2 < ..., which the
+ * combinatorial number system ranks densely.
+ */
+static uint64_t
+get_leave_rank(leave_table* Table, const uint8_t* symbols, uint32_t count)
+{
+    uint64_t rank = Table->size_offsets[count];
+
+    for (uint32_t i = 0; i < count; ++i)
+        rank += Table->binomial[symbols[i] + i][i + 1];
+
+    return rank;
+}
+
+static void
+sort_bytes(uint8_t* bytes, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; ++i) {
+        uint8_t value = bytes[i];
+        uint32_t j = i;
+
+        while (j > 0 && bytes[j - 1] > value) {
+            bytes[j] = bytes[j - 1];
+            --j;
+        }
+
+        bytes[j] = value;
+    }
+}
+
+/*
+ * Allocates an empty table for the alphabet, laid out exactly like the
+ * file so it can be written in one go.
+ */
+int
+create_leave_table(leave_table* Table, alphabet* Alphabet)
+{
+    memset(Table, 0, sizeof(*Table));
+    init_leave_ranks(Table, Alphabet->size + 1);
+
+    size_t image_size = sizeof(leave_table_header) + Table->entry_count * sizeof(leave_stats);
+    Table->Header = (leave_table_header*) VirtualAlloc(NULL, image_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Table->Header)
+        return 0;
+
+    leave_table_header* Header = Table->Header;
+    Header->magic = LEAVE_TABLE_MAGIC;
+    Header->version = LEAVE_TABLE_VERSION;
+    Header->symbol_count = Table->symbol_count;
+    Header->max_tiles = LEAVE_MAX_TILES;
+    Header->entry_count = Table->entry_count;
+    snprintf(Header->alphabet_name, sizeof(Header->alphabet_name), "%s", Alphabet->name);
+    memcpy(Header->values, Alphabet->values, sizeof(Header->values));
+
+    Table->entries = (leave_stats*) (Header + 1);
+
+    return 1;
+}
+
+static void
+add_leave_word(leave_stats* Entry, uint32_t score, uint8_t bingo)
+{
+    InterlockedIncrement((volatile LONG*) &Entry->word_count);
+
+    if (bingo)
+        InterlockedIncrement((volatile LONG*) &Entry->bingo_count);
+
+    if (score >= LEAVE_HIGH_SCORE)
+        InterlockedIncrement((volatile LONG*) &Entry->high_score_count);
+
+    LONG best = (LONG) Entry->best_score;
+
+    while ((LONG) score > best) {
+        LONG seen = InterlockedCompareExchange((volatile LONG*) &Entry->best_score, (LONG) score, best);
+
+        if (seen == best)
+            break;
+
+        best = seen;
+    }
+}
+
+/*
+ * Credits one word to every leave it can be played from: each
+ * sub-multiset of its tiles, plus any number of blanks standing in for
+ * the tiles left over. Safe to call from several threads at once.
+ */
+void
+add_word_leaves(leave_table* Table, const uint8_t* codes, uint32_t length)
+{
+    if (!length || length > LEAVE_RACK_TILES)
+        return;
+
+    uint8_t* values = Table->Header->values;
+    uint8_t sorted[LEAVE_RACK_TILES];
+    uint8_t letters[LEAVE_RACK_TILES];
+    uint8_t counts[LEAVE_RACK_TILES];
+    uint8_t take[LEAVE_RACK_TILES] = {};
+    uint32_t distinct = 0;
+    uint32_t word_score = 0;
+
+    memcpy(sorted, codes, length);
+    sort_bytes(sorted, length);
+
+    for (uint32_t i = 0; i < length; ++i) {
+        word_score += values[sorted[i]];
+
+        if (!distinct || letters[distinct - 1] != sorted[i]) {
+            letters[distinct] = sorted[i];
+            counts[distinct++] = 0;
+        }
+
+        ++counts[distinct - 1];
+    }
+
+    const uint8_t blank_symbol = (uint8_t) (Table->symbol_count - 1);
+    const uint8_t bingo = length == LEAVE_RACK_TILES;
+
+    // NOTE: odometer over how many copies of each distinct letter the
+    // leave keeps
+    for (;;) {
+        uint8_t symbols[LEAVE_RACK_TILES];
+        uint8_t rest[LEAVE_RACK_TILES];
+        uint32_t kept = 0;
+        uint32_t rest_count = 0;
+
+        for (uint32_t d = 0; d < distinct; ++d) {
+            for (uint32_t c = 0; c < take[d]; ++c)
+                symbols[kept++] = letters[d];
+
+            for (uint32_t c = take[d]; c < counts[d]; ++c)
+                rest[rest_count++] = values[letters[d]];
+        }
+
+        // NOTE: blanks take the cheapest of the remaining letters
+        sort_bytes(rest, rest_count);
+        uint32_t blank_value = 0;
+
+        for (uint32_t blanks = 0; kept + blanks <= LEAVE_MAX_TILES && blanks <= rest_count; ++blanks) {
+            if (blanks) {
+                symbols[kept + blanks - 1] = blank_symbol;
+                blank_value += rest[blanks - 1];
+            }
+
+            leave_stats* Entry = Table->entries + get_leave_rank(Table, symbols, kept + blanks);
+            add_leave_word(Entry, word_score - blank_value, bingo);
+        }
+
+        uint32_t d = 0;
+
+        while (d < distinct && take[d] == counts[d])
+            take[d++] = 0;
+
+        if (d == distinct)
+            break;
+
+        ++take[d];
+    }
+}
+
+int
+write_leave_table(leave_table* Table, const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    char* image = (char*) Table->Header;
+    size_t remaining = sizeof(leave_table_header) + Table->entry_count * sizeof(leave_stats);
+    int Result = 1;
+
+    // NOTE: WriteFile takes a DWORD size, so large alphabets go in chunks
+    while (remaining && Result) {
+        DWORD chunk = (DWORD) ((remaining < (1u << 30)) ? remaining : (1u << 30));
+        DWORD written = 0;
+
+        Result = WriteFile(file, image, chunk, &written, NULL) && written == chunk;
+        image += chunk;
+        remaining -= chunk;
+    }
+
+    CloseHandle(file);
+
+    return Result;
+}
+
+/*
+ * Maps a table written by write_leave_table read-only. Fails if the file
+ * is not a leave table for this alphabet.
+ */
+int
+map_leave_table(leave_table* Table, alphabet* Alphabet, const char* path)
+{
+    memset(Table, 0, sizeof(*Table));
+
+    Table->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (Table->file == INVALID_HANDLE_VALUE) {
+        Table->file = NULL;
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(Table->file, &file_size) || (uint64_t) file_size.QuadPart < sizeof(leave_table_header)) {
+        release_leave_table(Table);
+        return 0;
+    }
+
+    Table->mapping = CreateFileMappingA(Table->file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (Table->mapping)
+        Table->Header = (leave_table_header*) MapViewOfFile(Table->mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!Table->Header) {
+        release_leave_table(Table);
+        return 0;
+    }
+
+    leave_table_header* Header = Table->Header;
+    init_leave_ranks(Table, Alphabet->size + 1);
+
+    if (Header->magic != LEAVE_TABLE_MAGIC ||
+        Header->version != LEAVE_TABLE_VERSION ||
+        Header->symbol_count != Table->symbol_count ||
+        Header->max_tiles != LEAVE_MAX_TILES ||
+        Header->entry_count != Table->entry_count ||
+        (uint64_t) file_size.QuadPart != sizeof(leave_table_header) + Table->entry_count * sizeof(leave_stats) ||
+        strcmp(Header->alphabet_name, Alphabet->name)) {
+        release_leave_table(Table);
+        return 0;
+    }
+
+    Table->entries = (leave_stats*) (Header + 1);
+
+    return 1;
+}
+
+/*
+ * leave is written like a rack, '?' for blanks. Returns NULL if it has
+ * letters outside the alphabet or more than LEAVE_MAX_TILES tiles.
+ */
+leave_stats*
+get_leave_stats(leave_table* Table, alphabet* Alphabet, const char* leave)
+{
+    uint8_t symbols[LEAVE_MAX_TILES + 1];
+    int count = get_tile_codes(Alphabet, leave, symbols, sizeof(symbols));
+
+    if (count < 0 || count > LEAVE_MAX_TILES)
+        return NULL;
+
+    for (int i = 0; i < count; ++i) {
+        if (symbols[i] == BLANK_CODE)
+            symbols[i] = (uint8_t) (Table->symbol_count - 1);
+    }
+
+    sort_bytes(symbols, (uint32_t) count);
+
+    return Table->entries + get_leave_rank(Table, symbols, (uint32_t) count);
+}
+
+void
+release_leave_table(leave_table* Table)
+{
+    if (Table->file) {
+        if (Table->Header)
+            UnmapViewOfFile(Table->Header);
+
+        if (Table->mapping)
+            CloseHandle(Table->mapping);
+
+        CloseHandle(Table->file);
+    } else if (Table->Header) {
+        VirtualFree(Table->Header, 0, MEM_RELEASE);
+    }
+
+    Table->Header = NULL;
+    Table->entries = NULL;
+}
@@ -0,0 +1,65 @@
+#if !defined(LEAVES_H__)
+#define LEAVES_H__
+
+#include <windows.h>
+#include <stdint.h>
+#include "alphabet.h"
+
+#define LEAVE_MAX_TILES 6
+#define LEAVE_RACK_TILES 7
+#define LEAVE_HIGH_SCORE 20
+#define LEAVE_TABLE_MAGIC 0x5641454C    // "LEAV"
+#define LEAVE_TABLE_VERSION 1
+
+// NOTE: leave symbols are the alphabet's tile codes with the blank as one
+// extra symbol after the last tile, so multisets sort blanks last
+#define MAX_LEAVE_SYMBOLS (MAX_ALPHABET_SIZE + 1)
+
+/*
+ * What a leave is worth: the words of up to LEAVE_RACK_TILES tiles that
+ * use every tile of the leave, the rest coming from the draw. Blanks in
+ * the leave play the cheapest letters and score 0.
+ */
+struct leave_stats {
+    uint32_t word_count;
+    uint32_t bingo_count;           // words using all LEAVE_RACK_TILES tiles
+    uint32_t high_score_count;      // words scoring at least LEAVE_HIGH_SCORE
+    uint32_t best_score;
+};
+
+struct leave_table_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t symbol_count;
+    uint32_t max_tiles;
+    uint64_t entry_count;
+    uint64_t word_count;            // dictionary words the table was built from
+    char alphabet_name[64];
+    uint8_t values[MAX_ALPHABET_SIZE];
+};
+
+/*
+ * Dense table with one entry per multiset of at most LEAVE_MAX_TILES
+ * symbols. The multiset's rank (all smaller sizes first, then the
+ * combinatorial number system within its size) is a perfect hash, so a
+ * lookup is one index computation and one load.
+ */
+struct leave_table {
+    leave_table_header* Header;     // file image: header, then entries
+    leave_stats* entries;
+    uint64_t entry_count;
+    uint32_t symbol_count;
+    uint64_t binomial[MAX_LEAVE_SYMBOLS + LEAVE_MAX_TILES][LEAVE_MAX_TILES + 1];
+    uint64_t size_offsets[LEAVE_MAX_TILES + 2];
+    HANDLE file;                    // set when the table is mapped from disk
+    HANDLE mapping;
+};
+
+extern int create_leave_table(leave_table* Table, alphabet* Alphabet);
+extern void add_word_leaves(leave_table* Table, const uint8_t* codes, uint32_t length);
+extern int write_leave_table(leave_table* Table, const char* path);
+extern int map_leave_table(leave_table* Table, alphabet* Alphabet, const char* path);
+extern leave_stats* get_leave_stats(leave_table* Table, alphabet* Alphabet, const char* leave);
+extern void release_leave_table(leave_table* Table);
+
+#endif
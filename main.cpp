@@ -1,440 +1,894 @@
 #include <windows.h>
-#include <time.h>
-#include <assert.h>
-#include <string.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "getopt.h"
+#include "sch.h"
 
-#define DICTIONARY_WORD_COUNT 352253
-#define MAX_WORD_LIST_SIZE 10000
-#define MAX_NUM_THREADS 32
+/*
+ * Command line client for libsch: turns the options into an engine and
+ * one query, then prints the words and the STATISTICS block.
+ */
 
-struct ctx {
+struct cli_args {
     char* dictionary_file_path;
-    char* jumbled_letters;
-    uint8_t* jumbled_letters_freq;
-    uint32_t jumbled_letter_mask;
-    uint8_t included_letter;
-    uint8_t sort_lexicographically;
-    uint8_t sort_length;
-    uint8_t allow_repeated;
-};
-
-struct word_t {
-    char* word;
-    int word_length;
-};
-
-struct work_order {
-    char* fileContents;
-    ctx* context;
-    uint32_t startOffset;
-    uint32_t endOffset;
-};
-
-struct work_queue {
-    word_t* word_list;
-    volatile uint64_t word_count;
-    uint32_t WorkOrderCount;
-    work_order* WorkOrders;
-    volatile uint64_t NextWorkOrderIndex;
-    volatile uint64_t TotalWordsFound;
-    volatile uint64_t Retired;
+    sch_options Options;
+    sch_query_params Query;
+    sch_anagram_params Anagrams;
+    uint32_t benchmark_iterations;
+    char* build_leaves_path;
+    char* leave_table_path;
+    char* check_path;
+    int show_hooks;
+    sch_simulation_params Simulation;
 };
 
-int
-compare_lexicographically(const void* a, const void* b)
+static void
+usage(void)
 {
-    word_t* word_a = (word_t*) a;
-    word_t* word_b = (word_t*) b;
+    printf(
+        "Usage: ./sch jumbled_letters [-i letters] [-o letters] [-s | -a] [--top K [--by score|length] [--values spec]] [--build-leaves file | --leave-table file] [--words N] [--check file] [--hooks] [--simulate N [--bag spec] [--seed S]] [-d dictionary_file_path] [-A alphabet] [--classes] [-l layout] [-b runs] [-t threads] [-H] [-h] [-r]\n"
+        "Generate spellable words from jumbled letters.\n"
+        "Example: ./sch \"aeuild\" -i f -s -d \"./dictionary.txt\" -r\n\n"
+        "Spellable word selection:\n"
+        "    jumbled_letters            rack letters, '?' is a blank tile that can be any letter\n"
+        "    -r                         allow characters within jumbled_letters to repeatedly be used\n"
+        "    -i letters                 all found words must include every letter in letters\n"
+        "                               (repeats count, e.g. -i ee needs two 'e's)\n"
+        "    -o letters                 all found words must include at least one letter in letters,\n"
+        "                               which may be used once on top of jumbled_letters\n"
+        "    -d dictionary_file_path    use wordlist found in dictionary_file_path instead of the\n"
+        "                               index built into sch (build.bat embed) or ./dictionary.txt\n"
+        "                               NOTE: words need to be line separated\n"
+        "    -A alphabet                english (default), french, spanish, polish or a definition file\n\n"
+        "Output control:\n"
+        "    -s                  sort found spellable words by word size\n"
+        "    -a                  sort found spellable words lexicographically\n"
+        "    --top K             print only the best K words, best first, with their rank\n"
+        "    --by score|length   rank --top words by tile score (default) or word size;\n"
+        "                        blanks score 0\n"
+        "    --values spec       override tile scores, e.g. --values \"q=10,z=10\"\n\n"
+        "Leaves:\n"
+        "    --build-leaves file   build the table of every leave of up to 6 tiles from the\n"
+        "                          dictionary on all cores and write it to file\n"
+        "    --leave-table file    map a built table and print the stats of jumbled_letters\n"
+        "                          as a leave: words and bingos of up to 7 tiles that use it,\n"
+        "                          words scoring 20+ and the best score\n\n"
+        "Multi-word anagrams:\n"
+        "    --words N   print every combination of 2 to N words (N is 2 or 3) that uses\n"
+        "                jumbled_letters exactly, streamed as found; no blanks, -i, -o,\n"
+        "                -r or --top. With -b, times each stage at 1, 2, 4, ... threads\n\n"
+        "Word checks:\n"
+        "    --check file   print whether each line of file is a dictionary word\n"
+        "                   (valid or phony); jumbled_letters is ignored. With -b,\n"
+        "                   times the build of the word set at 1 to N threads and\n"
+        "                   the whole batch instead of printing verdicts\n\n"
+        "Cross-checks:\n"
+        "    --hooks   print the tiles that go in front of and after jumbled_letters to make\n"
+        "              a word, or with one '_' in it (e.g. \"qu_ck\"), the tiles that fill\n"
+        "              the '_'. With -b, times the hook table and checks it against scans\n\n"
+        "Rack simulation:\n"
+        "    --simulate N   draw N racks of 7 tiles from the bag, each holding jumbled_letters\n"
+        "                   as the leave (\"\" for none), and print how often the best word\n"
+        "                   has each length and score. With -b, runs at 1, 2, 4, ... threads\n"
+        "    --bag spec     tile counts, e.g. --bag \"a=9,b=2,?=2\" (default: the 100-tile\n"
+        "                   English bag, english only), at most 2 blanks\n"
+        "    --seed S       draws depend only on S, not on the thread count (default: 1)\n\n"
+        "Threading:\n"
+        "    -t threads   scan with exactly this many threads\n"
+        "                 (default: picked per query from its estimated cost)\n\n"
+        "NUMA:\n"
+        "    -l layout    dictionary placement: single, interleaved or replicated\n"
+        "                 (default: replicated on multi-node hosts)\n"
+        "    --classes    group the dictionary into anagram classes when it is loaded, so a\n"
+        "                 query tests each letter multiset once; -b times the class kernels too\n"
+        "    -b runs      time the query under every layout, the cost of waking workers\n"
+        "                 for a tiny query and every scan kernel, instead of printing words\n\n"
+        "Memory:\n"
+        "    -H    back the dictionary with large (2 MB) pages\n"
+        "          NOTE: needs the \"Lock pages in memory\" privilege, otherwise ignored\n\n"
+        "Miscellaneous:\n"
+        "    -h    display this help message\n"
+    );
 
-    return strncmp(word_a->word, word_b->word, (word_a->word_length < word_b->word_length) ? word_a->word_length : word_b->word_length);
+    exit(-1);
 }
 
-int
-compare_word_length(const void* a, const void* b)
+static void
+parse_args(int argc, char** argv, cli_args* Args)
 {
-    word_t* word_a = (word_t*) a;
-    word_t* word_b = (word_t*) b;
+    int opt;
 
-    if (word_a->word_length < word_b->word_length)
-        return -1;
+    static const option_a long_options[] = {
+        { "top",          REQUIRED_ARGUMENT, NULL, 'K' },
+        { "by",           REQUIRED_ARGUMENT, NULL, 'B' },
+        { "values",       REQUIRED_ARGUMENT, NULL, 'V' },
+        { "build-leaves", REQUIRED_ARGUMENT, NULL, 'W' },
+        { "leave-table",  REQUIRED_ARGUMENT, NULL, 'T' },
+        { "words",        REQUIRED_ARGUMENT, NULL, 'M' },
+        { "check",        REQUIRED_ARGUMENT, NULL, 'C' },
+        { "simulate",     REQUIRED_ARGUMENT, NULL, 'S' },
+        { "bag",          REQUIRED_ARGUMENT, NULL, 'G' },
+        { "seed",         REQUIRED_ARGUMENT, NULL, 'E' },
+        { "classes",      NO_ARGUMENT,       NULL, 'L' },
+        { "hooks",        NO_ARGUMENT,       NULL, 'X' },
+        { NULL,           NULL_ARGUMENT,     NULL, 0 },
+    };
 
-    if (word_a->word_length > word_b->word_length)
-        return 1;
+    if (argc < 2)
+        usage();
 
-    return 0;
+    Args->Query.rack = argv[1];
+    Args->Simulation.seed = 1;
+
+    while (opt = getopt_long(argc, argv, "i:o:sad:A:l:b:t:Hhr", long_options, NULL), opt != -1) {
+        switch (opt) {
+            case 'i':
+                Args->Query.include = optarg;
+                break;
+
+            case 'o':
+                Args->Query.any_of = optarg;
+                break;
+
+            case 's': {
+                if (Args->Query.order == SCH_ORDER_LEXICOGRAPHIC)
+                    usage();
+
+                Args->Query.order = SCH_ORDER_LENGTH;
+            } break;
+
+            case 'a': {
+                if (Args->Query.order == SCH_ORDER_LENGTH)
+                    usage();
+
+                Args->Query.order = SCH_ORDER_LEXICOGRAPHIC;
+            } break;
+
+            case 'd':
+                Args->dictionary_file_path = optarg;
+                break;
+
+            case 'A':
+                Args->Options.alphabet = optarg;
+                break;
+
+            case 'l':
+                Args->Options.layout = optarg;
+                break;
+
+            case 'b':
+                Args->benchmark_iterations = (uint32_t) atoi(optarg);
+
+                if (!Args->benchmark_iterations)
+                    usage();
+
+                break;
+
+            case 't':
+                Args->Query.thread_count = (uint32_t) atoi(optarg);
+
+                if (!Args->Query.thread_count)
+                    usage();
+
+                break;
+
+            case 'H':
+                Args->Options.use_large_pages = 1;
+                break;
+
+            case 'K':
+                Args->Query.top_count = (uint32_t) atoi(optarg);
+
+                if (!Args->Query.top_count || Args->Query.top_count > SCH_MAX_TOP_COUNT)
+                    usage();
+
+                break;
+
+            case 'B': {
+                if (!strcmp(optarg, "score"))
+                    Args->Query.rank_by_length = 0;
+                else if (!strcmp(optarg, "length"))
+                    Args->Query.rank_by_length = 1;
+                else
+                    usage();
+            } break;
+
+            case 'V':
+                Args->Options.tile_values = optarg;
+                break;
+
+            case 'W':
+                Args->build_leaves_path = optarg;
+                break;
+
+            case 'T':
+                Args->leave_table_path = optarg;
+                break;
+
+            case 'C':
+                Args->check_path = optarg;
+                break;
+
+            case 'L':
+                Args->Options.use_word_classes = 1;
+                break;
+
+            case 'X':
+                Args->show_hooks = 1;
+                break;
+
+            case 'S':
+                Args->Simulation.sample_count = strtoull(optarg, NULL, 10);
+
+                if (!Args->Simulation.sample_count)
+                    usage();
+
+                break;
+
+            case 'G':
+                Args->Simulation.bag = optarg;
+                break;
+
+            case 'E':
+                Args->Simulation.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case 'M':
+                Args->Anagrams.max_words = (uint32_t) atoi(optarg);
+
+                if (Args->Anagrams.max_words < 2 || Args->Anagrams.max_words > SCH_MAX_ANAGRAM_WORDS)
+                    usage();
+
+                break;
+
+            case 'h':
+                usage();
+                break;
+
+            case 'r':
+                Args->Query.allow_repeated = 1;
+                break;
+
+            case '?':
+                usage();
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (Args->Anagrams.max_words) {
+        if (Args->Query.include || Args->Query.any_of || Args->Query.allow_repeated || Args->Query.top_count)
+            usage();
+
+        Args->Anagrams.rack = Args->Query.rack;
+        Args->Anagrams.thread_count = Args->Query.thread_count;
+    }
+
+    if (Args->Simulation.sample_count) {
+        Args->Simulation.leave = Args->Query.rack;
+        Args->Simulation.thread_count = Args->Query.thread_count;
+    }
 }
 
-uint64_t
-locked_add_and_return_previous_value(uint64_t volatile* Value, uint64_t Delta)
+static int
+print_error(sch_status Status, cli_args* Args)
 {
-    uint64_t Result = InterlockedExchangeAdd64((volatile LONG64*) Value, Delta);
+    switch (Status) {
+        case SCH_ERROR_OPEN_FILE:
+            printf("Error opening file \"%s\": %lu\n", Args->dictionary_file_path ? Args->dictionary_file_path : "dictionary.txt", GetLastError());
+            break;
+
+        case SCH_ERROR_FILE_SIZE:
+            printf("Error getting file size \"%s\": %lu\n", Args->dictionary_file_path ? Args->dictionary_file_path : "dictionary.txt", GetLastError());
+            break;
+
+        case SCH_ERROR_OUT_OF_MEMORY:
+            printf("Memory allocation failed\n");
+            break;
+
+        case SCH_ERROR_READ_FILE:
+            printf("Error reading file\n");
+            break;
+
+        case SCH_ERROR_ALPHABET:
+            printf("Error loading alphabet \"%s\"\n", Args->Options.alphabet ? Args->Options.alphabet : "english");
+            break;
+
+        case SCH_ERROR_LETTERS:
+            printf("Letters outside the %s alphabet\n", Args->Options.alphabet ? Args->Options.alphabet : "english");
+            break;
+
+        case SCH_ERROR_TILE_VALUES:
+            printf("Bad tile values \"%s\"\n", Args->Options.tile_values);
+            break;
+
+        case SCH_ERROR_LEAVE_TABLE:
+            printf("Error mapping leave table \"%s\" for the %s alphabet\n", Args->leave_table_path, Args->Options.alphabet ? Args->Options.alphabet : "english");
+            break;
 
-    return Result;
+        case SCH_ERROR_WRITE_FILE:
+            printf("Error writing \"%s\"\n", Args->build_leaves_path);
+            break;
+
+        case SCH_ERROR_ARGUMENT:
+            usage();
+            break;
+
+        case SCH_ERROR_NO_BAG:
+            printf("The %s alphabet has no standard bag, give its tile counts with --bag\n", Args->Options.alphabet ? Args->Options.alphabet : "english");
+            break;
+
+        default:
+            break;
+    }
+
+    return Status;
 }
 
 static void
-add_word_to_list(word_t* wordl, uint64_t volatile* word_count, char* location, int size)
+print_progress(void* user, uint32_t percent)
 {
-    uint64_t current_index = locked_add_and_return_previous_value(word_count, 1);
+    printf("\r%3d%% complete", percent);
+    fflush(stdout);
+}
 
-    if (current_index < MAX_WORD_LIST_SIZE) {
-        wordl[current_index].word = location;
-        wordl[current_index].word_length = size;
-    } else {
-        fprintf(stderr, "list max reached\n");
-    }
+static double
+get_us_elapsed(LARGE_INTEGER start, LARGE_INTEGER end)
+{
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+
+    return 1000000.0 * (double) (end.QuadPart - start.QuadPart) / (double) Frequency.QuadPart;
 }
 
-static uint8_t
-is_word_delim(int c)
+static int
+print_leave_stats(cli_args* Args)
 {
-    return c == '\n' || c == '\r' || c == ' ';
+    sch_status Status;
+    sch_leave_table* Table = sch_open_leave_table(Args->leave_table_path, &Args->Options, &Status);
+
+    if (!Table)
+        return print_error(Status, Args);
+
+    sch_leave Leave;
+    LARGE_INTEGER start, end;
+
+    QueryPerformanceCounter(&start);
+    Status = sch_lookup_leave(Table, Args->Query.rack, &Leave);
+    QueryPerformanceCounter(&end);
+
+    if (Status != SCH_OK) {
+        printf("Leave \"%s\" is not 6 or fewer tiles of the %s alphabet\n", Args->Query.rack, Args->Options.alphabet ? Args->Options.alphabet : "english");
+        sch_close_leave_table(Table);
+        return Status;
+    }
+
+    uint64_t entry_count, word_count;
+    sch_get_leave_table_info(Table, &entry_count, &word_count);
+
+    printf("**********************************************************\n");
+    printf("** LEAVE %s\n", Args->Query.rack);
+    printf("**********************************************************\n");
+    printf("** Words           :  %u (up to 7 tiles, every leave tile used)\n", Leave.word_count);
+    printf("** Bingos          :  %u\n", Leave.bingo_count);
+    printf("** HighScoring     :  %u (20+ points)\n", Leave.high_score_count);
+    printf("** BestScore       :  %u\n", Leave.best_score);
+    printf("** LookupTime      :  %.3f us (%llu entries, built from %llu words)\n", get_us_elapsed(start, end), entry_count, word_count);
+    printf("**********************************************************\n\n");
+
+    sch_close_leave_table(Table);
+
+    return 0;
 }
 
-static uint32_t
-get_cpu_count(void)
+static void
+print_anagram(void* user, const sch_word* words, uint32_t count)
 {
-    SYSTEM_INFO Info;
-    GetSystemInfo(&Info);
+    sch_engine* Engine = (sch_engine*) user;
+    char text[1024];
 
-    return Info.dwNumberOfProcessors;
+    for (uint32_t i = 0; i < count; ++i) {
+        sch_decode_word(Engine, words + i, text, sizeof(text));
+        printf((i + 1 < count) ? "%s " : "%s\n", text);
+    }
 }
 
-static uint32_t
-get_word_mask(char* word)
+static int
+find_anagrams(sch_engine* Engine, cli_args* Args)
 {
-    char* ptr = word;
-    uint32_t result = 0;
+    sch_anagram_stats Stats;
+    sch_status Status;
+
+    if (Args->benchmark_iterations) {
+        Status = sch_benchmark_anagrams(Engine, &Args->Anagrams, Args->benchmark_iterations);
+        return (Status == SCH_OK) ? 0 : print_error(Status, Args);
+    }
+
+    Args->Anagrams.output = print_anagram;
+    Args->Anagrams.output_user = Engine;
+    Status = sch_find_anagrams(Engine, &Args->Anagrams, &Stats);
 
-    while (*ptr++) {
-        result |= (1 << (*ptr - 'a'));
+    if (Status == SCH_ERROR_ARGUMENT) {
+        printf("Multi-word anagrams use every tile exactly once, so the rack cannot hold blanks\n");
+        return Status;
     }
 
-    return result;
+    if (Status != SCH_OK)
+        return print_error(Status, Args);
+
+    printf("\n**********************************************************\n");
+    printf("** MULTI-WORD ANAGRAMS\n");
+    printf("**********************************************************\n");
+    printf("** Rack            :  %u tiles, 2 to %u words\n", Stats.rack_size, Args->Anagrams.max_words);
+    printf("** Candidates      :  %u words the rack can spell\n", Stats.candidate_count);
+    printf("** Classes         :  %u distinct letter multisets\n", Stats.class_count);
+    printf("** ClassMatches    :  %llu class combinations\n", Stats.class_combination_count);
+    printf("** Anagrams        :  %llu word combinations\n", Stats.anagram_count);
+    printf("** FilterTime      :  %.3f ms on %u threads\n", Stats.filter_ms, Stats.filter_thread_count);
+    printf("** GroupTime       :  %.3f ms\n", Stats.group_ms);
+    printf("** JoinTime        :  %.3f ms on %u threads\n", Stats.join_ms, Stats.join_thread_count);
+    printf("** TotalTime       : ~%.1f ms\n", Stats.elapsed_ms);
+    printf("**********************************************************\n\n");
+
+    return 0;
 }
 
-static uint32_t
-process_words(work_queue* Queue)
+/*
+ * Reads one candidate word per line. Lines are cut in place, so the
+ * returned array and the file contents behind it are one allocation.
+ */
+static char**
+read_check_words(const char* path, uint32_t* count)
 {
-    uint64_t WorkOrderIndex = locked_add_and_return_previous_value(&Queue->NextWorkOrderIndex, 1);
-
-    if (WorkOrderIndex >= Queue->WorkOrderCount)
-        return FALSE;
-
-    work_order* Order = Queue->WorkOrders + WorkOrderIndex;
-    word_t* word_list = Queue->word_list;
-    char* fileContents = Order->fileContents;
-    uint32_t startOffset = Order->startOffset;
-    uint32_t endOffset = Order->endOffset;
-    ctx* context = Order->context;
-    uint64_t words_found = 0;
-
-    char* ptr =  fileContents + startOffset;
-    char* wordstart = ptr;
-    uint8_t word_freq[26] = {};
-
-    while (ptr < fileContents + endOffset) {
-        if (is_word_delim(*ptr)) {
-            if (!context->allow_repeated) {
-                if (ptr > wordstart) {
-                    memset(word_freq, 0, sizeof(word_freq));
-
-                    char* w = wordstart;
-
-                    while (w != ptr) {
-                        word_freq[(*w - 'a')]++;
-                        ++w;
-                    }
-                }
-
-                if (context->included_letter)
-                    if (!word_freq[(context->included_letter - 'a')])
-                        goto NEXT_WORD;
-
-                uint8_t found = 1;
-
-                for (int i = 0; i < 26; ++i) {
-                    if (word_freq[i] > context->jumbled_letters_freq[i]) {
-                        found = 0;
-                        break;
-                    }
-                }
-
-                if (found) {
-                    ++words_found;
-                    add_word_to_list(word_list, &Queue->word_count, wordstart, (int) (ptr - wordstart));
-                }
-            } else {
-                if (ptr > wordstart) {
-                    uint32_t word_mask = 0;
-
-                    for (char* w = wordstart; w != ptr; ++w) {
-                        word_mask |= (1 << (*w - 'a'));
-                    }
-
-                    if (context->included_letter)
-                        if (!(word_mask & (1 << (context->included_letter - 'a'))))
-                            goto NEXT_WORD;
-
-                    if ((word_mask & context->jumbled_letter_mask) == word_mask) {
-                        ++words_found;
-                        add_word_to_list(word_list, &Queue->word_count, wordstart, (int) (ptr - wordstart));
-                    }
-                }
-            }
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
-NEXT_WORD:
-            while (is_word_delim(*ptr))
-                ++ptr;
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
 
-            wordstart = ptr;
-        } else {
-            ++ptr;
-        }
+    DWORD fileSize = GetFileSize(hFile, NULL);
+    char** words = NULL;
+
+    if (fileSize != INVALID_FILE_SIZE) {
+        // NOTE: at most one word per two bytes, plus the terminator
+        size_t words_size = ((size_t) fileSize / 2 + 1) * sizeof(char*);
+        words = (char**) VirtualAlloc(NULL, words_size + fileSize + 1, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
     }
 
-    locked_add_and_return_previous_value(&Queue->TotalWordsFound, words_found);
-    locked_add_and_return_previous_value(&Queue->Retired, 1);
+    DWORD bytesRead;
+    char* contents = words ? (char*) (words + fileSize / 2 + 1) : NULL;
+
+    if (contents && (!ReadFile(hFile, contents, fileSize, &bytesRead, NULL) || bytesRead != fileSize)) {
+        VirtualFree(words, 0, MEM_RELEASE);
+        words = NULL;
+    }
+
+    CloseHandle(hFile);
+
+    if (!words)
+        return NULL;
+
+    *count = 0;
+
+    for (DWORD i = 0; i < fileSize; ++i) {
+        if (contents[i] == '\n' || contents[i] == '\r') {
+            contents[i] = 0;
+        } else if (!i || !contents[i - 1]) {
+            words[(*count)++] = contents + i;
+        }
+    }
 
-    return TRUE;
+    return words;
 }
 
-DWORD WINAPI
-thread_func(LPVOID lpParam)
+static int
+check_words(sch_engine* Engine, cli_args* Args)
 {
-    work_queue* Queue = (work_queue*) lpParam;
-    while (process_words(Queue)) {}
+    uint32_t count = 0;
+    char** words = read_check_words(Args->check_path, &count);
+
+    if (!words) {
+        printf("Error reading \"%s\": %lu\n", Args->check_path, GetLastError());
+        return SCH_ERROR_READ_FILE;
+    }
+
+    sch_word_set_info Info;
+    sch_status Status = sch_get_word_set_info(Engine, &Info);
+    uint8_t* valid = NULL;
+
+    if (Status == SCH_OK) {
+        valid = (uint8_t*) VirtualAlloc(NULL, count + 1, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+        if (!valid)
+            Status = SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (Status != SCH_OK) {
+        VirtualFree(words, 0, MEM_RELEASE);
+        return print_error(Status, Args);
+    }
+
+    uint32_t runs = Args->benchmark_iterations ? Args->benchmark_iterations : 1;
+    double best_us = 0.0;
+
+    if (Args->benchmark_iterations)
+        sch_benchmark_word_set(Engine, runs);
+
+    for (uint32_t i = 0; i < runs; ++i) {
+        LARGE_INTEGER start, end;
+
+        QueryPerformanceCounter(&start);
+        sch_check_words(Engine, words, count, valid);
+        QueryPerformanceCounter(&end);
+
+        double us = get_us_elapsed(start, end);
+
+        if (!i || us < best_us)
+            best_us = us;
+    }
+
+    uint32_t valid_count = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        valid_count += valid[i];
+
+        if (!Args->benchmark_iterations)
+            printf("%s  %s\n", valid[i] ? "valid" : "phony", words[i]);
+    }
+
+    printf("\n**********************************************************\n");
+    printf("** WORD CHECK %s\n", Args->check_path);
+    printf("**********************************************************\n");
+    printf("** Checked         :  %u words (%u valid, %u phony)\n", count, valid_count, count - valid_count);
+    printf("** WordSet         :  %u words in %u slots, %u buckets (%u duplicates, %u seeds)\n",
+           Info.word_count, Info.slot_count, Info.bucket_count, Info.duplicate_count, Info.seed_count);
+    printf("** TableSize       :  %.1f KB, %.2f bytes/word (+%.2f dictionary bytes/word to verify hits)\n",
+           (double) Info.table_bytes / 1024.0, Info.bytes_per_word, Info.dictionary_bytes_per_word);
+    printf("** BuildTime       :  %.1f ms on %u threads (split %.1f, hash %.1f, scatter %.1f, place %.1f ms)\n",
+           Info.build_ms, Info.build_thread_count, Info.split_ms, Info.hash_ms, Info.scatter_ms, Info.place_ms);
+    printf("** Table           :  %u shards, checksum %016llx\n", Info.shard_count, Info.checksum);
+    printf("** CheckTime       :  %.3f ms on 1 thread%s, %.1f M lookups/s\n", best_us / 1000.0,
+           Args->benchmark_iterations ? " (best run)" : "", best_us ? (double) count / best_us : 0.0);
+    printf("**********************************************************\n\n");
+
+    VirtualFree(valid, 0, MEM_RELEASE);
+    VirtualFree(words, 0, MEM_RELEASE);
 
     return 0;
 }
 
-static void
-create_worker_thread(void* parameter)
+/*
+ * Without a '_' in jumbled_letters, looks up its front and back hooks;
+ * with one, the tiles that fit there. Both are single cross-checks.
+ */
+static int
+print_hooks(sch_engine* Engine, cli_args* Args)
 {
-    DWORD thread_id;
-    HANDLE wt = CreateThread(NULL, 0, thread_func, parameter, 0, &thread_id);
-    CloseHandle(wt);
-}
+    sch_status Status;
 
-static void
-usage(void)
-{
-    printf(
-        "Usage: ./sch jumbled_letters [-i c] [-s | -a] [-d dictionary_file_path] [-h] [-r]\n"
-        "Generate spellable words from jumbled letters.\n"
-        "Example: ./sch \"aeuild\" -i f -s -d \"./dictionary.txt\" -r\n\n"
-        "Spellable word selection:\n"
-        "    -r                         allow characters within jumbled_letters to repeatedly be used\n"
-        "    -i c                       all found words must include letter 'c'\n"
-        "    -d dictionary_file_path    use wordlist found in dictionary_file_path\n"
-        "                               NOTE: words need to be line separated and lowercase\n\n"
-        "Output control:\n"
-        "    -s    sort found spellable words by word size\n"
-        "    -a    sort found spellable words lexicographically\n\n"
-        "Miscellaneous:\n"
-        "    -h    display this help message\n"
-    );
+    if (Args->benchmark_iterations) {
+        Status = sch_benchmark_hooks(Engine, Args->benchmark_iterations);
+        return (Status == SCH_OK) ? 0 : print_error(Status, Args);
+    }
 
-    exit(-1);
+    char pattern[512];
+    snprintf(pattern, sizeof(pattern), "%s", Args->Query.rack);
+
+    char* square = strchr(pattern, '_');
+
+    if (square && strchr(square + 1, '_')) {
+        printf("Mark the square to fill with one '_'\n");
+        return SCH_ERROR_ARGUMENT;
+    }
+
+    const char* before[2] = { "", pattern };
+    const char* after[2] = { pattern, "" };
+    uint32_t count = 2;
+
+    if (square) {
+        *square = 0;
+        before[0] = pattern;
+        after[0] = square + 1;
+        count = 1;
+    }
+
+    // NOTE: the table is built here if it did not come with the index,
+    // so the lookups below are timed on their own
+    sch_hook_info Info;
+    Status = sch_get_hook_info(Engine, &Info);
+
+    if (Status != SCH_OK)
+        return print_error(Status, Args);
+
+    uint64_t masks[2];
+    LARGE_INTEGER start, end;
+
+    QueryPerformanceCounter(&start);
+    sch_cross_check(Engine, before, after, count, masks);
+    QueryPerformanceCounter(&end);
+
+    char tiles[2][1024];
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!sch_decode_tiles(Engine, masks[i], tiles[i], sizeof(tiles[i])))
+            snprintf(tiles[i], sizeof(tiles[i]), "(none)");
+    }
+
+    printf("**********************************************************\n");
+    printf("** %s %s\n", square ? "CROSS-CHECK" : "HOOKS", Args->Query.rack);
+    printf("**********************************************************\n");
+
+    if (square) {
+        printf("** Fits            :  %s\n", tiles[0]);
+    } else {
+        printf("** FrontHooks      :  %s\n", tiles[0]);
+        printf("** BackHooks       :  %s\n", tiles[1]);
+    }
+
+    printf("** LookupTime      :  %.3f us for %u lookups\n", get_us_elapsed(start, end), count);
+
+    if (Info.embedded) {
+        printf("** HookTable       :  %u pairs, %.1f MB, from the dictionary index\n", Info.pair_count, (double) Info.table_bytes / (1024.0 * 1024.0));
+    } else {
+        printf("** HookTable       :  %u pairs, %.1f MB, built in %.1f ms on %u threads\n", Info.pair_count, (double) Info.table_bytes / (1024.0 * 1024.0),
+               Info.build_ms, Info.build_thread_count);
+    }
+
+    printf("**********************************************************\n\n");
+
+    return 0;
 }
 
-int
-main(int argc, char** argv)
+static int
+simulate_racks(sch_engine* Engine, cli_args* Args)
 {
-    int opt;
-    ctx context = {};
-    uint8_t jumbled_letters_freq[26] = {};
+    sch_simulation_stats Stats;
+    sch_status Status;
 
-    if (argc < 2)
-        usage();
+    if (Args->benchmark_iterations) {
+        sch_info Info;
+        double single_rate = 0.0;
 
-    context.jumbled_letters = argv[1];
+        sch_get_info(Engine, &Info);
 
-    while (opt = getopt(argc, argv, "i:sad:hr"), opt != -1) {
-        switch (opt) {
-            case 'i':
-                context.included_letter = optarg[0];
-                break;
+        // NOTE: also builds the rack table and warms up caches before timing
+        Status = sch_simulate(Engine, &Args->Simulation, &Stats);
 
-            case 's': {
-                if (context.sort_lexicographically)
-                    usage();
+        if (Status != SCH_OK)
+            return print_error(Status, Args);
 
-                context.sort_length = 1;
-            } break;
+        printf("**********************************************************\n");
+        printf("** RACK SIMULATION BENCHMARK (%llu racks, best of %u)\n", Stats.sample_count, Args->benchmark_iterations);
+        printf("**********************************************************\n");
 
-            case 'a': {
-                if (context.sort_length)
-                    usage();
+        for (uint32_t thread_count = 1;; thread_count *= 2) {
+            double best_rate = 0.0;
 
-                context.sort_lexicographically = 1;
-            } break;
+            if (thread_count > Info.worker_count + 1)
+                thread_count = Info.worker_count + 1;
 
-            case 'd':
-                context.dictionary_file_path = optarg;
-                break;
+            Args->Simulation.thread_count = thread_count;
 
-            case 'h':
-                usage();
-                break;
+            for (uint32_t i = 0; i < Args->benchmark_iterations; ++i) {
+                sch_simulate(Engine, &Args->Simulation, &Stats);
 
-            case 'r':
-                context.allow_repeated = 1;
-                break;
+                if (Stats.racks_per_second > best_rate)
+                    best_rate = Stats.racks_per_second;
+            }
 
-            case '?':
-                usage();
-                break;
+            if (thread_count == 1)
+                single_rate = best_rate;
 
-            default:
+            printf("** %2u threads :  %12.0f racks/s (%.2fx)\n", thread_count, best_rate, best_rate / single_rate);
+
+            if (thread_count == Info.worker_count + 1)
                 break;
         }
+
+        printf("**********************************************************\n\n");
+
+        return 0;
     }
 
-    char* ptr = context.jumbled_letters;
+    Status = sch_simulate(Engine, &Args->Simulation, &Stats);
 
-    if (!context.allow_repeated) {
-        while (*ptr) {
-            jumbled_letters_freq[(*ptr - 'a')]++;
-            ++ptr;
-        }
+    if (Status == SCH_ERROR_ARGUMENT) {
+        printf("The leave must be tiles the bag holds, with room left on the rack for the draw,\n");
+        printf("and the bag can hold at most 2 blanks\n");
+        return Status;
+    }
 
-        if (context.included_letter)
-            ++jumbled_letters_freq[(context.included_letter - 'a')];
+    if (Status != SCH_OK)
+        return print_error(Status, Args);
 
-        context.jumbled_letters_freq = jumbled_letters_freq;
-    } else {
-        context.jumbled_letter_mask = get_word_mask(ptr);
+    double samples = (double) Stats.sample_count;
+    uint32_t last_bucket = 0;
 
-        if (context.included_letter)
-            context.jumbled_letter_mask |= (1 << (context.included_letter - 'a'));
+    for (uint32_t b = 0; b < SCH_SIMULATION_SCORE_BUCKETS; ++b) {
+        if (Stats.score_histogram[b])
+            last_bucket = b;
     }
 
-    if (!context.dictionary_file_path)
-        context.dictionary_file_path = (char*) "dictionary.txt";
+    printf("**********************************************************\n");
+    printf("** RACK SIMULATION (leave \"%s\", seed %llu)\n", Args->Simulation.leave, Args->Simulation.seed);
+    printf("**********************************************************\n");
+    printf("** Racks           :  %llu of %u tiles from a bag of %u\n", Stats.sample_count, SCH_MAX_RACK_TILES, Stats.bag_tile_count);
+    printf("** Playable        :  %llu (%.2f%%)\n", Stats.playable_count, 100.0 * (double) Stats.playable_count / samples);
+    printf("** Bingos          :  %llu (%.2f%%)\n", Stats.bingo_count, 100.0 * (double) Stats.bingo_count / samples);
+    printf("** MeanBestScore   :  %.2f\n", Stats.mean_best_score);
 
-    char* filename = context.dictionary_file_path;
-    HANDLE hFile = CreateFileA(filename, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    for (uint32_t l = 0; l <= SCH_MAX_RACK_TILES; ++l)
+        printf("** LongestWord %u   :  %10llu (%6.2f%%)\n", l, Stats.length_histogram[l], 100.0 * (double) Stats.length_histogram[l] / samples);
 
-    if (hFile == INVALID_HANDLE_VALUE) {
-        DWORD dwError = GetLastError();
-        printf("Error opening file \"%s\": %lu\n", filename, dwError);
-        return -2;
-    }
+    for (uint32_t b = 0; b <= last_bucket; b += 5) {
+        uint64_t count = 0;
 
-    DWORD fileSize = GetFileSize(hFile, NULL);
+        for (uint32_t k = b; k < b + 5 && k < SCH_SIMULATION_SCORE_BUCKETS; ++k)
+            count += Stats.score_histogram[k];
 
-    if (fileSize == INVALID_FILE_SIZE) {
-        DWORD dwError = GetLastError();
-        printf("Error getting file size \"%s\": %lu\n", filename, dwError);
-        return -3;
+        printf("** BestScore %3u+  :  %10llu (%6.2f%%)\n", b, count, 100.0 * (double) count / samples);
     }
 
-    char* fileContents = (char*) VirtualAlloc(NULL, fileSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    printf("** RackTable       :  %u multisets, %.1f MB, built in %.1f ms\n", Stats.table_entry_count,
+           (double) Stats.table_bytes / (1024.0 * 1024.0), Stats.table_build_ms);
+    printf("** SimulationTime  :  %.1f ms on %u threads, %.0f racks/s\n", Stats.elapsed_ms, Stats.thread_count, Stats.racks_per_second);
+    printf("**********************************************************\n\n");
 
-    if (!fileContents) {
-        printf("Memory allocation failed\n");
-        CloseHandle(hFile);
-        return -4;
-    }
+    return 0;
+}
 
-    DWORD bytesRead;
+static int
+build_leave_table(sch_engine* Engine, cli_args* Args)
+{
+    sch_leave_build_stats Stats = {};
+    sch_status Status = sch_build_leave_table(Engine, Args->build_leaves_path, print_progress, NULL, &Stats);
 
-    if (!ReadFile(hFile, fileContents, fileSize, &bytesRead, NULL) || bytesRead != fileSize) {
-        printf("Error reading file\n");
-        VirtualFree(fileContents, 0, MEM_RELEASE);
-        CloseHandle(hFile);
-        return -5;
-    }
+    printf("\r100%% complete\n\n");
 
-    CloseHandle(hFile);
+    if (Status != SCH_OK)
+        return print_error(Status, Args);
+
+    sch_info Info;
+    sch_get_info(Engine, &Info);
 
-    word_t* word_list = (word_t*) VirtualAlloc(NULL, DICTIONARY_WORD_COUNT * sizeof(word_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    printf("**********************************************************\n");
+    printf("** LEAVE TABLE %s\n", Args->build_leaves_path);
+    printf("**********************************************************\n");
+    printf("** Leaves          :  %llu (up to 6 tiles, %u symbols incl. blank)\n", Stats.entry_count, Stats.symbol_count);
+    printf("** TableSize       :  %.1f MB\n", (double) Stats.table_bytes / (1024.0 * 1024.0));
+    printf("** WordsUsed       :  %llu of %llu words (up to 7 tiles)\n", Stats.words_used, Info.word_count);
+    printf("** BuildTime       :  %.1f ms on %u threads\n", Stats.build_ms, Stats.thread_count);
+    printf("** WriteTime       :  %.1f ms\n", Stats.write_ms);
+    printf("**********************************************************\n\n");
 
-    work_queue Queue = {};
-    uint32_t core_count = get_cpu_count();
-    uint32_t chunk_size = (fileSize + core_count - 1) / core_count;
-    uint32_t last_line_end = 0;
-    uint32_t lastEndOffset = 0;
+    return 0;
+}
 
-    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, core_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-    Queue.word_list = word_list;
-    Queue.word_count = 0;
+int
+main(int argc, char** argv)
+{
+    cli_args Args = {};
+    parse_args(argc, argv, &Args);
 
-    for (uint32_t i = 0; i < core_count; ++i) {
-        uint32_t startOffset = lastEndOffset + 1;
-        uint32_t endOffset = (i == (core_count - 1)) ? fileSize : (i + 1) * chunk_size;
+    // NOTE: leave lookups only read the mapped table, no dictionary needed
+    if (Args.leave_table_path)
+        return print_leave_stats(&Args);
 
-        if (i < MAX_NUM_THREADS) {
-            while (endOffset < fileSize && fileContents[endOffset] != '\n')
-                ++endOffset;
-        }
+    sch_status Status;
+    sch_engine* Engine = sch_open(Args.dictionary_file_path, &Args.Options, &Status);
 
-        work_order* order = Queue.WorkOrders + Queue.WorkOrderCount++;
-        assert(Queue.WorkOrderCount <= core_count);
+    if (!Engine)
+        return print_error(Status, &Args);
 
-        lastEndOffset = endOffset;
-        order->endOffset = endOffset;
-        order->startOffset = startOffset;
-        order->fileContents = fileContents;
-        order->context = &context;
+    if (Args.check_path) {
+        int Result = check_words(Engine, &Args);
+        sch_close(Engine);
+        return Result;
     }
 
-    assert(Queue.WorkOrderCount == core_count);
+    if (Args.show_hooks) {
+        int Result = print_hooks(Engine, &Args);
+        sch_close(Engine);
+        return Result;
+    }
 
-    locked_add_and_return_previous_value(&Queue.NextWorkOrderIndex, 0);
+    if (Args.Simulation.sample_count) {
+        int Result = simulate_racks(Engine, &Args);
+        sch_close(Engine);
+        return Result;
+    }
 
-    clock_t start_time = clock();
+    if (Args.Anagrams.max_words) {
+        int Result = find_anagrams(Engine, &Args);
+        sch_close(Engine);
+        return Result;
+    }
 
-    for (uint32_t thread_index = 0; thread_index < core_count; ++thread_index) {
-        create_worker_thread(&Queue);
+    if (Args.benchmark_iterations) {
+        Status = sch_benchmark(Engine, &Args.Query, Args.benchmark_iterations);
+        sch_close(Engine);
+        return (Status == SCH_OK) ? 0 : print_error(Status, &Args);
     }
 
-    while (Queue.Retired < core_count) {
-        if (process_words(&Queue)) {
-            uint32_t progress = 100 * (uint32_t) Queue.Retired / core_count;
-            printf("\r%3d%% complete", progress);
-            fflush(stdout);
-        }
+    if (Args.build_leaves_path) {
+        int Result = build_leave_table(Engine, &Args);
+        sch_close(Engine);
+        return Result;
+    }
+
+    sch_result Result;
+    Args.Query.progress = print_progress;
+    Status = sch_query(Engine, &Args.Query, &Result);
+
+    if (Status != SCH_OK) {
+        sch_close(Engine);
+        return print_error(Status, &Args);
     }
 
-    clock_t end_time = clock();
-    clock_t total_time = end_time - start_time;
     printf("\r100%% complete\n\n");
 
-    uint64_t word_count = Queue.word_count;
+    char text[1024];
+    uint64_t cursor = 0;
+    sch_word Word;
 
-    if (context.sort_length || context.sort_lexicographically) {
-        size_t final_word_count = (size_t) word_count;
-        if (context.sort_length) {
-            qsort(word_list, final_word_count, sizeof(*word_list), compare_word_length);
-        }
+    while (sch_next_word(Engine, &Result, &cursor, &Word)) {
+        sch_decode_word(Engine, &Word, text, sizeof(text));
 
-        if (context.sort_lexicographically) {
-            qsort(word_list, final_word_count, sizeof(*word_list), compare_lexicographically);
-        }
+        if (Args.Query.top_count)
+            printf("%4u  %s\n", Word.rank, text);
+        else
+            printf("%s\n", text);
     }
 
-    for (uint64_t i = 0, i_max = word_count; i < i_max; ++i) {
-        word_t current_word = word_list[i];
-        printf("%.*s\n", current_word.word_length, current_word.word);
-    }
+    sch_info Info;
+    sch_get_info(Engine, &Info);
+    sch_query_stats* Stats = &Result.stats;
 
     printf("\n**********************************************************\n");
     printf("** STATISTICS\n");
     printf("**********************************************************\n");
-    printf("** TotalCores      :  %u\n", core_count);
-    printf("** TotalTime       : ~%ld ms\n", total_time);
-    printf("** TotalWords      :  %u words\n", DICTIONARY_WORD_COUNT);
-    printf("** WordsFound      :  %llu words\n", Queue.TotalWordsFound);
-    printf("** TimePerWord     : ~%f ms\n", (float) total_time / (float) DICTIONARY_WORD_COUNT);
+    printf("** TotalCores      :  %u\n", Info.core_count);
+    printf("** ExecMode        :  %s, %u of %u threads%s\n", Stats->exec_mode, Stats->thread_count, Stats->max_thread_count, Stats->forced ? " (forced by -t)" : "");
+    printf("** CostModel       :  ~%.0f us for %llu bytes, ~%llu words, ~%llu matches (rack %u, repeat %s)\n",
+           Stats->estimated_us, Stats->scan_bytes, Stats->estimated_words, Stats->estimated_matches,
+           Stats->rack_size, Args.Query.allow_repeated ? "on" : "off");
+    printf("** NumaNodes       :  %u\n", Info.numa_node_count);
+    printf("** DictLayout      :  %s\n", Info.layout);
+
+    if (Info.class_count)
+        printf("** WordClasses     :  %u anagram classes for %llu words (%.1f KB, built in %.1f ms)\n",
+               Info.class_count, Info.word_count, (double) Info.class_bytes / 1024.0, Info.class_build_ms);
+
+    if (Info.large_page_count)
+        printf("** LargePages      :  on (%zu KB)\n", Info.large_page_size / 1024);
+    else if (Info.large_page_size)
+        printf("** LargePages      :  unavailable (no free %zu KB pages)\n", Info.large_page_size / 1024);
+    else
+        printf("** LargePages      :  %s\n", Args.Options.use_large_pages ? "unavailable (needs SeLockMemoryPrivilege)" : "off");
+
+    printf("** MappedPages     :  %llu large + %llu small (TLB entries to cover data)\n", Info.large_page_count, Info.small_page_count);
+    printf("** PageFaults      :  %llu during query\n", Stats->page_faults);
+    printf("** TotalTime       : ~%.1f ms\n", Stats->elapsed_ms);
+    printf("** Alphabet        :  %s (%u tiles)\n", Info.alphabet, Info.alphabet_size);
+    printf("** Dictionary      :  %s, loaded in %.1f ms\n", Info.dictionary_embedded ? "index built into sch" : (Args.dictionary_file_path ? Args.dictionary_file_path : "dictionary.txt"), Info.load_ms);
+    printf("** TotalWords      :  %llu words\n", Info.word_count);
+    printf("** DroppedWords    :  %llu words (characters outside the alphabet)\n", Info.dropped_word_count);
+    printf("** WordsFound      :  %llu words\n", Stats->words_found);
+
+    if (Args.Query.top_count)
+        printf("** TopK            :  best %u of %llu by %s (%u per-thread heaps)\n", Result.count, Stats->words_found,
+               Args.Query.rank_by_length ? "length" : "score", Stats->heap_count);
+
+    printf("** ResultMemory    :  %llu bytes (%s)\n", Stats->result_bytes, Result.bitset ? "bitset over the dictionary" : "32-bit word ids");
+
+    printf("** TimePerWord     : ~%f ms\n", Stats->elapsed_ms / (double) Info.word_count);
     printf("**********************************************************\n\n");
 
-    // VirtualFree(fileContents, 0, MEM_RELEASE);
+    sch_release_result(&Result);
+    sch_close(Engine);
 
     return 0;
 }
@@ -0,0 +1,484 @@
+#include <windows.h>
+#include <string.h>
+#include <immintrin.h>
+#include <intrin.h>
+#include "racks.h"
+#include "hash.h"
+
+static void
+sort_symbols(uint8_t* symbols, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; ++i) {
+        uint8_t symbol = symbols[i];
+        uint32_t j = i;
+
+        for (; j > 0 && symbols[j - 1] > symbol; --j)
+            symbols[j] = symbols[j - 1];
+
+        symbols[j] = symbol;
+    }
+}
+
+// NOTE: lowest symbol in the low bits, the order evaluate_rack builds
+// its keys in
+static uint64_t
+pack_symbols(const uint8_t* sorted, uint32_t count)
+{
+    uint64_t key = 0;
+
+    for (uint32_t i = count; i-- > 0;)
+        key = (key << RACK_SYMBOL_BITS) | (uint64_t) (sorted[i] + 1);
+
+    return key;
+}
+
+static uint64_t
+make_rack_entry(const uint8_t* sorted, uint32_t count, uint32_t score)
+{
+    return ((uint64_t) score << RACK_KEY_BITS) | pack_symbols(sorted, count);
+}
+
+/*
+ * Lists a word's multiset and every way of playing it with one or two
+ * blanks, each blank scoring 0 in place of a letter. Equal letters give
+ * equal variants, so only the first of a run is replaced. Returns how
+ * many entries it wrote, at most 1 + length + length * (length - 1) / 2.
+ */
+static uint32_t
+list_word_racks(alphabet* Alphabet, const uint8_t* sorted, uint32_t length, uint64_t* entries)
+{
+    uint8_t variant[RACK_MAX_TILES];
+    uint32_t score = 0;
+    uint32_t entry_count = 0;
+
+    for (uint32_t i = 0; i < length; ++i)
+        score += Alphabet->values[sorted[i]];
+
+    entries[entry_count++] = make_rack_entry(sorted, length, score);
+
+    for (uint32_t i = 0; i < length; ++i) {
+        if (i && sorted[i] == sorted[i - 1])
+            continue;
+
+        uint32_t count = 0;
+
+        for (uint32_t k = 0; k < length; ++k) {
+            if (k != i)
+                variant[count++] = sorted[k];
+        }
+
+        variant[count] = RACK_BLANK_SYMBOL;
+        entries[entry_count++] = make_rack_entry(variant, length, score - Alphabet->values[sorted[i]]);
+
+        for (uint32_t j = i + 1; j < length; ++j) {
+            if (j > i + 1 && sorted[j] == sorted[j - 1])
+                continue;
+
+            count = 0;
+
+            for (uint32_t k = 0; k < length; ++k) {
+                if (k != i && k != j)
+                    variant[count++] = sorted[k];
+            }
+
+            variant[count] = RACK_BLANK_SYMBOL;
+            variant[count + 1] = RACK_BLANK_SYMBOL;
+            entries[entry_count++] = make_rack_entry(variant, length, score - Alphabet->values[sorted[i]] - Alphabet->values[sorted[j]]);
+        }
+    }
+
+    return entry_count;
+}
+
+static uint32_t
+get_home_slot(rack_table* Table, uint64_t entry)
+{
+    return (uint32_t) mix_hash(entry & RACK_KEY_MASK) & Table->slot_mask;
+}
+
+static uint32_t
+get_shard(rack_table_build* Build, uint64_t entry)
+{
+    return get_home_slot(Build->Table, entry) >> (Build->slot_bits - RACK_SHARD_BITS);
+}
+
+// NOTE: sets up a build over a normalized dictionary
+int
+begin_rack_table_build(rack_table_build* Build, rack_table* Table, alphabet* Alphabet, const char* contents, uint32_t size)
+{
+    memset(Build, 0, sizeof(*Build));
+    memset(Table, 0, sizeof(*Table));
+    Build->Table = Table;
+    Build->Alphabet = Alphabet;
+    Build->contents = contents;
+    Build->size = size;
+
+    return begin_staged_build(&Build->Stages, contents, size, RACK_RANGE_COUNT, RACK_SHARD_COUNT);
+}
+
+uint32_t
+get_rack_stage_size(rack_table_build* Build)
+{
+    return (Build->stage >= RACK_STAGE_SORT) ? RACK_SHARD_COUNT : RACK_RANGE_COUNT;
+}
+
+/*
+ * Counting-sorts one shard's entries by home slot, keeping dictionary
+ * order within a slot, then keeps the best score of each key. Equal keys
+ * share a home slot, so each slot's run is compared within itself. Also
+ * notes the last slot the shard takes when nothing spills into it.
+ */
+static void
+sort_shard(rack_table_build* Build, uint32_t shard)
+{
+    rack_table* Table = Build->Table;
+    uint32_t shard_slot_count = (Table->slot_mask + 1) / RACK_SHARD_COUNT;
+    uint32_t first_slot = shard * shard_slot_count;
+    uint32_t first_entry = Build->shard_entries[shard];
+    uint32_t entry_count = Build->shard_entries[shard + 1] - first_entry;
+    uint64_t* entries = Build->sharded_entries + first_entry;
+    uint64_t* sorted = Build->entries + first_entry;
+    uint32_t* home_starts = Build->home_starts + (size_t) shard * (shard_slot_count + 1);
+
+    for (uint32_t e = 0; e < entry_count; ++e)
+        ++home_starts[get_home_slot(Table, entries[e]) - first_slot + 1];
+
+    for (uint32_t h = 0; h < shard_slot_count; ++h)
+        home_starts[h + 1] += home_starts[h];
+
+    for (uint32_t e = 0; e < entry_count; ++e)
+        sorted[home_starts[get_home_slot(Table, entries[e]) - first_slot]++] = entries[e];
+
+    uint32_t kept = 0;
+    uint32_t run_start = 0;
+    int64_t last_slot = -1;
+
+    for (uint32_t h = 0; h < shard_slot_count; ++h) {
+        uint32_t run_end = home_starts[h];
+        uint32_t first_kept = kept;
+
+        for (uint32_t e = run_start; e < run_end; ++e) {
+            uint32_t k = first_kept;
+
+            while (k < kept && (entries[k] & RACK_KEY_MASK) != (sorted[e] & RACK_KEY_MASK))
+                ++k;
+
+            if (k == kept) {
+                entries[kept++] = sorted[e];
+                last_slot = (last_slot + 1 > first_slot + h) ? last_slot + 1 : first_slot + h;
+            } else if (sorted[e] > entries[k]) {
+                entries[k] = sorted[e];
+            }
+        }
+
+        run_start = run_end;
+    }
+
+    Build->shard_counts[shard] = kept;
+    Build->shard_ends[shard] = last_slot;
+}
+
+static void
+place_shard(rack_table_build* Build, uint32_t shard)
+{
+    rack_table* Table = Build->Table;
+    uint64_t* entries = Build->sharded_entries + Build->shard_entries[shard];
+    int64_t slot = Build->shard_carries[shard];
+
+    for (uint32_t e = 0; e < Build->shard_counts[shard]; ++e) {
+        int64_t home = get_home_slot(Table, entries[e]);
+
+        slot = (slot + 1 > home) ? slot + 1 : home;
+        Table->entries[slot & Table->slot_mask] = entries[e];
+    }
+}
+
+// NOTE: index is a range for SPLIT, EXPAND and SCATTER, a shard after
+void
+run_rack_stage(rack_table_build* Build, uint32_t index)
+{
+    const char* contents = Build->contents;
+    uint32_t end = Build->Stages.range_starts[index + 1];
+
+    switch (Build->stage) {
+    case RACK_STAGE_SPLIT: {
+        uint32_t entry_count = 0;
+        uint32_t word_count = 0;
+        uint32_t min_length = RACK_MAX_TILES + 1;
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < end;) {
+            uint32_t start = i;
+
+            while (i < Build->size && contents[i] != '\n')
+                ++i;
+
+            uint32_t length = i++ - start;
+
+            if (length && length <= RACK_MAX_TILES) {
+                ++word_count;
+                entry_count += 1 + length + length * (length - 1) / 2;
+
+                if (length < min_length)
+                    min_length = length;
+            }
+        }
+
+        Build->range_entries[index + 1] = entry_count;
+        Build->range_word_counts[index] = word_count;
+        Build->range_min_lengths[index] = min_length;
+    } break;
+
+    case RACK_STAGE_EXPAND: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * RACK_SHARD_COUNT;
+        uint64_t* entries = Build->entries + Build->range_entries[index];
+        uint32_t entry_count = 0;
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < end;) {
+            uint32_t start = i;
+
+            while (i < Build->size && contents[i] != '\n')
+                ++i;
+
+            uint32_t length = i++ - start;
+            uint8_t sorted[RACK_MAX_TILES];
+
+            if (!length || length > RACK_MAX_TILES)
+                continue;
+
+            for (uint32_t k = 0; k < length; ++k)
+                sorted[k] = (uint8_t) (contents[start + k] - TILE_CODE_BASE);
+
+            sort_symbols(sorted, length);
+
+            uint32_t listed = list_word_racks(Build->Alphabet, sorted, length, entries + entry_count);
+
+            for (uint32_t e = entry_count; e < entry_count + listed; ++e)
+                ++shard_counts[get_shard(Build, entries[e])];
+
+            entry_count += listed;
+        }
+
+        Build->range_entry_counts[index] = entry_count;
+    } break;
+
+    case RACK_STAGE_SCATTER: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * RACK_SHARD_COUNT;
+        uint64_t* entries = Build->entries + Build->range_entries[index];
+
+        for (uint32_t e = 0; e < Build->range_entry_counts[index]; ++e)
+            Build->sharded_entries[shard_counts[get_shard(Build, entries[e])]++] = entries[e];
+    } break;
+
+    case RACK_STAGE_SORT:
+        sort_shard(Build, index);
+        break;
+
+    case RACK_STAGE_PLACE:
+        place_shard(Build, index);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// NOTE: the table is sized at most half full from the most entries the
+// short words can list, as before any are merged
+static int
+allocate_rack_table(rack_table_build* Build)
+{
+    rack_table* Table = Build->Table;
+    uint32_t max_entry_count = Build->range_entries[RACK_RANGE_COUNT];
+    uint32_t slot_count = RACK_SHARD_COUNT;
+
+    Build->slot_bits = RACK_SHARD_BITS;
+
+    while (slot_count < 2 * (uint64_t) max_entry_count) {
+        slot_count *= 2;
+        ++Build->slot_bits;
+    }
+
+    Table->entries = (uint64_t*) VirtualAlloc(NULL, (size_t) slot_count * sizeof(uint64_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Table->entries)
+        return 0;
+
+    Table->slot_mask = slot_count - 1;
+
+    size_t entries_size = ((size_t) max_entry_count + 1) * sizeof(uint64_t);
+    size_t home_starts_size = ((size_t) slot_count + RACK_SHARD_COUNT) * sizeof(uint32_t);
+
+    Build->Stages.scratch = (char*) VirtualAlloc(NULL, 2 * entries_size + home_starts_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Build->Stages.scratch)
+        return 0;
+
+    Build->entries = (uint64_t*) Build->Stages.scratch;
+    Build->sharded_entries = (uint64_t*) (Build->Stages.scratch + entries_size);
+    Build->home_starts = (uint32_t*) (Build->Stages.scratch + 2 * entries_size);
+
+    return 1;
+}
+
+/*
+ * Where each shard starts laying out: after the last slot the shards
+ * before it took. A shard of count keys after slot carry ends at
+ * carry + count or where it ends alone, whichever is later. The last
+ * shard can wrap around into the first, which then starts after it, so
+ * this goes round until the wrap stops moving; with the table at most
+ * half full that takes a round or two.
+ */
+static void
+assign_carries(rack_table_build* Build)
+{
+    rack_table* Table = Build->Table;
+    int64_t slot_count = (int64_t) Table->slot_mask + 1;
+    int64_t wrap = -1;
+
+    for (;;) {
+        int64_t last_slot = wrap;
+
+        for (uint32_t s = 0; s < RACK_SHARD_COUNT; ++s) {
+            Build->shard_carries[s] = last_slot;
+
+            if (!Build->shard_counts[s])
+                continue;
+
+            if (last_slot + Build->shard_counts[s] > Build->shard_ends[s])
+                last_slot += Build->shard_counts[s];
+            else
+                last_slot = Build->shard_ends[s];
+        }
+
+        int64_t next_wrap = (last_slot >= slot_count) ? last_slot - slot_count : -1;
+
+        if (next_wrap == wrap)
+            break;
+
+        wrap = next_wrap;
+    }
+
+    for (uint32_t s = 0; s < RACK_SHARD_COUNT; ++s)
+        Table->entry_count += Build->shard_counts[s];
+}
+
+// NOTE: returns 0 when the build cannot go on
+int
+finish_rack_stage(rack_table_build* Build)
+{
+    rack_table* Table = Build->Table;
+
+    switch (Build->stage) {
+    case RACK_STAGE_SPLIT:
+        Table->min_length = RACK_MAX_TILES + 1;
+
+        for (uint32_t r = 0; r < RACK_RANGE_COUNT; ++r) {
+            Build->range_entries[r + 1] += Build->range_entries[r];
+            Table->word_count += Build->range_word_counts[r];
+
+            if (Build->range_min_lengths[r] < Table->min_length)
+                Table->min_length = Build->range_min_lengths[r];
+        }
+
+        return allocate_rack_table(Build);
+
+    case RACK_STAGE_EXPAND:
+        assign_shard_starts(&Build->Stages, Build->shard_entries);
+        return 1;
+
+    case RACK_STAGE_SORT:
+        assign_carries(Build);
+        return 1;
+
+    default:
+        return 1;
+    }
+}
+
+int
+end_rack_table_build(rack_table_build* Build, int succeeded)
+{
+    end_staged_build(&Build->Stages);
+
+    if (!succeeded)
+        release_rack_table(Build->Table);
+
+    return succeeded;
+}
+
+/*
+ * Best play of a rack of at most RACK_MAX_TILES symbols: the longest and
+ * the highest scoring word, not necessarily the same one. The rack is
+ * sorted once, so every subset of its positions is a sorted multiset
+ * whose key extends the key of the subset without its lowest position.
+ * All lookups are prefetched before the first one is read.
+ */
+void
+evaluate_rack(rack_table* Table, const uint8_t* symbols, uint32_t count, rack_result* Result)
+{
+    uint8_t sorted[RACK_MAX_TILES];
+    uint64_t keys[1 << RACK_MAX_TILES];
+    uint32_t masks[1 << RACK_MAX_TILES];
+    uint32_t slots[1 << RACK_MAX_TILES];
+    uint32_t probe_count = 0;
+
+    memcpy(sorted, symbols, count);
+    sort_symbols(sorted, count);
+
+    keys[0] = 0;
+
+    for (uint32_t mask = 1; mask < (1u << count); ++mask) {
+        keys[mask] = (keys[mask & (mask - 1)] << RACK_SYMBOL_BITS) | (uint64_t) (sorted[_tzcnt_u32(mask)] + 1);
+
+        if (__popcnt(mask) < Table->min_length)
+            continue;
+
+        masks[probe_count] = mask;
+        slots[probe_count] = (uint32_t) mix_hash(keys[mask]) & Table->slot_mask;
+        _mm_prefetch((const char*) (Table->entries + slots[probe_count]), _MM_HINT_T0);
+        ++probe_count;
+    }
+
+    Result->best_length = 0;
+    Result->best_score = 0;
+
+    for (uint32_t p = 0; p < probe_count; ++p) {
+        uint64_t key = keys[masks[p]];
+
+        for (uint32_t slot = slots[p];; slot = (slot + 1) & Table->slot_mask) {
+            uint64_t entry = Table->entries[slot];
+
+            if (!entry)
+                break;
+
+            if ((entry & RACK_KEY_MASK) != key)
+                continue;
+
+            uint32_t length = __popcnt(masks[p]);
+            uint32_t score = (uint32_t) (entry >> RACK_KEY_BITS);
+
+            if (length > Result->best_length)
+                Result->best_length = length;
+
+            if (score > Result->best_score)
+                Result->best_score = score;
+
+            break;
+        }
+    }
+}
+
+uint64_t
+get_rack_table_bytes(rack_table* Table)
+{
+    return ((uint64_t) Table->slot_mask + 1) * sizeof(uint64_t);
+}
+
+void
+release_rack_table(rack_table* Table)
+{
+    if (Table->entries)
+        VirtualFree(Table->entries, 0, MEM_RELEASE);
+
+    Table->entries = NULL;
+}
@@ -0,0 +1,91 @@
+#if !defined(RACKS_H__)
+#define RACKS_H__
+
+#include <windows.h>
+#include <stdint.h>
+#include "alphabet.h"
+#include "build.h"
+
+#define RACK_MAX_TILES 7
+#define RACK_MAX_BLANKS 2
+#define RACK_SYMBOL_BITS 7
+#define RACK_KEY_BITS (RACK_MAX_TILES * RACK_SYMBOL_BITS)
+#define RACK_KEY_MASK (((uint64_t) 1 << RACK_KEY_BITS) - 1)
+#define RACK_SHARD_BITS 8
+#define RACK_SHARD_COUNT (1 << RACK_SHARD_BITS)
+#define RACK_RANGE_COUNT 64
+
+// NOTE: rack symbols are tile codes with the blank as one extra symbol
+// after the last possible tile, so sorted multisets put blanks last
+#define RACK_BLANK_SYMBOL MAX_ALPHABET_SIZE
+
+/*
+ * Every multiset of up to RACK_MAX_TILES tiles that spells a dictionary
+ * word, with the best score it plays. A key is the multiset's sorted
+ * symbols packed RACK_SYMBOL_BITS each, so lookups are exact. Multisets
+ * with up to RACK_MAX_BLANKS blanks are in as well, the blanks standing
+ * for the word's cheapest letters, so a rack is worked out from its
+ * sub-multisets alone, without a dictionary scan.
+ */
+struct rack_table {
+    uint64_t* entries;          // score << RACK_KEY_BITS | key, 0 when empty
+    uint32_t slot_mask;
+    uint32_t entry_count;
+    uint32_t word_count;        // dictionary words of up to RACK_MAX_TILES tiles
+    uint32_t min_length;        // shorter sub-racks are never looked up
+};
+
+struct rack_result {
+    uint32_t best_length;       // 0 when no word can be played
+    uint32_t best_score;
+};
+
+enum rack_stage {
+    RACK_STAGE_SPLIT,           // per range: count its short words
+    RACK_STAGE_EXPAND,          // per range: list its words' multisets, count them per shard
+    RACK_STAGE_SCATTER,         // per range: copy its multisets to their shards
+    RACK_STAGE_SORT,            // per shard: sort by home slot, keep each key's best score
+    RACK_STAGE_PLACE,           // per shard: lay its keys out from where the last shard ended
+    RACK_STAGE_COUNT
+};
+
+/*
+ * A rack table built in stages over a staged_build. Shards own runs of
+ * home slots, and each lays its keys out in order of home slot, every
+ * one in the first free slot from its home, which leaves every key
+ * where linear probing finds it. Only where a shard's last keys spill
+ * into the next shard's slots is serial, and short.
+ *
+ *   begin, then SPLIT, EXPAND, SCATTER, SORT, PLACE, each followed by finish
+ */
+struct rack_table_build {
+    rack_table* Table;
+    alphabet* Alphabet;
+    const char* contents;
+    uint32_t size;
+    rack_stage stage;
+    uint32_t slot_bits;
+    staged_build Stages;
+    uint32_t range_entries[RACK_RANGE_COUNT + 1];   // most multisets each range can list, summed
+    uint32_t range_entry_counts[RACK_RANGE_COUNT];  // multisets each range listed
+    uint32_t range_word_counts[RACK_RANGE_COUNT];
+    uint32_t range_min_lengths[RACK_RANGE_COUNT];
+    uint32_t shard_entries[RACK_SHARD_COUNT + 1];   // first multiset of each shard
+    uint32_t shard_counts[RACK_SHARD_COUNT];        // keys left once sorted
+    int64_t shard_ends[RACK_SHARD_COUNT];           // last slot taken with nothing before the shard
+    int64_t shard_carries[RACK_SHARD_COUNT];        // last slot taken before the shard
+    uint64_t* entries;              // by range, as entries are laid out
+    uint64_t* sharded_entries;      // by shard, dictionary order within, then sorted
+    uint32_t* home_starts;          // one per slot and one per shard
+};
+
+extern int begin_rack_table_build(rack_table_build* Build, rack_table* Table, alphabet* Alphabet, const char* contents, uint32_t size);
+extern uint32_t get_rack_stage_size(rack_table_build* Build);
+extern void run_rack_stage(rack_table_build* Build, uint32_t index);
+extern int finish_rack_stage(rack_table_build* Build);
+extern int end_rack_table_build(rack_table_build* Build, int succeeded);
+extern void evaluate_rack(rack_table* Table, const uint8_t* symbols, uint32_t count, rack_result* Result);
+extern uint64_t get_rack_table_bytes(rack_table* Table);
+extern void release_rack_table(rack_table* Table);
+
+#endif
@@ -0,0 +1,4037 @@
+#include <windows.h>
+#include <time.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <immintrin.h>
+#include <intrin.h>
+#include <psapi.h>
+#include "sch.h"
+#include "alphabet.h"
+#include "leaves.h"
+#include "wordset.h"
+#include "racks.h"
+#include "classes.h"
+#include "hooks.h"
+#include "embedded.h"
+
+#define MIN_WORD_ID_CAPACITY 1024
+#define MAX_NUM_THREADS 32
+#define REPEATED_LETTER_FREQ 0xFF
+#define MAX_NUMA_NODES 64
+#define NUMA_INTERLEAVE_STRIPE (64 * 1024)
+#define POOL_SPIN_COUNT 4096
+#define DISPATCH_BENCHMARK_ORDER_SIZE 1024
+#define ANAGRAM_CLASSES_PER_ORDER 16
+#define ANAGRAM_OUTPUT_SIZE 256
+#define ANAGRAM_PARALLEL_JOIN_STEPS 65536
+#define ANAGRAM_SIGNATURE_SEED 0x5343484D554C5449ull
+#define SIMULATION_ORDER_SAMPLES 4096
+#define SIMULATION_MAX_BAG_TILES ((MAX_ALPHABET_SIZE + 1) * MAX_TILE_VALUE)
+#define SIMULATION_ENGLISH_BAG "a=9,b=2,c=2,d=4,e=12,f=2,g=3,h=2,i=9,j=1,k=1,l=4,m=2,n=6,o=8,p=2,q=1,r=6,s=4,t=6,u=4,v=2,w=2,x=1,y=2,z=1,?=2"
+#define HOOK_BENCHMARK_SCANS 64
+
+// NOTE: cost model constants, fitted on dictionary.txt
+#define COST_SCAN_NS_PER_BYTE 2.5
+#define COST_MATCH_NS 40.0
+#define COST_WORKER_WAKE_NS 5000.0
+#define COST_AVERAGE_WORD_BYTES 10.5
+#define COST_MATCH_EXPONENT 4.0
+#define COST_NO_REPEAT_MATCH_SCALE 0.125
+
+enum dictionary_layout {
+    LAYOUT_DEFAULT,
+    LAYOUT_SINGLE_NODE,
+    LAYOUT_INTERLEAVED,
+    LAYOUT_REPLICATED,
+    LAYOUT_COUNT
+};
+
+static const char* dictionary_layout_names[LAYOUT_COUNT] = {
+    "default",
+    "single",
+    "interleaved",
+    "replicated",
+};
+
+struct ctx;
+struct work_queue;
+struct word_heap;
+struct anagram_index;
+struct simulation;
+
+typedef uint64_t scan_kernel(char* ptr, char* end, ctx* context, work_queue* Queue, word_heap* Heap);
+typedef uint64_t index_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap);
+
+struct ctx {
+    alphabet* Alphabet;
+    const char* jumbled_letters;
+    const char* included_letters;
+    const char* any_of_letters;
+    alignas(64) uint8_t jumbled_letters_freq[MAX_ALPHABET_SIZE];
+    alignas(64) uint8_t included_letters_freq[MAX_ALPHABET_SIZE];
+    uint64_t jumbled_letter_mask;
+    uint64_t any_of_mask;
+    uint64_t any_of_test_mask;
+    alignas(64) int8_t tile_values[MAX_ALPHABET_SIZE];
+    uint32_t blank_count;
+    scan_kernel* kernel;
+    index_kernel* range_kernel; // set for queries over an index instead of the dictionary
+    index_kernel* class_kernel; // the same test over word_classes
+    uint8_t allow_repeated;
+    uint32_t thread_count;      // 0 lets the cost model decide
+    uint32_t top_count;         // 0 keeps every match
+    uint8_t rank_by_score;
+    leave_table* Leaves;
+    anagram_index* Anagrams;
+    word_set_build* WordSet;
+    hook_table_build* HookBuild;
+    word_class_build* ClassBuild;
+    rack_table_build* RackBuild;
+    simulation* Simulation;
+    word_classes* Classes;
+};
+
+struct word_t {
+    char* word;
+    int word_length;
+};
+
+struct ranked_word {
+    uint32_t id;
+    int word_length;
+    uint32_t rank;              // tile score or length
+};
+
+/*
+ * What one thread keeps of its matches. With --top it is a bounded
+ * min-heap of the best it has seen: the root is the worst kept word, so
+ * a new match costs one compare unless it displaces it. Otherwise every
+ * match goes on ids, which the thread grows by itself.
+ *
+ * Both hold word IDs, byte offsets into base, the dictionary copy the
+ * thread scans. Every copy has the same layout, so an ID names the same
+ * word in all of them and outlives the copy it was found in.
+ */
+struct word_heap {
+    ranked_word* entries;
+    uint32_t count;
+    uint32_t capacity;          // 0 when --top is off
+    char* base;
+    uint32_t* ids;
+    uint32_t id_count;
+    uint32_t id_capacity;
+    uint8_t out_of_memory;      // ids could not grow, matches were lost
+};
+
+/*
+ * Words of the multi-word anagram search that share one letter
+ * histogram. signature is the multiset hash of that histogram (see
+ * get_anagram_signature).
+ */
+struct anagram_class {
+    alignas(64) uint8_t freq[MAX_ALPHABET_SIZE];
+    uint64_t signature;
+    uint32_t first_word;        // into anagram_index::words
+    uint32_t word_count;
+    uint32_t length;
+};
+
+// NOTE: per-thread batch of combinations waiting to be streamed
+struct anagram_output {
+    sch_word words[ANAGRAM_OUTPUT_SIZE][SCH_MAX_ANAGRAM_WORDS];
+    uint32_t word_counts[ANAGRAM_OUTPUT_SIZE];
+    uint32_t count;
+};
+
+struct anagram_index {
+    uint64_t keys[MAX_ALPHABET_SIZE];   // random per tile, summed into signatures
+    uint64_t rack_signature;
+    uint32_t rack_size;
+    uint32_t max_words;
+    anagram_class* classes;     // shortest first
+    uint32_t class_count;
+    char* contents;             // dictionary the candidate words point into
+    word_t* words;              // candidates grouped by class
+    uint32_t* slots;            // class index + 1 by signature, 0 when empty
+    uint32_t slot_mask;
+    anagram_output* Outputs;    // one per heap of the join queue
+    sch_anagram_fn* output;
+    void* output_user;
+    SRWLOCK OutputLock;
+    volatile uint64_t ClassCombinationCount;
+};
+
+// NOTE: what one thread has drawn, on its own cache lines
+struct alignas(64) simulation_counts {
+    uint64_t length_histogram[RACK_MAX_TILES + 1];
+    uint64_t score_histogram[SCH_SIMULATION_SCORE_BUCKETS];
+    uint64_t score_sum;
+};
+
+/*
+ * A rack simulation: the bag without the leave, as one symbol per tile,
+ * and the leave every rack starts from. Order i draws samples
+ * i * SIMULATION_ORDER_SAMPLES onwards from a bag and a random stream of
+ * its own, so the racks depend on the seed but not on the threads.
+ */
+struct simulation {
+    rack_table* Table;
+    uint8_t tiles[SIMULATION_MAX_BAG_TILES];
+    uint32_t tile_count;
+    uint8_t leave[RACK_MAX_TILES];
+    uint32_t leave_count;
+    uint32_t rack_size;
+    uint64_t seed;
+    uint64_t sample_count;
+    simulation_counts* Counts;  // one per heap
+};
+
+struct work_order {
+    ctx* context;
+    uint32_t startOffset;
+    uint32_t endOffset;
+};
+
+struct worker_pool;
+
+struct work_queue {
+    uint32_t WorkOrderCount;
+    work_order* WorkOrders;
+    volatile uint64_t NextWorkOrderIndex;
+    volatile uint64_t TotalWordsFound;
+    volatile uint64_t Retired;
+    word_heap* Heaps;           // one per worker, then one for the calling thread
+    uint32_t HeapCount;
+    worker_pool* Pool;          // while dispatched to it, NULL for the calling thread alone
+    sch_progress_fn* progress;
+    void* progress_user;
+};
+
+struct numa_node {
+    USHORT node_number;
+    GROUP_AFFINITY affinity;
+    uint32_t processor_count;
+    char* fileContents;     // dictionary copy this node's workers scan
+    uint8_t large_pages;    // fileContents is a replica on large pages
+};
+
+struct numa_topology {
+    uint32_t node_count;
+    numa_node nodes[MAX_NUMA_NODES];
+    char* interleaved_contents;
+};
+
+struct page_stats {
+    size_t small_page_size;
+    size_t large_page_size;     // 0 when large pages are off or not permitted
+    uint64_t small_page_count;
+    uint64_t large_page_count;
+};
+
+struct worker_thread {
+    worker_pool* Pool;
+    uint32_t index;
+    char* fileContents;
+    GROUP_AFFINITY affinity;
+};
+
+struct query_plan {
+    uint64_t scan_bytes;
+    uint64_t estimated_words;
+    uint64_t estimated_matches;
+    uint32_t rack_size;
+    uint8_t allow_repeated;
+    uint8_t forced;
+    double estimated_ns;
+    uint32_t thread_count;      // including the calling thread
+    uint32_t max_thread_count;
+};
+
+struct worker_pool {
+    work_queue* Queue;
+    worker_thread* Workers;
+    HANDLE* Threads;
+    uint32_t worker_count;
+    volatile uint32_t ActiveWorkerCount;    // workers that join the current query
+    volatile LONG Generation;   // bumped once per dispatched query
+    volatile LONG Shutdown;
+    volatile LONG BusyWorkerCount;  // workers that may still touch Pool->Queue
+};
+
+// NOTE: ties fall back to dictionary order, so sorted results do not
+// depend on which thread found which word
+int
+compare_lexicographically(const void* a, const void* b)
+{
+    word_t* word_a = (word_t*) a;
+    word_t* word_b = (word_t*) b;
+    int order = strncmp(word_a->word, word_b->word, (word_a->word_length < word_b->word_length) ? word_a->word_length : word_b->word_length);
+
+    if (order)
+        return order;
+
+    if (word_a->word_length != word_b->word_length)
+        return (word_a->word_length < word_b->word_length) ? -1 : 1;
+
+    return (word_a->word < word_b->word) ? -1 : (word_a->word > word_b->word);
+}
+
+int
+compare_word_length(const void* a, const void* b)
+{
+    word_t* word_a = (word_t*) a;
+    word_t* word_b = (word_t*) b;
+
+    if (word_a->word_length < word_b->word_length)
+        return -1;
+
+    if (word_a->word_length > word_b->word_length)
+        return 1;
+
+    return (word_a->word < word_b->word) ? -1 : (word_a->word > word_b->word);
+}
+
+int
+compare_word_ids(const void* a, const void* b)
+{
+    uint32_t id_a = *(uint32_t*) a;
+    uint32_t id_b = *(uint32_t*) b;
+
+    return (id_a < id_b) ? -1 : (id_a > id_b);
+}
+
+int
+compare_anagram_candidates(const void* a, const void* b)
+{
+    word_t* word_a = (word_t*) a;
+    word_t* word_b = (word_t*) b;
+
+    if (word_a->word_length != word_b->word_length)
+        return (word_a->word_length < word_b->word_length) ? -1 : 1;
+
+    return memcmp(word_a->word, word_b->word, (size_t) word_a->word_length);
+}
+
+uint64_t
+locked_add_and_return_previous_value(uint64_t volatile* Value, uint64_t Delta)
+{
+    uint64_t Result = InterlockedExchangeAdd64((volatile LONG64*) Value, Delta);
+
+    return Result;
+}
+
+static uint64_t
+get_next_random(uint64_t* state)
+{
+    // NOTE: splitmix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
+/*
+ * Doubles a thread's ID list, starting from MIN_WORD_ID_CAPACITY, so a
+ * query holds memory for the matches it has rather than for the whole
+ * dictionary.
+ */
+static int
+grow_word_ids(word_heap* Heap)
+{
+    uint32_t capacity = Heap->id_capacity ? 2 * Heap->id_capacity : MIN_WORD_ID_CAPACITY;
+    uint32_t* ids = (uint32_t*) VirtualAlloc(NULL, (size_t) capacity * sizeof(uint32_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!ids) {
+        Heap->out_of_memory = 1;
+        return 0;
+    }
+
+    if (Heap->ids) {
+        memcpy(ids, Heap->ids, (size_t) Heap->id_count * sizeof(uint32_t));
+        VirtualFree(Heap->ids, 0, MEM_RELEASE);
+    }
+
+    Heap->ids = ids;
+    Heap->id_capacity = capacity;
+
+    return 1;
+}
+
+static void
+add_word_to_list(word_heap* Heap, char* location)
+{
+    if (Heap->id_count == Heap->id_capacity && !grow_word_ids(Heap))
+        return;
+
+    Heap->ids[Heap->id_count++] = (uint32_t) (location - Heap->base);
+}
+
+/*
+ * Total order on ranked words, best first: higher rank, then
+ * lexicographically smaller, so the kept top K does not depend on which
+ * thread saw which word.
+ */
+static int
+is_ranked_before(const char* contents, ranked_word* a, ranked_word* b)
+{
+    if (a->rank != b->rank)
+        return a->rank > b->rank;
+
+    int common = (a->word_length < b->word_length) ? a->word_length : b->word_length;
+    int order = memcmp(contents + a->id, contents + b->id, (size_t) common);
+
+    if (order)
+        return order < 0;
+
+    return a->word_length < b->word_length;
+}
+
+// NOTE: puts New at the root of the first count entries and lets it sink
+static void
+sift_down_ranked_word(const char* contents, ranked_word* entries, uint32_t count, ranked_word New)
+{
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && is_ranked_before(contents, entries + child, entries + child + 1))
+            ++child;
+
+        if (!is_ranked_before(contents, &New, entries + child))
+            break;
+
+        entries[i] = entries[child];
+        i = child;
+    }
+
+    entries[i] = New;
+}
+
+static void
+push_ranked_word(word_heap* Heap, const char* contents, ranked_word New)
+{
+    ranked_word* entries = Heap->entries;
+
+    if (Heap->count < Heap->capacity) {
+        uint32_t i = Heap->count++;
+
+        while (i > 0) {
+            uint32_t parent = (i - 1) / 2;
+
+            if (!is_ranked_before(contents, entries + parent, &New))
+                break;
+
+            entries[i] = entries[parent];
+            i = parent;
+        }
+
+        entries[i] = New;
+    } else if (is_ranked_before(contents, &New, entries)) {
+        sift_down_ranked_word(contents, entries, Heap->count, New);
+    }
+}
+
+static void
+add_word_to_heap(word_heap* Heap, char* location, int size, uint32_t rank)
+{
+    ranked_word New = { (uint32_t) (location - Heap->base), size, rank };
+
+    push_ranked_word(Heap, Heap->base, New);
+}
+
+/*
+ * Heapsort in place: the root is always the worst word left, so moving
+ * it behind the shrinking heap leaves the entries best first.
+ */
+static void
+sort_word_heap(word_heap* Heap, const char* contents)
+{
+    for (uint32_t end = Heap->count; end > 1; --end) {
+        ranked_word Worst = Heap->entries[0];
+
+        sift_down_ranked_word(contents, Heap->entries, end - 1, Heap->entries[end - 1]);
+        Heap->entries[end - 1] = Worst;
+    }
+}
+
+static uint8_t
+is_word_delim(int c)
+{
+    return c == '\n' || c == '\r' || c == ' ';
+}
+
+static uint32_t
+get_cpu_count(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+
+    return Info.dwNumberOfProcessors;
+}
+
+/*
+ * Histogram and mask operations for one alphabet width: 32 letters fit an
+ * AVX2 register and a 32-bit mask (English runs here), up to 64 letters
+ * use AVX-512BW and 64-bit masks.
+ */
+template <int FreqSize>
+struct letter_ops;
+
+template <>
+struct letter_ops<32> {
+    typedef uint32_t mask_t;
+    typedef __m256i vec_t;
+
+    static vec_t load(uint8_t* freq) { return _mm256_load_si256((__m256i*) freq); }
+    static void store(uint8_t* freq, vec_t V) { _mm256_store_si256((__m256i*) freq, V); }
+    static void clear(uint8_t* freq) { _mm256_store_si256((__m256i*) freq, _mm256_setzero_si256()); }
+    static vec_t subs(vec_t A, vec_t B) { return _mm256_subs_epu8(A, B); }
+    static vec_t one(void) { return _mm256_set1_epi8(1); }
+    static uint32_t popcount(mask_t mask) { return __popcnt(mask); }
+
+    static mask_t
+    nonzero(vec_t V)
+    {
+        return ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(V, _mm256_setzero_si256()));
+    }
+
+    static uint32_t
+    sum(vec_t V)
+    {
+        __m256i Sums = _mm256_sad_epu8(V, _mm256_setzero_si256());
+        __m128i Sum = _mm_add_epi64(_mm256_castsi256_si128(Sums), _mm256_extracti128_si256(Sums, 1));
+
+        return (uint32_t) (_mm_cvtsi128_si64(Sum) + _mm_extract_epi64(Sum, 1));
+    }
+
+    // NOTE: only letters the rack holds score, letters played by blanks
+    // count 0
+    static uint32_t
+    score(vec_t Freq, vec_t Rack, vec_t Values)
+    {
+        __m256i Pairs = _mm256_maddubs_epi16(_mm256_min_epu8(Freq, Rack), Values);
+        __m256i Quads = _mm256_madd_epi16(Pairs, _mm256_set1_epi16(1));
+        __m128i Sum = _mm_add_epi32(_mm256_castsi256_si128(Quads), _mm256_extracti128_si256(Quads, 1));
+        Sum = _mm_hadd_epi32(Sum, Sum);
+        Sum = _mm_hadd_epi32(Sum, Sum);
+
+        return (uint32_t) _mm_cvtsi128_si32(Sum);
+    }
+};
+
+template <>
+struct letter_ops<64> {
+    typedef uint64_t mask_t;
+    typedef __m512i vec_t;
+
+    static vec_t load(uint8_t* freq) { return _mm512_load_si512(freq); }
+    static void store(uint8_t* freq, vec_t V) { _mm512_store_si512(freq, V); }
+    static void clear(uint8_t* freq) { _mm512_store_si512(freq, _mm512_setzero_si512()); }
+    static vec_t subs(vec_t A, vec_t B) { return _mm512_subs_epu8(A, B); }
+    static vec_t one(void) { return _mm512_set1_epi8(1); }
+    static uint32_t popcount(mask_t mask) { return (uint32_t) __popcnt64(mask); }
+    static mask_t nonzero(vec_t V) { return _mm512_test_epi8_mask(V, V); }
+    static uint32_t sum(vec_t V) { return (uint32_t) _mm512_reduce_add_epi64(_mm512_sad_epu8(V, _mm512_setzero_si512())); }
+
+    static uint32_t
+    score(vec_t Freq, vec_t Rack, vec_t Values)
+    {
+        __m512i Pairs = _mm512_maddubs_epi16(_mm512_min_epu8(Freq, Rack), Values);
+
+        return (uint32_t) _mm512_reduce_add_epi32(_mm512_madd_epi16(Pairs, _mm512_set1_epi16(1)));
+    }
+};
+
+static uint32_t
+get_letter_index(char c)
+{
+    return (uint8_t) c - TILE_CODE_BASE;
+}
+
+static int
+get_word_mask(alphabet* Alphabet, const char* word, uint64_t* mask)
+{
+    uint8_t codes[256];
+    int count = get_tile_codes(Alphabet, word, codes, sizeof(codes));
+
+    for (int i = 0; i < count; ++i) {
+        if (codes[i] != BLANK_CODE)
+            *mask |= (uint64_t) 1 << codes[i];
+    }
+
+    return count >= 0;
+}
+
+static int
+add_letters_to_freq(alphabet* Alphabet, uint8_t* freq, const char* letters, uint8_t allow_repeated, uint32_t* blank_count)
+{
+    uint8_t codes[256];
+    int count = get_tile_codes(Alphabet, letters, codes, sizeof(codes));
+
+    for (int i = 0; i < count; ++i) {
+        if (codes[i] == BLANK_CODE) {
+            if (blank_count)
+                ++*blank_count;
+
+            continue;
+        }
+
+        uint8_t* letter_count = freq + codes[i];
+
+        if (allow_repeated)
+            *letter_count = REPEATED_LETTER_FREQ;
+        else if (*letter_count < REPEATED_LETTER_FREQ)
+            ++*letter_count;
+    }
+
+    return count >= 0;
+}
+
+/*
+ * Over-rack letters have to be covered by blanks, except for one tile
+ * from the any-of set (the board tile being hooked onto). With -r a
+ * blank stands for one more reusable letter, so distinct letters are
+ * counted instead of tiles.
+ */
+template <int FreqSize>
+static uint32_t
+get_uncovered_count(typename letter_ops<FreqSize>::vec_t Over,
+                    typename letter_ops<FreqSize>::mask_t over_mask,
+                    typename letter_ops<FreqSize>::mask_t any_of_mask,
+                    uint8_t allow_repeated)
+{
+    typedef letter_ops<FreqSize> ops;
+    typename ops::mask_t over_many_mask = ops::nonzero(ops::subs(Over, ops::one()));
+
+    if (allow_repeated)
+        return ops::popcount(over_mask) - !!(over_mask & any_of_mask & ~over_many_mask);
+
+    return ops::sum(Over) - !!(over_mask & any_of_mask);
+}
+
+/*
+ * Tests a word histogram against the rack, the required multiset, the
+ * any-of set and blanks in one pass without per-letter branches:
+ *   - Over:    letters the word uses beyond what the rack holds
+ *   - Missing: required letters the word does not contain often enough
+ * Every mode and alphabet goes through this one check; -b compares it
+ * against the specialized kernels below.
+ */
+static uint8_t
+is_word_spellable(uint8_t* word_freq, ctx* context)
+{
+    typedef letter_ops<MAX_ALPHABET_SIZE> ops;
+
+    ops::vec_t Freq = ops::load(word_freq);
+    ops::vec_t Over = ops::subs(Freq, ops::load(context->jumbled_letters_freq));
+
+    uint64_t word_mask = ops::nonzero(Freq);
+    uint64_t over_mask = ops::nonzero(Over);
+    uint64_t missing_mask = ops::nonzero(ops::subs(ops::load(context->included_letters_freq), Freq));
+    uint32_t uncovered = get_uncovered_count<MAX_ALPHABET_SIZE>(Over, over_mask, context->any_of_mask, context->allow_repeated);
+
+    return !missing_mask &
+           (uncovered <= context->blank_count) &
+           !!(word_mask & context->any_of_test_mask);
+}
+
+static uint64_t
+scan_words_generic(char* ptr, char* end, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    typedef letter_ops<MAX_ALPHABET_SIZE> ops;
+
+    uint64_t words_found = 0;
+    alignas(64) uint8_t word_freq[MAX_ALPHABET_SIZE];
+
+    // NOTE: the end of the order counts as a delimiter, so the word right
+    // before a chunk boundary is not lost
+    while (ptr < end) {
+        while (ptr < end && is_word_delim(*ptr))
+            ++ptr;
+
+        char* wordstart = ptr;
+
+        while (ptr < end && !is_word_delim(*ptr))
+            ++ptr;
+
+        if (ptr > wordstart) {
+            memset(word_freq, 0, sizeof(word_freq));
+
+            for (char* w = wordstart; w != ptr; ++w)
+                word_freq[get_letter_index(*w)]++;
+
+            if (is_word_spellable(word_freq, context)) {
+                int word_length = (int) (ptr - wordstart);
+                ++words_found;
+
+                if (Heap->capacity) {
+                    uint32_t rank = context->rank_by_score
+                        ? ops::score(ops::load(word_freq), ops::load(context->jumbled_letters_freq), ops::load((uint8_t*) context->tile_values))
+                        : (uint32_t) word_length;
+
+                    add_word_to_heap(Heap, wordstart, word_length, rank);
+                } else {
+                    add_word_to_list(Heap, wordstart);
+                }
+            }
+        }
+    }
+
+    return words_found;
+}
+
+/*
+ * Scan kernel specialized at compile time on the alphabet width and the
+ * query mode:
+ *   FreqSize - 32 or 64 letter histogram (see letter_ops)
+ *   Repeat   - -r, rack letters are reusable
+ *   Required - -i or -o constraints are present
+ *   Blanks   - the rack holds blank tiles
+ * The query state lives in registers for the whole order, and modes that
+ * need no counts (-r without -i/-o) skip the histogram and test a
+ * letter mask only. With --top, matches go to the thread's heap ranked by
+ * length or by the score of the histogram just built.
+ */
+template <int FreqSize, bool Repeat, bool Required, bool Blanks>
+static uint64_t
+scan_words(char* ptr, char* end, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    typedef letter_ops<FreqSize> ops;
+    typedef typename ops::mask_t mask_t;
+    typedef typename ops::vec_t vec_t;
+
+    const vec_t Rack = ops::load(context->jumbled_letters_freq);
+    const vec_t RequiredFreq = ops::load(context->included_letters_freq);
+    const mask_t rack_mask = (mask_t) context->jumbled_letter_mask;
+    const mask_t any_of_mask = (mask_t) context->any_of_mask;
+    const mask_t any_of_test_mask = (mask_t) context->any_of_test_mask;
+    const vec_t Values = ops::load((uint8_t*) context->tile_values);
+    const uint32_t blank_count = context->blank_count;
+    const uint8_t ranked = Heap->capacity != 0;
+    const uint8_t rank_by_score = context->rank_by_score;
+    uint64_t words_found = 0;
+    alignas(64) uint8_t word_freq[FreqSize];
+
+    while (ptr < end) {
+        while (ptr < end && is_word_delim(*ptr))
+            ++ptr;
+
+        char* wordstart = ptr;
+        uint8_t found;
+        uint32_t score = 0;
+
+        if (Repeat && !Required) {
+            mask_t word_mask = 0;
+
+            for (; ptr < end && !is_word_delim(*ptr); ++ptr)
+                word_mask |= (mask_t) 1 << get_letter_index(*ptr);
+
+            mask_t over_mask = word_mask & ~rack_mask;
+            found = Blanks ? (ops::popcount(over_mask) <= blank_count) : !over_mask;
+
+            if (found & rank_by_score) {
+                for (char* w = wordstart; w != ptr; ++w) {
+                    uint32_t index = get_letter_index(*w);
+                    score += ((rack_mask >> index) & 1) * (uint32_t) context->tile_values[index];
+                }
+            }
+        } else {
+            ops::clear(word_freq);
+
+            for (; ptr < end && !is_word_delim(*ptr); ++ptr)
+                word_freq[get_letter_index(*ptr)]++;
+
+            vec_t Freq = ops::load(word_freq);
+            vec_t Over = ops::subs(Freq, Rack);
+            mask_t over_mask = ops::nonzero(Over);
+
+            if (Required) {
+                mask_t word_mask = ops::nonzero(Freq);
+                mask_t missing_mask = ops::nonzero(ops::subs(RequiredFreq, Freq));
+                uint32_t uncovered = get_uncovered_count<FreqSize>(Over, over_mask, any_of_mask, Repeat);
+
+                found = !missing_mask & (uncovered <= blank_count) & !!(word_mask & any_of_test_mask);
+            } else if (Blanks) {
+                found = ops::sum(Over) <= blank_count;
+            } else {
+                found = !over_mask;
+            }
+
+            if (found & rank_by_score)
+                score = ops::score(Freq, Rack, Values);
+        }
+
+        if (found & (ptr > wordstart)) {
+            int word_length = (int) (ptr - wordstart);
+            ++words_found;
+
+            if (ranked)
+                add_word_to_heap(Heap, wordstart, word_length, rank_by_score ? score : (uint32_t) word_length);
+            else
+                add_word_to_list(Heap, wordstart);
+        }
+    }
+
+    return words_found;
+}
+
+#define SCAN_KERNELS_FOR_WIDTH(FreqSize)                                                                          \
+    { { { scan_words<FreqSize, false, false, false>, scan_words<FreqSize, false, false, true> },                  \
+        { scan_words<FreqSize, false, true, false>,  scan_words<FreqSize, false, true, true> } },                 \
+      { { scan_words<FreqSize, true, false, false>,  scan_words<FreqSize, true, false, true> },                   \
+        { scan_words<FreqSize, true, true, false>,   scan_words<FreqSize, true, true, true> } } }
+
+static scan_kernel* scan_kernels[2][2][2][2] = {
+    SCAN_KERNELS_FOR_WIDTH(32),
+    SCAN_KERNELS_FOR_WIDTH(64),
+};
+
+/*
+ * scan_words over the class layout: each anagram class's histogram is
+ * loaded instead of counted from the text, and its members are only
+ * touched when it passes. Members share the histogram, so one length
+ * and one rank serve all of them.
+ */
+template <int FreqSize, bool Repeat, bool Required, bool Blanks>
+static uint64_t
+scan_word_classes(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    typedef letter_ops<FreqSize> ops;
+    typedef typename ops::mask_t mask_t;
+    typedef typename ops::vec_t vec_t;
+
+    word_classes* Classes = context->Classes;
+    const vec_t Rack = ops::load(context->jumbled_letters_freq);
+    const vec_t RequiredFreq = ops::load(context->included_letters_freq);
+    const mask_t rack_mask = (mask_t) context->jumbled_letter_mask;
+    const mask_t any_of_mask = (mask_t) context->any_of_mask;
+    const mask_t any_of_test_mask = (mask_t) context->any_of_test_mask;
+    const vec_t Values = ops::load((uint8_t*) context->tile_values);
+    const uint32_t blank_count = context->blank_count;
+    const uint8_t ranked = Heap->capacity != 0;
+    const uint8_t rank_by_score = context->rank_by_score;
+    uint64_t words_found = 0;
+
+    for (uint32_t c = first; c < last; ++c) {
+        uint8_t* freq = Classes->freqs + (size_t) c * FreqSize;
+        uint8_t found;
+
+        if (Repeat && !Required) {
+            mask_t over_mask = (mask_t) Classes->masks[c] & ~rack_mask;
+            found = Blanks ? (ops::popcount(over_mask) <= blank_count) : !over_mask;
+        } else {
+            vec_t Freq = ops::load(freq);
+            vec_t Over = ops::subs(Freq, Rack);
+            mask_t over_mask = ops::nonzero(Over);
+
+            if (Required) {
+                mask_t missing_mask = ops::nonzero(ops::subs(RequiredFreq, Freq));
+                uint32_t uncovered = get_uncovered_count<FreqSize>(Over, over_mask, any_of_mask, Repeat);
+
+                found = !missing_mask & (uncovered <= blank_count) & !!((mask_t) Classes->masks[c] & any_of_test_mask);
+            } else if (Blanks) {
+                found = ops::sum(Over) <= blank_count;
+            } else {
+                found = !over_mask;
+            }
+        }
+
+        if (!found)
+            continue;
+
+        vec_t Freq = ops::load(freq);
+        int word_length = (int) ops::sum(Freq);
+        uint32_t rank = rank_by_score ? ops::score(Freq, Rack, Values) : (uint32_t) word_length;
+        uint32_t* member = Classes->members + Classes->first_members[c];
+        uint32_t* last_member = Classes->members + Classes->first_members[c + 1];
+
+        words_found += (uint64_t) (last_member - member);
+
+        for (; member != last_member; ++member) {
+            if (ranked)
+                add_word_to_heap(Heap, Heap->base + *member, word_length, rank);
+            else
+                add_word_to_list(Heap, Heap->base + *member);
+        }
+    }
+
+    return words_found;
+}
+
+#define CLASS_KERNELS_FOR_WIDTH(FreqSize)                                                                                       \
+    { { { scan_word_classes<FreqSize, false, false, false>, scan_word_classes<FreqSize, false, false, true> },                  \
+        { scan_word_classes<FreqSize, false, true, false>,  scan_word_classes<FreqSize, false, true, true> } },                 \
+      { { scan_word_classes<FreqSize, true, false, false>,  scan_word_classes<FreqSize, true, false, true> },                   \
+        { scan_word_classes<FreqSize, true, true, false>,   scan_word_classes<FreqSize, true, true, true> } } }
+
+static index_kernel* class_kernels[2][2][2][2] = {
+    CLASS_KERNELS_FOR_WIDTH(32),
+    CLASS_KERNELS_FOR_WIDTH(64),
+};
+
+/*
+ * Not a search, but run through the pool like one so the leave table
+ * build uses every core: each word of up to LEAVE_RACK_TILES tiles is
+ * credited to every leave it can be played from.
+ */
+static uint64_t
+build_leaves_kernel(char* ptr, char* end, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    uint64_t words_seen = 0;
+    uint8_t codes[LEAVE_RACK_TILES];
+
+    while (ptr < end) {
+        while (ptr < end && is_word_delim(*ptr))
+            ++ptr;
+
+        char* wordstart = ptr;
+
+        while (ptr < end && !is_word_delim(*ptr))
+            ++ptr;
+
+        uint32_t length = (uint32_t) (ptr - wordstart);
+
+        if (!length || length > LEAVE_RACK_TILES)
+            continue;
+
+        for (uint32_t i = 0; i < length; ++i)
+            codes[i] = (uint8_t) get_letter_index(wordstart[i]);
+
+        add_word_leaves(context->Leaves, codes, length);
+        ++words_seen;
+    }
+
+    return words_seen;
+}
+
+// NOTE: one dictionary range or shard of the build's current stage per
+// index, see word_set_build
+static uint64_t
+build_word_set_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    for (uint32_t i = first; i < last; ++i)
+        run_word_set_stage(context->WordSet, i);
+
+    return 0;
+}
+
+// NOTE: the same for hook_table_build
+static uint64_t
+build_hook_table_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    for (uint32_t i = first; i < last; ++i)
+        run_hook_stage(context->HookBuild, i);
+
+    return 0;
+}
+
+// NOTE: and for word_class_build
+static uint64_t
+build_word_classes_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    for (uint32_t i = first; i < last; ++i)
+        run_word_class_stage(context->ClassBuild, i);
+
+    return 0;
+}
+
+// NOTE: and for rack_table_build
+static uint64_t
+build_rack_table_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    for (uint32_t i = first; i < last; ++i)
+        run_rack_stage(context->RackBuild, i);
+
+    return 0;
+}
+
+/*
+ * Draws the rest of each rack with a partial Fisher-Yates shuffle of the
+ * order's copy of the bag. The copy is never put back in order: any
+ * arrangement of the bag gives the same chances.
+ */
+static uint64_t
+simulate_racks_kernel(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    simulation* Simulation = context->Simulation;
+    simulation_counts* Counts = Simulation->Counts + (Heap - Queue->Heaps);
+    uint8_t tiles[SIMULATION_MAX_BAG_TILES];
+    uint8_t rack[RACK_MAX_TILES];
+    uint32_t draw_count = Simulation->rack_size - Simulation->leave_count;
+    uint64_t sample_count = 0;
+
+    memcpy(rack, Simulation->leave, Simulation->leave_count);
+
+    for (uint32_t order = first; order < last; ++order) {
+        uint64_t sample = (uint64_t) order * SIMULATION_ORDER_SAMPLES;
+        uint64_t end = sample + SIMULATION_ORDER_SAMPLES;
+        uint64_t state = Simulation->seed ^ ((uint64_t) order * 0xD1B54A32D192ED03ull);
+
+        if (end > Simulation->sample_count)
+            end = Simulation->sample_count;
+
+        memcpy(tiles, Simulation->tiles, Simulation->tile_count);
+
+        for (; sample < end; ++sample) {
+            rack_result Result;
+
+            for (uint32_t i = 0; i < draw_count; ++i) {
+                // NOTE: multiply-shift range reduction instead of a modulo
+                uint32_t range = Simulation->tile_count - i;
+                uint32_t j = i + (uint32_t) (((get_next_random(&state) & 0xFFFFFFFF) * range) >> 32);
+                uint8_t tile = tiles[j];
+
+                tiles[j] = tiles[i];
+                tiles[i] = tile;
+                rack[Simulation->leave_count + i] = tile;
+            }
+
+            evaluate_rack(Simulation->Table, rack, Simulation->rack_size, &Result);
+
+            uint32_t bucket = (Result.best_score < SCH_SIMULATION_SCORE_BUCKETS) ? Result.best_score : SCH_SIMULATION_SCORE_BUCKETS - 1;
+
+            ++Counts->length_histogram[Result.best_length];
+            ++Counts->score_histogram[bucket];
+            Counts->score_sum += Result.best_score;
+        }
+
+        sample_count += end - (uint64_t) order * SIMULATION_ORDER_SAMPLES;
+    }
+
+    return sample_count;
+}
+
+/*
+ * Multiset hash: the sum of one random key per tile. What a rack has
+ * left after a word hashes to the rack's signature minus the word's, so
+ * the join never rebuilds a histogram to probe for a partner.
+ */
+static uint64_t
+get_anagram_signature(anagram_index* Index, uint8_t* freq)
+{
+    uint64_t signature = 0;
+
+    for (uint32_t i = 0; i < MAX_ALPHABET_SIZE; ++i)
+        signature += freq[i] * Index->keys[i];
+
+    return signature;
+}
+
+static int
+find_anagram_class(anagram_index* Index, uint64_t signature, uint8_t* freq, uint32_t first_class, uint32_t* class_index)
+{
+    for (uint32_t slot = (uint32_t) signature & Index->slot_mask; Index->slots[slot]; slot = (slot + 1) & Index->slot_mask) {
+        uint32_t c = Index->slots[slot] - 1;
+        anagram_class* Class = Index->classes + c;
+
+        // NOTE: signatures can collide, the histogram decides
+        if (Class->signature == signature && !memcmp(Class->freq, freq, MAX_ALPHABET_SIZE)) {
+            *class_index = c;
+            return c >= first_class;
+        }
+    }
+
+    return 0;
+}
+
+static void
+flush_anagram_output(anagram_index* Index, anagram_output* Output)
+{
+    if (!Output->count)
+        return;
+
+    AcquireSRWLockExclusive(&Index->OutputLock);
+
+    for (uint32_t i = 0; i < Output->count; ++i)
+        Index->output(Index->output_user, Output->words[i], Output->word_counts[i]);
+
+    ReleaseSRWLockExclusive(&Index->OutputLock);
+    Output->count = 0;
+}
+
+/*
+ * Expands one combination of classes into its word combinations. A class
+ * taken m times in a row picks its words in non-decreasing order, which
+ * gives C(words + m - 1, m) combinations and every multiset of words
+ * exactly once. Without an output only the count is worked out.
+ */
+static uint64_t
+emit_anagrams(anagram_index* Index, anagram_output* Output, uint32_t* class_indices, uint32_t count)
+{
+    anagram_class* Classes[SCH_MAX_ANAGRAM_WORDS];
+    uint32_t picks[SCH_MAX_ANAGRAM_WORDS];
+    uint64_t anagram_count = 1;
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Classes[i] = Index->classes + class_indices[i];
+        picks[i] = 0;
+        run = (i && class_indices[i] == class_indices[i - 1]) ? run + 1 : 1;
+        anagram_count = anagram_count * (Classes[i]->word_count + run - 1) / run;
+    }
+
+    if (!Index->output)
+        return anagram_count;
+
+    for (;;) {
+        uint32_t slot = Output->count++;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            word_t* Word = Index->words + Classes[i]->first_word + picks[i];
+            sch_word* Out = Output->words[slot] + i;
+
+            Out->text = Word->word;
+            Out->length = Word->word_length;
+            Out->rank = 0;
+            Out->id = (uint32_t) (Word->word - Index->contents);
+        }
+
+        Output->word_counts[slot] = count;
+
+        if (Output->count == ANAGRAM_OUTPUT_SIZE)
+            flush_anagram_output(Index, Output);
+
+        // NOTE: odometer, last word fastest
+        int i = (int) count - 1;
+
+        while (i >= 0 && picks[i] + 1 == Classes[i]->word_count)
+            --i;
+
+        if (i < 0)
+            break;
+
+        ++picks[i];
+
+        for (uint32_t j = (uint32_t) i + 1; j < count; ++j)
+            picks[j] = (class_indices[j] == class_indices[j - 1]) ? picks[j - 1] : 0;
+    }
+
+    return anagram_count;
+}
+
+/*
+ * Hash join over the classes, shortest first. The pair partner of class
+ * A is the class holding exactly what A leaves of the rack, one probe by
+ * signature; for triples every class B from A on that fits in A's rest
+ * is joined the same way. Combinations are taken in non-decreasing class
+ * order, so each is found once and both loops stop at the first class
+ * too long to leave room for the ones after it.
+ */
+template <int FreqSize>
+static uint64_t
+join_anagram_classes(uint32_t first, uint32_t last, ctx* context, work_queue* Queue, word_heap* Heap)
+{
+    typedef letter_ops<FreqSize> ops;
+    typedef typename ops::vec_t vec_t;
+
+    anagram_index* Index = context->Anagrams;
+    anagram_output* Output = Index->Outputs + (Heap - Queue->Heaps);
+    anagram_class* Classes = Index->classes;
+    const vec_t Rack = ops::load(context->jumbled_letters_freq);
+    const uint32_t rack_size = Index->rack_size;
+    uint64_t anagram_count = 0;
+    uint64_t class_combination_count = 0;
+    alignas(64) uint8_t rest_freq[MAX_ALPHABET_SIZE] = {};
+
+    for (uint32_t a = first; a < last; ++a) {
+        anagram_class* A = Classes + a;
+        vec_t Rest = ops::subs(Rack, ops::load(A->freq));
+        uint64_t rest_signature = Index->rack_signature - A->signature;
+        uint32_t combination[SCH_MAX_ANAGRAM_WORDS] = { a };
+
+        ops::store(rest_freq, Rest);
+
+        if (find_anagram_class(Index, rest_signature, rest_freq, a, combination + 1)) {
+            anagram_count += emit_anagrams(Index, Output, combination, 2);
+            ++class_combination_count;
+        }
+
+        if (Index->max_words < 3)
+            continue;
+
+        for (uint32_t b = a; b < Index->class_count; ++b) {
+            anagram_class* B = Classes + b;
+
+            if (A->length + 2 * B->length > rack_size)
+                break;
+
+            vec_t Freq = ops::load(B->freq);
+
+            if (ops::nonzero(ops::subs(Freq, Rest)))
+                continue;
+
+            ops::store(rest_freq, ops::subs(Rest, Freq));
+            combination[1] = b;
+
+            if (find_anagram_class(Index, rest_signature - B->signature, rest_freq, b, combination + 2)) {
+                anagram_count += emit_anagrams(Index, Output, combination, 3);
+                ++class_combination_count;
+            }
+        }
+    }
+
+    locked_add_and_return_previous_value(&Index->ClassCombinationCount, class_combination_count);
+
+    return anagram_count;
+}
+
+/*
+ * Derives everything the kernels test against from the query strings and
+ * picks the kernel for this alphabet and mode. Fails if a letter is not
+ * in the alphabet.
+ */
+static int
+prepare_query(ctx* context)
+{
+    alphabet* Alphabet = context->Alphabet;
+
+    memset(context->jumbled_letters_freq, 0, sizeof(context->jumbled_letters_freq));
+    memset(context->included_letters_freq, 0, sizeof(context->included_letters_freq));
+    context->any_of_mask = 0;
+    context->blank_count = 0;
+
+    if (!add_letters_to_freq(Alphabet, context->jumbled_letters_freq, context->jumbled_letters, context->allow_repeated, &context->blank_count))
+        return 0;
+
+    if (context->included_letters) {
+        if (!add_letters_to_freq(Alphabet, context->included_letters_freq, context->included_letters, 0, NULL))
+            return 0;
+
+        add_letters_to_freq(Alphabet, context->jumbled_letters_freq, context->included_letters, context->allow_repeated, NULL);
+    }
+
+    if (context->any_of_letters && !get_word_mask(Alphabet, context->any_of_letters, &context->any_of_mask))
+        return 0;
+
+    context->any_of_test_mask = context->any_of_mask ? context->any_of_mask : ~(uint64_t) 0;
+    context->jumbled_letter_mask = 0;
+    memset(context->tile_values, 0, sizeof(context->tile_values));
+
+    for (uint32_t i = 0; i < Alphabet->size; ++i) {
+        context->jumbled_letter_mask |= (uint64_t) (context->jumbled_letters_freq[i] != 0) << i;
+        context->tile_values[i] = (int8_t) Alphabet->values[i];
+    }
+
+    uint8_t wide = Alphabet->size > 32;
+    uint8_t required = context->included_letters || context->any_of_letters;
+    context->kernel = scan_kernels[wide][!!context->allow_repeated][required][context->blank_count != 0];
+    context->class_kernel = class_kernels[wide][!!context->allow_repeated][required][context->blank_count != 0];
+
+    return 1;
+}
+
+static uint32_t
+process_words(work_queue* Queue, char* fileContents, word_heap* Heap)
+{
+    uint64_t WorkOrderIndex = locked_add_and_return_previous_value(&Queue->NextWorkOrderIndex, 1);
+
+    if (WorkOrderIndex >= Queue->WorkOrderCount)
+        return FALSE;
+
+    work_order* Order = Queue->WorkOrders + WorkOrderIndex;
+    uint32_t startOffset = Order->startOffset;
+    uint32_t endOffset = Order->endOffset;
+    ctx* context = Order->context;
+
+    Heap->base = fileContents;
+
+    // NOTE: range kernels walk an index built for the query, so the
+    // order's bounds are indices into it rather than dictionary offsets
+    uint64_t words_found = context->range_kernel
+        ? context->range_kernel(startOffset, endOffset, context, Queue, Heap)
+        : context->kernel(fileContents + startOffset, fileContents + endOffset, context, Queue, Heap);
+
+    locked_add_and_return_previous_value(&Queue->TotalWordsFound, words_found);
+
+    if (locked_add_and_return_previous_value(&Queue->Retired, 1) + 1 == Queue->WorkOrderCount)
+        WakeByAddressAll((void*) &Queue->Retired);
+
+    return TRUE;
+}
+
+static uint64_t
+get_wall_clock(void)
+{
+    LARGE_INTEGER Result;
+    QueryPerformanceCounter(&Result);
+
+    return Result.QuadPart;
+}
+
+static double
+get_ms_elapsed(uint64_t start, uint64_t end)
+{
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+
+    return 1000.0 * (double) (end - start) / (double) Frequency.QuadPart;
+}
+
+static void
+get_numa_topology(numa_topology* Topology)
+{
+    ULONG highest_node = 0;
+
+    if (!GetNumaHighestNodeNumber(&highest_node))
+        highest_node = 0;
+
+    for (ULONG node = 0; node <= highest_node && Topology->node_count < MAX_NUMA_NODES; ++node) {
+        GROUP_AFFINITY affinity = {};
+
+        if (!GetNumaNodeProcessorMaskEx((USHORT) node, &affinity) || !affinity.Mask)
+            continue;
+
+        numa_node* Node = Topology->nodes + Topology->node_count++;
+        Node->node_number = (USHORT) node;
+        Node->affinity = affinity;
+        Node->processor_count = (uint32_t) __popcnt64(affinity.Mask);
+    }
+
+    // NOTE: no usable topology, behave as one unpinned node
+    if (!Topology->node_count) {
+        numa_node* Node = Topology->nodes + Topology->node_count++;
+        Node->processor_count = get_cpu_count();
+    }
+}
+
+/*
+ * Large pages need SeLockMemoryPrivilege ("Lock pages in memory") granted
+ * to the user; without it every allocation quietly stays on small pages.
+ * Each engine keeps its own stats, so one opened with large pages does
+ * not turn them on for the next.
+ */
+static void
+init_page_stats(page_stats* Pages, int use_large_pages)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    Pages->small_page_size = Info.dwPageSize;
+
+    if (!use_large_pages)
+        return;
+
+    HANDLE token;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return;
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    if (LookupPrivilegeValueA(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+        GetLastError() == ERROR_SUCCESS) {
+        Pages->large_page_size = GetLargePageMinimum();
+    }
+
+    CloseHandle(token);
+}
+
+/*
+ * Allocation for the dictionary and everything indexed off it. Tries
+ * large pages first, since scans and random lookups across a few MB
+ * otherwise walk ~1,000 small-page TLB entries, and falls back to small
+ * pages if the large allocation fails (fragmented physical memory).
+ * large_pages tells free_pages which kind it got.
+ */
+static char*
+alloc_pages(page_stats* Pages, size_t size, DWORD node_number, uint8_t* large_pages)
+{
+    *large_pages = 0;
+
+    if (Pages->large_page_size) {
+        size_t large_size = (size + Pages->large_page_size - 1) & ~(Pages->large_page_size - 1);
+        char* Result = (char*) VirtualAllocExNuma(GetCurrentProcess(), NULL, large_size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE, node_number);
+
+        if (Result) {
+            Pages->large_page_count += large_size / Pages->large_page_size;
+            *large_pages = 1;
+            return Result;
+        }
+    }
+
+    char* Result = (char*) VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, node_number);
+
+    if (Result)
+        Pages->small_page_count += (size + Pages->small_page_size - 1) / Pages->small_page_size;
+
+    return Result;
+}
+
+/*
+ * Frees what alloc_pages or alloc_interleaved handed out, with the size
+ * it was asked for, and takes its pages back off the counts.
+ */
+static void
+free_pages(page_stats* Pages, char* memory, size_t size, uint8_t large_pages)
+{
+    VirtualFree(memory, 0, MEM_RELEASE);
+
+    if (large_pages)
+        Pages->large_page_count -= (size + Pages->large_page_size - 1) / Pages->large_page_size;
+    else
+        Pages->small_page_count -= (size + Pages->small_page_size - 1) / Pages->small_page_size;
+}
+
+static uint64_t
+get_page_fault_count(void)
+{
+    PROCESS_MEMORY_COUNTERS Counters = {};
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)))
+        return 0;
+
+    return Counters.PageFaultCount;
+}
+
+static char*
+alloc_interleaved(page_stats* Pages, size_t size, numa_topology* Topology)
+{
+    // NOTE: large pages must be reserved and committed in one call, so
+    // node-striped commits always use small pages
+    char* Result = (char*) VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Result)
+        return NULL;
+
+    for (size_t offset = 0, stripe = 0; offset < size; offset += NUMA_INTERLEAVE_STRIPE, ++stripe) {
+        size_t stripe_size = (size - offset < NUMA_INTERLEAVE_STRIPE) ? size - offset : NUMA_INTERLEAVE_STRIPE;
+        numa_node* Node = Topology->nodes + (stripe % Topology->node_count);
+
+        if (!VirtualAllocExNuma(GetCurrentProcess(), Result + offset, stripe_size, MEM_COMMIT, PAGE_READWRITE, Node->node_number)) {
+            VirtualFree(Result, 0, MEM_RELEASE);
+            return NULL;
+        }
+    }
+
+    // NOTE: counted only once every stripe is committed
+    Pages->small_page_count += (size + Pages->small_page_size - 1) / Pages->small_page_size;
+
+    return Result;
+}
+
+static void
+release_dictionary_layout(numa_topology* Topology, page_stats* Pages, uint32_t fileSize)
+{
+    char* home_contents = Topology->nodes[0].fileContents;
+
+    for (uint32_t i = 1; i < Topology->node_count; ++i) {
+        numa_node* Node = Topology->nodes + i;
+
+        if (Node->fileContents != home_contents && Node->fileContents != Topology->interleaved_contents)
+            free_pages(Pages, Node->fileContents, fileSize, Node->large_pages);
+
+        Node->fileContents = home_contents;
+        Node->large_pages = 0;
+    }
+
+    if (Topology->interleaved_contents)
+        free_pages(Pages, Topology->interleaved_contents, fileSize, 0);
+
+    Topology->interleaved_contents = NULL;
+}
+
+/*
+ * Points every node at the dictionary copy it should scan. The file is
+ * always loaded into node 0's memory first, so single-node layout is that
+ * buffer shared by everyone. Falls back to single-node if an allocation
+ * fails.
+ */
+static dictionary_layout
+apply_dictionary_layout(numa_topology* Topology, page_stats* Pages, char* home_contents, uint32_t fileSize, dictionary_layout layout)
+{
+    release_dictionary_layout(Topology, Pages, fileSize);
+    Topology->nodes[0].fileContents = home_contents;
+
+    if (layout == LAYOUT_DEFAULT)
+        layout = (Topology->node_count > 1) ? LAYOUT_REPLICATED : LAYOUT_SINGLE_NODE;
+
+    for (uint32_t i = 1; i < Topology->node_count; ++i)
+        Topology->nodes[i].fileContents = home_contents;
+
+    if (layout == LAYOUT_INTERLEAVED) {
+        char* interleaved = alloc_interleaved(Pages, fileSize, Topology);
+
+        if (!interleaved)
+            return LAYOUT_SINGLE_NODE;
+
+        memcpy(interleaved, home_contents, fileSize);
+        Topology->interleaved_contents = interleaved;
+
+        for (uint32_t i = 0; i < Topology->node_count; ++i)
+            Topology->nodes[i].fileContents = interleaved;
+    } else if (layout == LAYOUT_REPLICATED) {
+        for (uint32_t i = 1; i < Topology->node_count; ++i) {
+            numa_node* Node = Topology->nodes + i;
+            char* replica = alloc_pages(Pages, fileSize, Node->node_number, &Node->large_pages);
+
+            if (!replica) {
+                release_dictionary_layout(Topology, Pages, fileSize);
+                return LAYOUT_SINGLE_NODE;
+            }
+
+            memcpy(replica, home_contents, fileSize);
+            Node->fileContents = replica;
+        }
+    }
+
+    return layout;
+}
+
+/*
+ * One worker per processor, each pinned to that processor so it stays
+ * next to its node's copy of the dictionary.
+ */
+static uint32_t
+create_workers(numa_topology* Topology, worker_pool* Pool, worker_thread* Workers)
+{
+    uint32_t worker_count = 0;
+
+    for (uint32_t i = 0; i < Topology->node_count; ++i) {
+        numa_node* Node = Topology->nodes + i;
+        KAFFINITY remaining = Node->affinity.Mask;
+
+        for (uint32_t p = 0; p < Node->processor_count; ++p) {
+            worker_thread* Worker = Workers + worker_count;
+            Worker->Pool = Pool;
+            Worker->index = worker_count++;
+            Worker->affinity = Node->affinity;
+
+            if (remaining) {
+                KAFFINITY processor = remaining & (~remaining + 1);
+                Worker->affinity.Mask = processor;
+                remaining &= ~processor;
+            }
+        }
+    }
+
+    return worker_count;
+}
+
+static void
+assign_worker_contents(numa_topology* Topology, worker_thread* Workers)
+{
+    worker_thread* Worker = Workers;
+
+    for (uint32_t i = 0; i < Topology->node_count; ++i) {
+        numa_node* Node = Topology->nodes + i;
+
+        for (uint32_t p = 0; p < Node->processor_count; ++p)
+            (Worker++)->fileContents = Node->fileContents;
+    }
+}
+
+/*
+ * Parked workers sleep on Pool->Generation. A short spin first catches
+ * back-to-back queries without a kernel round trip; after that
+ * WaitOnAddress parks the thread until dispatch_query bumps the
+ * generation and wakes everyone with a single WakeByAddressAll.
+ */
+static LONG
+wait_for_generation(worker_pool* Pool, LONG seen_generation)
+{
+    for (uint32_t spin = 0; spin < POOL_SPIN_COUNT; ++spin) {
+        if (Pool->Generation != seen_generation)
+            return Pool->Generation;
+
+        YieldProcessor();
+    }
+
+    while (Pool->Generation == seen_generation)
+        WaitOnAddress(&Pool->Generation, &seen_generation, sizeof(seen_generation), INFINITE);
+
+    return Pool->Generation;
+}
+
+static void
+leave_worker_pool_queue(worker_pool* Pool)
+{
+    if (!InterlockedDecrement(&Pool->BusyWorkerCount))
+        WakeByAddressAll((void*) &Pool->BusyWorkerCount);
+}
+
+DWORD WINAPI
+thread_func(LPVOID lpParam)
+{
+    worker_thread* Worker = (worker_thread*) lpParam;
+    worker_pool* Pool = Worker->Pool;
+    LONG seen_generation = 0;
+
+    if (Worker->affinity.Mask)
+        SetThreadGroupAffinity(GetCurrentThread(), &Worker->affinity, NULL);
+
+    for (;;) {
+        seen_generation = wait_for_generation(Pool, seen_generation);
+
+        if (Pool->Shutdown)
+            break;
+
+        if (Worker->index >= Pool->ActiveWorkerCount)
+            continue;
+
+        // NOTE: counted in before looking at the queue, so the query cannot
+        // end and free it in between; a worker that wakes after its query
+        // ended finds no queue or a newer generation and goes back to sleep
+        InterlockedIncrement(&Pool->BusyWorkerCount);
+
+        work_queue* Queue = Pool->Queue;
+
+        // NOTE: the queue may already be the next query's, stored before
+        // its generation is bumped. Its worker count was stored before the
+        // queue, so checking the count again keeps out workers it did not
+        // ask for
+        if (Queue && Pool->Generation == seen_generation && Worker->index < Pool->ActiveWorkerCount)
+            while (process_words(Queue, Worker->fileContents, Queue->Heaps + Worker->index)) {}
+
+        leave_worker_pool_queue(Pool);
+    }
+
+    return 0;
+}
+
+static void
+start_worker_pool(worker_pool* Pool, worker_thread* Workers, uint32_t worker_count)
+{
+    Pool->Workers = Workers;
+    Pool->worker_count = worker_count;
+    Pool->Threads = (HANDLE*) VirtualAlloc(NULL, worker_count * sizeof(HANDLE), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    for (uint32_t thread_index = 0; thread_index < worker_count; ++thread_index) {
+        DWORD thread_id;
+        Pool->Threads[thread_index] = CreateThread(NULL, 0, thread_func, Workers + thread_index, 0, &thread_id);
+    }
+}
+
+static void
+stop_worker_pool(worker_pool* Pool)
+{
+    Pool->Shutdown = 1;
+    InterlockedIncrement(&Pool->Generation);
+    WakeByAddressAll((void*) &Pool->Generation);
+
+    for (uint32_t thread_index = 0; thread_index < Pool->worker_count; ++thread_index) {
+        WaitForSingleObject(Pool->Threads[thread_index], INFINITE);
+        CloseHandle(Pool->Threads[thread_index]);
+    }
+
+    VirtualFree(Pool->Threads, 0, MEM_RELEASE);
+    Pool->Threads = NULL;
+}
+
+/*
+ * Match sinks for a query: every worker and the calling thread keep
+ * their own, so matching never contends. With top_count they are heaps
+ * that merge_word_heaps folds together once the query is done, with
+ * capacity 0 they are ID lists that collect_results joins. They belong
+ * to the query, so concurrent queries never share one.
+ */
+static int
+create_word_heaps(work_queue* Queue, uint32_t worker_count, uint32_t capacity)
+{
+    uint32_t heap_count = worker_count + 1;
+    size_t heaps_size = heap_count * sizeof(word_heap);
+
+    Queue->Heaps = (word_heap*) VirtualAlloc(NULL, heaps_size + (size_t) heap_count * capacity * sizeof(ranked_word), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Queue->Heaps)
+        return 0;
+
+    Queue->HeapCount = heap_count;
+    ranked_word* entries = (ranked_word*) ((char*) Queue->Heaps + heaps_size);
+
+    for (uint32_t i = 0; i < heap_count; ++i) {
+        Queue->Heaps[i].entries = entries + (size_t) i * capacity;
+        Queue->Heaps[i].capacity = capacity;
+    }
+
+    return 1;
+}
+
+// NOTE: ID lists keep their pages, so repeated runs of one query do not
+// allocate again
+static void
+reset_word_heaps(work_queue* Queue)
+{
+    for (uint32_t i = 0; i < Queue->HeapCount; ++i) {
+        Queue->Heaps[i].count = 0;
+        Queue->Heaps[i].id_count = 0;
+        Queue->Heaps[i].out_of_memory = 0;
+    }
+}
+
+static void
+release_word_heaps(work_queue* Queue)
+{
+    for (uint32_t i = 0; i < Queue->HeapCount; ++i) {
+        if (Queue->Heaps[i].ids)
+            VirtualFree(Queue->Heaps[i].ids, 0, MEM_RELEASE);
+    }
+
+    VirtualFree(Queue->Heaps, 0, MEM_RELEASE);
+}
+
+static word_heap*
+get_caller_heap(work_queue* Queue)
+{
+    return Queue->Heaps + Queue->HeapCount - 1;
+}
+
+/*
+ * Pushes every worker's survivors into the calling thread's heap and
+ * sorts what is left best first. Words are compared in contents, which
+ * may be any copy of the dictionary.
+ */
+static word_heap*
+merge_word_heaps(work_queue* Queue, const char* contents)
+{
+    word_heap* Result = get_caller_heap(Queue);
+
+    for (uint32_t i = 0; i + 1 < Queue->HeapCount; ++i) {
+        word_heap* Heap = Queue->Heaps + i;
+
+        for (uint32_t j = 0; j < Heap->count; ++j)
+            push_ranked_word(Result, contents, Heap->entries[j]);
+    }
+
+    sort_word_heap(Result, contents);
+
+    return Result;
+}
+
+static void
+reset_work_queue(work_queue* Queue)
+{
+    Queue->TotalWordsFound = 0;
+    Queue->Retired = 0;
+    Queue->Pool = NULL;
+
+    // NOTE: wait_for_query saw every worker leave the previous run, so
+    // nothing else can claim an order once this is visible
+    InterlockedExchange64((volatile LONG64*) &Queue->NextWorkOrderIndex, 0);
+}
+
+static void
+dispatch_query(worker_pool* Pool, work_queue* Queue, uint32_t active_workers)
+{
+    reset_word_heaps(Queue);
+    reset_work_queue(Queue);
+
+    // NOTE: single-threaded queries never touch the pool, so they can run
+    // while another query owns it
+    if (!active_workers)
+        return;
+
+    // NOTE: the worker count goes out before the queue, see thread_func
+    Queue->Pool = Pool;
+    Pool->ActiveWorkerCount = active_workers;
+    Pool->Queue = Queue;
+    InterlockedIncrement(&Pool->Generation);
+    WakeByAddressAll((void*) &Pool->Generation);
+}
+
+/*
+ * Returns once every order is retired and, for pooled queries, every
+ * worker has left the queue: the last one out may still be claiming an
+ * order past the end, and the queue usually lives on the caller's stack.
+ * Pool->Queue is cleared first, so no worker can join after the count
+ * reaches 0.
+ */
+static void
+wait_for_query(work_queue* Queue)
+{
+    for (uint32_t spin = 0; Queue->Retired < Queue->WorkOrderCount; ++spin) {
+        if (spin < POOL_SPIN_COUNT) {
+            YieldProcessor();
+            continue;
+        }
+
+        uint64_t retired = Queue->Retired;
+
+        if (retired < Queue->WorkOrderCount)
+            WaitOnAddress((void*) &Queue->Retired, &retired, sizeof(retired), INFINITE);
+    }
+
+    worker_pool* Pool = Queue->Pool;
+
+    if (!Pool)
+        return;
+
+    InterlockedExchangePointer((void* volatile*) &Pool->Queue, NULL);
+
+    for (uint32_t spin = 0; Pool->BusyWorkerCount; ++spin) {
+        if (spin < POOL_SPIN_COUNT) {
+            YieldProcessor();
+            continue;
+        }
+
+        LONG busy = Pool->BusyWorkerCount;
+
+        if (busy)
+            WaitOnAddress((void*) &Pool->BusyWorkerCount, &busy, sizeof(busy), INFINITE);
+    }
+
+    Queue->Pool = NULL;
+}
+
+static void
+run_query(worker_pool* Pool, work_queue* Queue, char* fileContents, uint32_t active_workers)
+{
+    dispatch_query(Pool, Queue, active_workers);
+
+    while (process_words(Queue, fileContents, get_caller_heap(Queue))) {
+        if (Queue->progress)
+            Queue->progress(Queue->progress_user, 100 * (uint32_t) Queue->Retired / Queue->WorkOrderCount);
+    }
+
+    wait_for_query(Queue);
+}
+
+DWORD WINAPI
+one_shot_thread_func(LPVOID lpParam)
+{
+    worker_thread* Worker = (worker_thread*) lpParam;
+
+    if (Worker->affinity.Mask)
+        SetThreadGroupAffinity(GetCurrentThread(), &Worker->affinity, NULL);
+
+    worker_pool* Pool = Worker->Pool;
+    InterlockedIncrement(&Pool->BusyWorkerCount);
+
+    work_queue* Queue = Pool->Queue;
+
+    if (Queue)
+        while (process_words(Queue, Worker->fileContents, Queue->Heaps + Worker->index)) {}
+
+    leave_worker_pool_queue(Pool);
+
+    return 0;
+}
+
+/*
+ * The old per-query model, kept only so -b can show what the pool saves:
+ * a fresh thread per processor whose handle is dropped straight away.
+ */
+static void
+run_query_with_new_threads(worker_pool* Pool, work_queue* Queue, char* fileContents)
+{
+    reset_word_heaps(Queue);
+    reset_work_queue(Queue);
+    Queue->Pool = Pool;
+    Pool->Queue = Queue;
+
+    for (uint32_t thread_index = 0; thread_index < Pool->worker_count; ++thread_index) {
+        DWORD thread_id;
+        HANDLE wt = CreateThread(NULL, 0, one_shot_thread_func, Pool->Workers + thread_index, 0, &thread_id);
+        CloseHandle(wt);
+    }
+
+    while (process_words(Queue, fileContents, get_caller_heap(Queue))) {}
+
+    wait_for_query(Queue);
+}
+
+/*
+ * Times a query that is all overhead: one tiny order per worker, so what
+ * is left is waking the workers and collecting them again.
+ */
+static void
+run_dispatch_benchmark(worker_pool* Pool, work_queue* Queue, char* fileContents, uint32_t fileSize, uint32_t iterations)
+{
+    work_queue Tiny = {};
+    Tiny.Heaps = Queue->Heaps;
+    Tiny.HeapCount = Queue->HeapCount;
+    Tiny.WorkOrderCount = Queue->WorkOrderCount;
+    Tiny.WorkOrders = (work_order*) VirtualAlloc(NULL, Tiny.WorkOrderCount * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    for (uint32_t i = 0; i < Tiny.WorkOrderCount; ++i) {
+        work_order* order = Tiny.WorkOrders + i;
+        *order = Queue->WorkOrders[i];
+
+        if (order->endOffset - order->startOffset > DISPATCH_BENCHMARK_ORDER_SIZE) {
+            order->endOffset = order->startOffset + DISPATCH_BENCHMARK_ORDER_SIZE;
+
+            while (order->endOffset < fileSize && fileContents[order->endOffset] != '\n')
+                ++order->endOffset;
+        }
+    }
+
+    double spawn_ms = 0.0;
+    double pool_ms = 0.0;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t start = get_wall_clock();
+        run_query_with_new_threads(Pool, &Tiny, fileContents);
+        uint64_t middle = get_wall_clock();
+        run_query(Pool, &Tiny, fileContents, Pool->worker_count);
+        uint64_t end = get_wall_clock();
+
+        spawn_ms += get_ms_elapsed(start, middle);
+        pool_ms += get_ms_elapsed(middle, end);
+    }
+
+    printf("** DISPATCH OVERHEAD (%u orders of ~%u bytes)\n", Tiny.WorkOrderCount, DISPATCH_BENCHMARK_ORDER_SIZE);
+    printf("** new threads :  avg %8.1f us\n", 1000.0 * spawn_ms / iterations);
+    printf("** worker pool :  avg %8.1f us\n", 1000.0 * pool_ms / iterations);
+    printf("**********************************************************\n");
+
+    VirtualFree(Tiny.WorkOrders, 0, MEM_RELEASE);
+}
+
+static void
+run_layout_benchmark(worker_pool* Pool, work_queue* Queue, numa_topology* Topology, page_stats* Pages, char* home_contents, uint32_t fileSize, uint32_t iterations)
+{
+    printf("**********************************************************\n");
+    printf("** NUMA LAYOUT BENCHMARK (%u nodes, %u workers, %u runs)\n", Topology->node_count, Pool->worker_count, iterations);
+    printf("**********************************************************\n");
+
+    for (int layout = LAYOUT_SINGLE_NODE; layout < LAYOUT_COUNT; ++layout) {
+        dictionary_layout applied = apply_dictionary_layout(Topology, Pages, home_contents, fileSize, (dictionary_layout) layout);
+        assign_worker_contents(Topology, Pool->Workers);
+
+        if (applied != layout) {
+            printf("** %-12s:  unavailable\n", dictionary_layout_names[layout]);
+            continue;
+        }
+
+        // NOTE: warm up caches and page tables before timing
+        run_query(Pool, Queue, Topology->nodes[0].fileContents, Pool->worker_count);
+
+        double best_ms = 0.0;
+        double total_ms = 0.0;
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            uint64_t start = get_wall_clock();
+            run_query(Pool, Queue, Topology->nodes[0].fileContents, Pool->worker_count);
+            double ms = get_ms_elapsed(start, get_wall_clock());
+
+            total_ms += ms;
+
+            if (!i || ms < best_ms)
+                best_ms = ms;
+        }
+
+        printf("** %-12s:  avg %8.3f ms  best %8.3f ms\n", dictionary_layout_names[layout], total_ms / iterations, best_ms);
+    }
+
+    printf("**********************************************************\n");
+    release_dictionary_layout(Topology, Pages, fileSize);
+    assign_worker_contents(Topology, Pool->Workers);
+}
+
+static double
+time_single_threaded_query(worker_pool* Pool, work_queue* Queue, char* fileContents, uint32_t iterations)
+{
+    double best_ms = 0.0;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t start = get_wall_clock();
+        run_query(Pool, Queue, fileContents, 0);
+        double ms = get_ms_elapsed(start, get_wall_clock());
+
+        if (!i || ms < best_ms)
+            best_ms = ms;
+    }
+
+    return best_ms;
+}
+
+/*
+ * Runs the query's rack through every kernel mode, once with the generic
+ * all-features check and once with the specialized kernel, and with the
+ * class layout also through its kernel on ClassQueue. Modes the query
+ * does not use borrow the rack's first letter for -i and append a
+ * blank. Single-threaded so the numbers are per-core kernel cost.
+ */
+static void
+run_kernel_benchmark(ctx* context, worker_pool* Pool, work_queue* Queue, work_queue* ClassQueue, char* fileContents, uint32_t iterations)
+{
+    ctx Saved = *context;
+    char rack[256];
+    uint8_t rack_codes[256];
+
+    printf("** SCAN KERNELS (single thread, best of %u)\n", iterations);
+
+    if (ClassQueue) {
+        printf("** class layout: %u anagram classes for %u words (%.2f words per class)\n", context->Classes->class_count,
+               context->Classes->word_count, (double) context->Classes->word_count / (double) context->Classes->class_count);
+    }
+
+    for (int mode = 0; mode < 8; ++mode) {
+        uint8_t repeat = (mode >> 2) & 1;
+        uint8_t required = (mode >> 1) & 1;
+        uint8_t blanks = mode & 1;
+        size_t rack_size = 0;
+
+        for (const char* ptr = Saved.jumbled_letters; *ptr && rack_size < sizeof(rack) - 2; ++ptr) {
+            if (*ptr != BLANK_TILE)
+                rack[rack_size++] = *ptr;
+        }
+
+        if (blanks)
+            rack[rack_size++] = BLANK_TILE;
+
+        rack[rack_size] = 0;
+
+        *context = Saved;
+        context->jumbled_letters = rack;
+        context->allow_repeated = repeat;
+
+        if (!required) {
+            context->included_letters = NULL;
+            context->any_of_letters = NULL;
+        } else if (!Saved.included_letters && !Saved.any_of_letters &&
+                   get_tile_codes(context->Alphabet, rack, rack_codes, sizeof(rack_codes)) > 0 &&
+                   rack_codes[0] != BLANK_CODE) {
+            context->included_letters = context->Alphabet->tiles[rack_codes[0]];
+        }
+
+        prepare_query(context);
+        double specialized_ms = time_single_threaded_query(Pool, Queue, fileContents, iterations);
+
+        context->kernel = scan_words_generic;
+        double generic_ms = time_single_threaded_query(Pool, Queue, fileContents, iterations);
+
+        printf("** %-9s %-11s %-9s:  generic %8.3f ms  specialized %8.3f ms  (%.2fx)",
+               repeat ? "repeat" : "no-repeat", required ? "required" : "no-required", blanks ? "blanks" : "no-blanks",
+               generic_ms, specialized_ms, generic_ms / specialized_ms);
+
+        if (ClassQueue) {
+            context->range_kernel = context->class_kernel;
+            double classes_ms = time_single_threaded_query(Pool, ClassQueue, fileContents, iterations);
+            context->range_kernel = NULL;
+
+            printf("  classes %8.3f ms  (%.2fx)", classes_ms, specialized_ms / classes_ms);
+        }
+
+        printf("\n");
+    }
+
+    printf("**********************************************************\n\n");
+    *context = Saved;
+}
+
+/*
+ * Estimates the query cost and picks how many threads to spend on it.
+ * With W threads the query takes roughly work / W + W * wake_cost, which
+ * is smallest at W = sqrt(work / wake_cost): tiny queries stay on the
+ * calling thread, big scans fan out to every processor.
+ */
+static query_plan
+plan_query(ctx* context, uint64_t scan_bytes, uint32_t max_thread_count)
+{
+    query_plan Plan = {};
+    Plan.scan_bytes = scan_bytes;
+    Plan.estimated_words = (uint64_t) ((double) scan_bytes / COST_AVERAGE_WORD_BYTES);
+    uint8_t rack_codes[256];
+    int rack_size = get_tile_codes(context->Alphabet, context->jumbled_letters, rack_codes, sizeof(rack_codes));
+    Plan.rack_size = (rack_size > 0) ? (uint32_t) rack_size : 0;
+    Plan.allow_repeated = context->allow_repeated;
+    Plan.max_thread_count = max_thread_count;
+
+    uint64_t rack_mask = context->jumbled_letter_mask | context->any_of_mask;
+    double match_rate = pow((double) __popcnt64(rack_mask) / context->Alphabet->size, COST_MATCH_EXPONENT);
+
+    if (!context->allow_repeated)
+        match_rate *= COST_NO_REPEAT_MATCH_SCALE;
+
+    Plan.estimated_matches = (uint64_t) (match_rate * (double) Plan.estimated_words);
+    Plan.estimated_ns = (double) scan_bytes * COST_SCAN_NS_PER_BYTE + (double) Plan.estimated_matches * COST_MATCH_NS;
+
+    if (context->thread_count) {
+        Plan.forced = 1;
+        Plan.thread_count = context->thread_count;
+    } else {
+        Plan.thread_count = (uint32_t) sqrt(Plan.estimated_ns / COST_WORKER_WAKE_NS);
+    }
+
+    if (Plan.thread_count < 1)
+        Plan.thread_count = 1;
+
+    if (Plan.thread_count > max_thread_count)
+        Plan.thread_count = max_thread_count;
+
+    return Plan;
+}
+
+static const char*
+get_plan_mode_name(query_plan* Plan)
+{
+    if (Plan->thread_count == 1)
+        return "single-threaded";
+
+    if (Plan->thread_count < Plan->max_thread_count)
+        return "few-threaded";
+
+    return "parallel";
+}
+
+struct sch_engine {
+    alphabet Alphabet;
+    normalize_stats Normalized;
+    numa_topology Topology;
+    page_stats Pages;           // everything alloc_pages and alloc_interleaved handed out
+    char* fileContents;         // node 0's copy, the one the calling thread scans
+    uint32_t fileSize;
+    uint8_t embedded;           // the dictionary is the index linked into the image
+    uint8_t large_pages;        // fileContents came from alloc_pages on large pages
+    uint32_t allocated_size;    // what alloc_pages was asked for, 0 when scanned in the image
+    double load_ms;
+    dictionary_layout requested_layout;
+    dictionary_layout layout;
+    uint32_t core_count;
+    work_order* WorkOrders;     // chunk offsets every query copies
+    uint32_t WorkOrderCount;
+    worker_thread* Workers;
+    worker_pool Pool;
+    SRWLOCK PoolLock;           // held by whichever query fans out to the pool
+    word_set Words;             // built by the first check
+    double words_stage_ms[WORD_SET_STAGE_COUNT];
+    double words_build_ms;
+    uint32_t words_thread_count;
+    SRWLOCK WordsLock;
+    word_classes Classes;       // with use_word_classes only
+    work_order* ClassOrders;    // WorkOrderCount runs of classes
+    double classes_build_ms;
+    rack_table Racks;           // built by the first simulation
+    double racks_build_ms;
+    SRWLOCK RacksLock;
+    hook_table Hooks;           // from the dictionary index, or built by the first cross-check
+    double hooks_build_ms;
+    uint32_t hooks_thread_count;
+    SRWLOCK HooksLock;
+};
+
+struct sch_leave_table {
+    alphabet Alphabet;
+    leave_table Table;
+};
+
+static sch_status
+load_engine_alphabet(alphabet* Alphabet, const sch_options* Options)
+{
+    if (!load_alphabet(Alphabet, Options->alphabet ? Options->alphabet : "english"))
+        return SCH_ERROR_ALPHABET;
+
+    if (Options->tile_values && !set_tile_values(Alphabet, Options->tile_values))
+        return SCH_ERROR_TILE_VALUES;
+
+    return SCH_OK;
+}
+
+/*
+ * Splits the dictionary into one work order per processor, each ending
+ * on a line break.
+ */
+static int
+create_work_orders(sch_engine* Engine)
+{
+    uint32_t core_count = Engine->core_count;
+    uint32_t chunk_size = (Engine->fileSize + core_count - 1) / core_count;
+    uint32_t lastEndOffset = 0;
+
+    Engine->WorkOrders = (work_order*) VirtualAlloc(NULL, core_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Engine->WorkOrders)
+        return 0;
+
+    for (uint32_t i = 0; i < core_count; ++i) {
+        uint32_t startOffset = lastEndOffset;
+        uint32_t endOffset = (i == (core_count - 1)) ? Engine->fileSize : (i + 1) * chunk_size;
+
+        if (endOffset < startOffset)
+            endOffset = startOffset;
+
+        while (endOffset < Engine->fileSize && Engine->fileContents[endOffset] != '\n')
+            ++endOffset;
+
+        work_order* order = Engine->WorkOrders + Engine->WorkOrderCount++;
+        assert(Engine->WorkOrderCount <= core_count);
+
+        lastEndOffset = endOffset;
+        order->endOffset = endOffset;
+        order->startOffset = startOffset;
+    }
+
+    assert(Engine->WorkOrderCount == core_count);
+
+    return 1;
+}
+
+/*
+ * The dictionary index build.bat embeds in sch.exe, see embedded.h. It
+ * is scanned where it lies in the image: no file is opened, nothing is
+ * normalized, and pages are only read in as queries touch them. The
+ * hook table after the words is looked up in place the same way. Image
+ * sections only come on small pages, so with large pages the words are
+ * copied out first. Fails when there is no index or it is for another
+ * alphabet.
+ */
+static int
+load_embedded_dictionary(sch_engine* Engine)
+{
+    HRSRC Resource = FindResourceA(NULL, MAKEINTRESOURCEA(DICTIONARY_INDEX_RESOURCE), RT_RCDATA);
+    HGLOBAL Loaded = Resource ? LoadResource(NULL, Resource) : NULL;
+    dictionary_index_header* Header = Loaded ? (dictionary_index_header*) LockResource(Loaded) : NULL;
+
+    if (!Header || SizeofResource(NULL, Resource) < sizeof(*Header))
+        return 0;
+
+    if (Header->magic != DICTIONARY_INDEX_MAGIC || Header->version != DICTIONARY_INDEX_VERSION ||
+        SizeofResource(NULL, Resource) - sizeof(*Header) < Header->size ||
+        strncmp(Header->alphabet_name, Engine->Alphabet.name, sizeof(Header->alphabet_name))) {
+        return 0;
+    }
+
+    Engine->fileContents = (char*) (Header + 1);
+    Engine->fileSize = Header->size;
+    Engine->Normalized.word_count = Header->word_count;
+    Engine->Normalized.dropped_word_count = Header->dropped_word_count;
+    Engine->embedded = 1;
+
+    if (Engine->Pages.large_page_size) {
+        char* copy = alloc_pages(&Engine->Pages, Header->size, Engine->Topology.nodes[0].node_number, &Engine->large_pages);
+
+        // NOTE: a small-page copy would only cost the time to make it
+        if (copy && Engine->large_pages) {
+            memcpy(copy, Engine->fileContents, Header->size);
+            Engine->fileContents = copy;
+            Engine->allocated_size = Header->size;
+        } else if (copy) {
+            free_pages(&Engine->Pages, copy, Header->size, 0);
+        }
+    }
+
+    if (!Engine->allocated_size)
+        Engine->Pages.small_page_count += (Header->size + Engine->Pages.small_page_size - 1) / Engine->Pages.small_page_size;
+
+    uint64_t hooks_size = get_hook_block_size(Header->hook_pair_count, Header->hook_bucket_count, Header->hook_mask_size);
+
+    // NOTE: without a usable hook block the table is built on first use
+    if (Header->hook_bucket_count && (Header->hook_mask_size == 4 || Header->hook_mask_size == 8) &&
+        Header->hooks_offset >= Header->size && Header->hooks_offset + hooks_size <= SizeofResource(NULL, Resource) - sizeof(*Header)) {
+        place_hook_table(&Engine->Hooks, (const char*) (Header + 1) + Header->hooks_offset, Header->hook_pair_count,
+                         Header->hook_bucket_count, Header->hook_mask_size, Engine->fileContents, Engine->fileSize);
+    }
+
+    return 1;
+}
+
+static sch_status
+load_dictionary_file(sch_engine* Engine, const char* path)
+{
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return SCH_ERROR_OPEN_FILE;
+
+    DWORD fileSize = GetFileSize(hFile, NULL);
+
+    if (fileSize == INVALID_FILE_SIZE) {
+        CloseHandle(hFile);
+        return SCH_ERROR_FILE_SIZE;
+    }
+
+    Engine->fileContents = alloc_pages(&Engine->Pages, fileSize, Engine->Topology.nodes[0].node_number, &Engine->large_pages);
+
+    if (!Engine->fileContents) {
+        CloseHandle(hFile);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    Engine->allocated_size = fileSize;
+
+    DWORD bytesRead;
+
+    if (!ReadFile(hFile, Engine->fileContents, fileSize, &bytesRead, NULL) || bytesRead != fileSize) {
+        CloseHandle(hFile);
+        return SCH_ERROR_READ_FILE;
+    }
+
+    CloseHandle(hFile);
+
+    Engine->fileSize = normalize_dictionary(&Engine->Alphabet, Engine->fileContents, fileSize, &Engine->Normalized);
+
+    return SCH_OK;
+}
+
+static void
+release_query_queue(work_queue* Queue)
+{
+    if (Queue->WorkOrders)
+        VirtualFree(Queue->WorkOrders, 0, MEM_RELEASE);
+
+    if (Queue->Heaps)
+        release_word_heaps(Queue);
+}
+
+/*
+ * Queries the cost model keeps on one thread scan on the caller and run
+ * concurrently with anything else; wider ones wait for the pool.
+ */
+static void
+run_engine_query(sch_engine* Engine, work_queue* Queue, uint32_t thread_count)
+{
+    if (thread_count > 1) {
+        AcquireSRWLockExclusive(&Engine->PoolLock);
+        run_query(&Engine->Pool, Queue, Engine->fileContents, thread_count - 1);
+        ReleaseSRWLockExclusive(&Engine->PoolLock);
+    } else {
+        run_query(&Engine->Pool, Queue, Engine->fileContents, 0);
+    }
+}
+
+/*
+ * One pool run over the items of a staged build, one work order each.
+ * Items write only what is theirs, so it does not matter which thread
+ * takes which.
+ */
+static void
+run_build_stage(sch_engine* Engine, ctx* context, work_queue* Queue, uint32_t item_count, uint32_t thread_count)
+{
+    Queue->WorkOrderCount = item_count;
+
+    for (uint32_t i = 0; i < item_count; ++i) {
+        Queue->WorkOrders[i].context = context;
+        Queue->WorkOrders[i].startOffset = i;
+        Queue->WorkOrders[i].endOffset = i + 1;
+    }
+
+    run_engine_query(Engine, Queue, thread_count);
+}
+
+/*
+ * Builds Classes over the engine's own copy of the dictionary, one pool
+ * run per stage of word_class_build, so the classes are the same for
+ * any thread_count.
+ */
+static int
+build_word_classes(sch_engine* Engine, word_classes* Classes, uint32_t thread_count)
+{
+    word_class_build Build;
+    ctx context = {};
+    work_queue Queue = {};
+    uint32_t order_count = (WORD_CLASS_RANGE_COUNT > WORD_CLASS_SHARD_COUNT) ? WORD_CLASS_RANGE_COUNT : WORD_CLASS_SHARD_COUNT;
+    int Result = 0;
+
+    context.ClassBuild = &Build;
+    context.range_kernel = build_word_classes_kernel;
+    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, order_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (begin_word_class_build(&Build, Classes, &Engine->Alphabet, Engine->fileContents, Engine->fileSize) &&
+        Queue.WorkOrders && create_word_heaps(&Queue, Engine->Pool.worker_count, 0)) {
+        Result = 1;
+
+        for (int stage = WORD_CLASS_STAGE_SPLIT; Result && stage < WORD_CLASS_STAGE_COUNT; ++stage) {
+            Build.stage = (word_class_stage) stage;
+            run_build_stage(Engine, &context, &Queue, get_word_class_stage_size(&Build), thread_count);
+            Result = finish_word_class_stage(&Build);
+        }
+    }
+
+    release_query_queue(&Queue);
+
+    return end_word_class_build(&Build, Result);
+}
+
+/*
+ * Groups the dictionary into anagram classes on every thread and splits
+ * them into as many runs as there are work orders, so a class query
+ * reuses the query queue as it is.
+ */
+static int
+create_class_orders(sch_engine* Engine)
+{
+    uint64_t start = get_wall_clock();
+
+    if (!build_word_classes(Engine, &Engine->Classes, Engine->Pool.worker_count + 1))
+        return 0;
+
+    Engine->ClassOrders = (work_order*) VirtualAlloc(NULL, Engine->WorkOrderCount * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Engine->ClassOrders)
+        return 0;
+
+    for (uint32_t i = 0; i < Engine->WorkOrderCount; ++i) {
+        Engine->ClassOrders[i].startOffset = (uint32_t) ((uint64_t) Engine->Classes.class_count * i / Engine->WorkOrderCount);
+        Engine->ClassOrders[i].endOffset = (uint32_t) ((uint64_t) Engine->Classes.class_count * (i + 1) / Engine->WorkOrderCount);
+    }
+
+    Engine->classes_build_ms = get_ms_elapsed(start, get_wall_clock());
+
+    return 1;
+}
+
+static sch_engine*
+fail_open(sch_engine* Engine, sch_status Error, sch_status* Status)
+{
+    // NOTE: keep the failing call's error code for the caller
+    DWORD last_error = GetLastError();
+
+    if (Engine->allocated_size)
+        free_pages(&Engine->Pages, Engine->fileContents, Engine->allocated_size, Engine->large_pages);
+
+    VirtualFree(Engine, 0, MEM_RELEASE);
+    SetLastError(last_error);
+
+    if (Status)
+        *Status = Error;
+
+    return NULL;
+}
+
+/*
+ * Loads and normalizes the dictionary, places it on the NUMA nodes and
+ * starts one parked worker per processor. dictionary_path and Options may
+ * be NULL for the defaults: the embedded index, or else dictionary.txt.
+ */
+sch_engine*
+sch_open(const char* dictionary_path, const sch_options* Options, sch_status* Status)
+{
+    sch_options Defaults = {};
+    dictionary_layout layout = LAYOUT_DEFAULT;
+
+    if (!Options)
+        Options = &Defaults;
+
+    if (Options->layout) {
+        layout = LAYOUT_COUNT;
+
+        for (int i = LAYOUT_SINGLE_NODE; i < LAYOUT_COUNT; ++i) {
+            if (!strcmp(Options->layout, dictionary_layout_names[i]))
+                layout = (dictionary_layout) i;
+        }
+
+        if (layout == LAYOUT_COUNT) {
+            if (Status)
+                *Status = SCH_ERROR_ARGUMENT;
+
+            return NULL;
+        }
+    }
+
+    sch_engine* Engine = (sch_engine*) VirtualAlloc(NULL, sizeof(sch_engine), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Engine) {
+        if (Status)
+            *Status = SCH_ERROR_OUT_OF_MEMORY;
+
+        return NULL;
+    }
+
+    sch_status Result = load_engine_alphabet(&Engine->Alphabet, Options);
+
+    if (Result != SCH_OK)
+        return fail_open(Engine, Result, Status);
+
+    get_numa_topology(&Engine->Topology);
+
+    init_page_stats(&Engine->Pages, Options->use_large_pages);
+
+    uint64_t start = get_wall_clock();
+
+    // NOTE: without a path, an index linked into the executable for this
+    // alphabet wins over dictionary.txt
+    if (dictionary_path || !load_embedded_dictionary(Engine)) {
+        Result = load_dictionary_file(Engine, dictionary_path ? dictionary_path : "dictionary.txt");
+
+        if (Result != SCH_OK)
+            return fail_open(Engine, Result, Status);
+    }
+
+    Engine->load_ms = get_ms_elapsed(start, get_wall_clock());
+
+    for (uint32_t i = 0; i < Engine->Topology.node_count; ++i)
+        Engine->core_count += Engine->Topology.nodes[i].processor_count;
+
+    Engine->Workers = (worker_thread*) VirtualAlloc(NULL, Engine->core_count * sizeof(worker_thread), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Engine->Workers || !create_work_orders(Engine)) {
+        if (Engine->Workers)
+            VirtualFree(Engine->Workers, 0, MEM_RELEASE);
+
+        return fail_open(Engine, SCH_ERROR_OUT_OF_MEMORY, Status);
+    }
+
+    uint32_t worker_count = create_workers(&Engine->Topology, &Engine->Pool, Engine->Workers);
+
+    Engine->requested_layout = layout;
+    Engine->layout = apply_dictionary_layout(&Engine->Topology, &Engine->Pages, Engine->fileContents, Engine->fileSize, layout);
+    assign_worker_contents(&Engine->Topology, Engine->Workers);
+    InitializeSRWLock(&Engine->PoolLock);
+    InitializeSRWLock(&Engine->WordsLock);
+    InitializeSRWLock(&Engine->RacksLock);
+    InitializeSRWLock(&Engine->HooksLock);
+    start_worker_pool(&Engine->Pool, Engine->Workers, worker_count);
+
+    // NOTE: built once the pool is up, since the build runs on it
+    if (Options->use_word_classes && !create_class_orders(Engine)) {
+        stop_worker_pool(&Engine->Pool);
+        release_dictionary_layout(&Engine->Topology, &Engine->Pages, Engine->fileSize);
+        release_word_classes(&Engine->Classes);
+        VirtualFree(Engine->WorkOrders, 0, MEM_RELEASE);
+        VirtualFree(Engine->Workers, 0, MEM_RELEASE);
+
+        return fail_open(Engine, SCH_ERROR_OUT_OF_MEMORY, Status);
+    }
+
+    if (Status)
+        *Status = SCH_OK;
+
+    return Engine;
+}
+
+void
+sch_close(sch_engine* Engine)
+{
+    if (!Engine)
+        return;
+
+    stop_worker_pool(&Engine->Pool);
+    release_dictionary_layout(&Engine->Topology, &Engine->Pages, Engine->fileSize);
+    release_word_set(&Engine->Words);
+    release_rack_table(&Engine->Racks);
+    release_word_classes(&Engine->Classes);
+    release_hook_table(&Engine->Hooks);
+
+    if (Engine->ClassOrders)
+        VirtualFree(Engine->ClassOrders, 0, MEM_RELEASE);
+
+    VirtualFree(Engine->WorkOrders, 0, MEM_RELEASE);
+    VirtualFree(Engine->Workers, 0, MEM_RELEASE);
+
+    if (Engine->allocated_size)
+        free_pages(&Engine->Pages, Engine->fileContents, Engine->allocated_size, Engine->large_pages);
+
+    VirtualFree(Engine, 0, MEM_RELEASE);
+}
+
+void
+sch_get_info(sch_engine* Engine, sch_info* Info)
+{
+    memset(Info, 0, sizeof(*Info));
+
+    Info->core_count = Engine->core_count;
+    Info->worker_count = Engine->Pool.worker_count;
+    Info->numa_node_count = Engine->Topology.node_count;
+    Info->layout = dictionary_layout_names[Engine->layout];
+    Info->large_page_size = Engine->Pages.large_page_size;
+    Info->large_page_count = Engine->Pages.large_page_count;
+    Info->small_page_count = Engine->Pages.small_page_count;
+    Info->alphabet = Engine->Alphabet.name;
+    Info->alphabet_size = Engine->Alphabet.size;
+    Info->word_count = Engine->Normalized.word_count;
+    Info->dropped_word_count = Engine->Normalized.dropped_word_count;
+    Info->dictionary_bytes = Engine->fileSize;
+    Info->dictionary_embedded = Engine->embedded;
+    Info->load_ms = Engine->load_ms;
+    Info->class_count = Engine->Classes.class_count;
+    Info->class_bytes = Engine->ClassOrders ? get_word_classes_bytes(&Engine->Classes) : 0;
+    Info->class_build_ms = Engine->classes_build_ms;
+}
+
+/*
+ * Everything one query writes: its own copy of the work orders pointing
+ * at its context and its per-thread heaps. Nothing here is shared with
+ * other queries.
+ */
+static int
+create_query_queue(sch_engine* Engine, ctx* context, work_queue* Queue)
+{
+    Queue->WorkOrderCount = Engine->WorkOrderCount;
+    Queue->WorkOrders = (work_order*) VirtualAlloc(NULL, Queue->WorkOrderCount * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Queue->WorkOrders)
+        return 0;
+
+    for (uint32_t i = 0; i < Queue->WorkOrderCount; ++i) {
+        Queue->WorkOrders[i] = Engine->WorkOrders[i];
+        Queue->WorkOrders[i].context = context;
+    }
+
+    return create_word_heaps(Queue, Engine->Pool.worker_count, context->top_count);
+}
+
+static sch_status
+begin_query(sch_engine* Engine, const sch_query_params* Query, ctx* context, work_queue* Queue)
+{
+    if (!Query->rack || Query->top_count > SCH_MAX_TOP_COUNT)
+        return SCH_ERROR_ARGUMENT;
+
+    context->Alphabet = &Engine->Alphabet;
+    context->jumbled_letters = Query->rack;
+    context->included_letters = Query->include;
+    context->any_of_letters = Query->any_of;
+    context->allow_repeated = !!Query->allow_repeated;
+    context->thread_count = Query->thread_count;
+    context->top_count = Query->top_count;
+    context->rank_by_score = !Query->rank_by_length;
+
+    if (!prepare_query(context))
+        return SCH_ERROR_LETTERS;
+
+    if (!create_query_queue(Engine, context, Queue)) {
+        release_query_queue(Queue);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    Queue->progress = Query->progress;
+    Queue->progress_user = Query->progress_user;
+
+    return SCH_OK;
+}
+
+// NOTE: the class layout keeps the query's orders and heaps, only the
+// ranges now index classes
+static void
+use_word_classes(sch_engine* Engine, ctx* context, work_queue* Queue)
+{
+    for (uint32_t i = 0; i < Queue->WorkOrderCount; ++i) {
+        Queue->WorkOrders[i].startOffset = Engine->ClassOrders[i].startOffset;
+        Queue->WorkOrders[i].endOffset = Engine->ClassOrders[i].endOffset;
+    }
+
+    context->Classes = &Engine->Classes;
+    context->range_kernel = context->class_kernel;
+}
+
+static int
+get_word_length(const char* contents, uint32_t size, uint32_t id)
+{
+    uint32_t end = id;
+
+    while (end < size && !is_word_delim(contents[end]))
+        ++end;
+
+    return (int) (end - id);
+}
+
+// NOTE: spans into the engine's own copy, for sorting and for the
+// anagram grouping
+static void
+get_words_by_id(sch_engine* Engine, const uint32_t* ids, uint32_t count, word_t* words)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        words[i].word = Engine->fileContents + ids[i];
+        words[i].word_length = get_word_length(Engine->fileContents, Engine->fileSize, ids[i]);
+    }
+}
+
+static uint32_t
+join_word_ids(work_queue* Queue, uint32_t* ids)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < Queue->HeapCount; ++i) {
+        word_heap* Heap = Queue->Heaps + i;
+
+        memcpy(ids + count, Heap->ids, (size_t) Heap->id_count * sizeof(uint32_t));
+        count += Heap->id_count;
+    }
+
+    return count;
+}
+
+/*
+ * Length and lexicographic order need the words themselves, so the IDs
+ * are sorted as spans in a scratch array that lives only this long.
+ */
+static int
+sort_word_ids(sch_engine* Engine, uint32_t* ids, uint32_t count, sch_order order)
+{
+    if (order == SCH_ORDER_NONE) {
+        qsort(ids, count, sizeof(*ids), compare_word_ids);
+        return 1;
+    }
+
+    word_t* words = (word_t*) VirtualAlloc(NULL, (size_t) count * sizeof(word_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!words)
+        return 0;
+
+    get_words_by_id(Engine, ids, count, words);
+    qsort(words, count, sizeof(*words), (order == SCH_ORDER_LENGTH) ? compare_word_length : compare_lexicographically);
+
+    for (uint32_t i = 0; i < count; ++i)
+        ids[i] = (uint32_t) (words[i].word - Engine->fileContents);
+
+    VirtualFree(words, 0, MEM_RELEASE);
+
+    return 1;
+}
+
+/*
+ * Results hold word IDs, 4 bytes a match plus 4 for the rank with
+ * top_count, and are sized by the matches found. Unordered results
+ * that would take more room as IDs than one bit per dictionary byte
+ * come back as that bitset instead. Either way unordered results are in
+ * dictionary order, and text is only looked up by sch_next_word.
+ */
+static int
+collect_results(sch_engine* Engine, ctx* context, work_queue* Queue, sch_order order, sch_result* Result)
+{
+    uint64_t count = 0;
+
+    if (context->top_count) {
+        word_heap* Top = merge_word_heaps(Queue, Engine->fileContents);
+
+        if (!Top->count)
+            return 1;
+
+        Result->stats.result_bytes = (uint64_t) Top->count * 2 * sizeof(uint32_t);
+        Result->ids = (uint32_t*) VirtualAlloc(NULL, (size_t) Result->stats.result_bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+        if (!Result->ids)
+            return 0;
+
+        Result->ranks = Result->ids + Top->count;
+
+        for (uint32_t i = 0; i < Top->count; ++i) {
+            Result->ids[i] = Top->entries[i].id;
+            Result->ranks[i] = Top->entries[i].rank;
+        }
+
+        Result->count = Top->count;
+
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < Queue->HeapCount; ++i) {
+        if (Queue->Heaps[i].out_of_memory)
+            return 0;
+
+        count += Queue->Heaps[i].id_count;
+    }
+
+    if (!count)
+        return 1;
+
+    uint32_t bitset_words = (Engine->fileSize + 63) / 64;
+
+    if (order == SCH_ORDER_NONE && count * sizeof(uint32_t) > bitset_words * sizeof(uint64_t)) {
+        Result->stats.result_bytes = (uint64_t) bitset_words * sizeof(uint64_t);
+        Result->bitset = (uint64_t*) VirtualAlloc(NULL, (size_t) Result->stats.result_bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+        if (!Result->bitset)
+            return 0;
+
+        for (uint32_t i = 0; i < Queue->HeapCount; ++i) {
+            word_heap* Heap = Queue->Heaps + i;
+
+            for (uint32_t j = 0; j < Heap->id_count; ++j)
+                Result->bitset[Heap->ids[j] / 64] |= (uint64_t) 1 << (Heap->ids[j] % 64);
+        }
+
+        Result->bitset_words = bitset_words;
+    } else {
+        Result->stats.result_bytes = count * sizeof(uint32_t);
+        Result->ids = (uint32_t*) VirtualAlloc(NULL, (size_t) Result->stats.result_bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+        if (!Result->ids)
+            return 0;
+
+        join_word_ids(Queue, Result->ids);
+
+        if (!sort_word_ids(Engine, Result->ids, (uint32_t) count, order))
+            return 0;
+    }
+
+    Result->count = (uint32_t) count;
+
+    return 1;
+}
+
+sch_status
+sch_query(sch_engine* Engine, const sch_query_params* Query, sch_result* Result)
+{
+    ctx context = {};
+    work_queue Queue = {};
+
+    memset(Result, 0, sizeof(*Result));
+
+    sch_status Status = begin_query(Engine, Query, &context, &Queue);
+
+    if (Status != SCH_OK)
+        return Status;
+
+    if (Engine->ClassOrders)
+        use_word_classes(Engine, &context, &Queue);
+
+    query_plan Plan = plan_query(&context, Engine->fileSize, Engine->Pool.worker_count + 1);
+    uint64_t start_page_faults = get_page_fault_count();
+    uint64_t start = get_wall_clock();
+
+    run_engine_query(Engine, &Queue, Plan.thread_count);
+
+    sch_query_stats* Stats = &Result->stats;
+    Stats->elapsed_ms = get_ms_elapsed(start, get_wall_clock());
+    Stats->page_faults = get_page_fault_count() - start_page_faults;
+    Stats->words_found = Queue.TotalWordsFound;
+    Stats->thread_count = Plan.thread_count;
+    Stats->max_thread_count = Plan.max_thread_count;
+    Stats->forced = Plan.forced;
+    Stats->exec_mode = get_plan_mode_name(&Plan);
+    Stats->estimated_us = Plan.estimated_ns / 1000.0;
+    Stats->scan_bytes = Plan.scan_bytes;
+    Stats->estimated_words = Plan.estimated_words;
+    Stats->estimated_matches = Plan.estimated_matches;
+    Stats->rack_size = Plan.rack_size;
+    Stats->heap_count = context.top_count ? Queue.HeapCount : 0;
+
+    if (!collect_results(Engine, &context, &Queue, Query->order, Result))
+        Status = SCH_ERROR_OUT_OF_MEMORY;
+
+    release_query_queue(&Queue);
+
+    return Status;
+}
+
+void
+sch_release_result(sch_result* Result)
+{
+    if (Result->ids)
+        VirtualFree(Result->ids, 0, MEM_RELEASE);
+
+    if (Result->bitset)
+        VirtualFree(Result->bitset, 0, MEM_RELEASE);
+
+    Result->ids = NULL;
+    Result->ranks = NULL;
+    Result->bitset = NULL;
+    Result->count = 0;
+}
+
+int
+sch_next_word(sch_engine* Engine, const sch_result* Result, uint64_t* cursor, sch_word* Word)
+{
+    uint32_t id;
+
+    Word->rank = 0;
+
+    if (Result->bitset) {
+        uint64_t index = *cursor / 64;
+
+        if (index >= Result->bitset_words)
+            return 0;
+
+        uint64_t bits = Result->bitset[index] & (~(uint64_t) 0 << (*cursor % 64));
+
+        while (!bits) {
+            if (++index >= Result->bitset_words)
+                return 0;
+
+            bits = Result->bitset[index];
+        }
+
+        id = (uint32_t) (index * 64 + _tzcnt_u64(bits));
+        *cursor = (uint64_t) id + 1;
+    } else {
+        if (*cursor >= Result->count)
+            return 0;
+
+        id = Result->ids[*cursor];
+
+        if (Result->ranks)
+            Word->rank = Result->ranks[*cursor];
+
+        ++*cursor;
+    }
+
+    Word->id = id;
+    Word->text = Engine->fileContents + id;
+    Word->length = get_word_length(Engine->fileContents, Engine->fileSize, id);
+
+    return 1;
+}
+
+int
+sch_decode_word(sch_engine* Engine, const sch_word* Word, char* buffer, size_t size)
+{
+    return decode_word(&Engine->Alphabet, Word->text, Word->length, buffer, size);
+}
+
+/*
+ * Times the query under every layout, the pool's dispatch overhead and
+ * every scan kernel. Owns the pool for the whole run and puts the
+ * engine's layout back afterwards.
+ */
+sch_status
+sch_benchmark(sch_engine* Engine, const sch_query_params* Query, uint32_t iterations)
+{
+    ctx context = {};
+    work_queue Queue = {};
+    work_queue ClassQueue = {};
+    sch_status Status = begin_query(Engine, Query, &context, &Queue);
+
+    if (Status != SCH_OK)
+        return Status;
+
+    // NOTE: benchmark queries are quiet whatever the caller passed
+    Queue.progress = NULL;
+
+    // NOTE: the class kernel only runs while run_kernel_benchmark times
+    // it, everything else scans words
+    if (Engine->ClassOrders) {
+        if (!create_query_queue(Engine, &context, &ClassQueue)) {
+            release_query_queue(&ClassQueue);
+            release_query_queue(&Queue);
+            return SCH_ERROR_OUT_OF_MEMORY;
+        }
+
+        use_word_classes(Engine, &context, &ClassQueue);
+        context.range_kernel = NULL;
+    }
+
+    AcquireSRWLockExclusive(&Engine->PoolLock);
+
+    run_layout_benchmark(&Engine->Pool, &Queue, &Engine->Topology, &Engine->Pages, Engine->fileContents, Engine->fileSize, iterations);
+    run_dispatch_benchmark(&Engine->Pool, &Queue, Engine->fileContents, Engine->fileSize, iterations);
+    run_kernel_benchmark(&context, &Engine->Pool, &Queue, Engine->ClassOrders ? &ClassQueue : NULL, Engine->fileContents, iterations);
+
+    Engine->layout = apply_dictionary_layout(&Engine->Topology, &Engine->Pages, Engine->fileContents, Engine->fileSize, Engine->requested_layout);
+    assign_worker_contents(&Engine->Topology, Engine->Workers);
+
+    ReleaseSRWLockExclusive(&Engine->PoolLock);
+    release_query_queue(&ClassQueue);
+    release_query_queue(&Queue);
+
+    return SCH_OK;
+}
+
+static int
+run_word_set_build_stage(sch_engine* Engine, ctx* context, work_queue* Queue, word_set_stage stage, uint32_t thread_count, double* stage_ms)
+{
+    word_set_build* Build = context->WordSet;
+    uint64_t start = get_wall_clock();
+
+    Build->stage = stage;
+    run_build_stage(Engine, context, Queue, get_word_set_stage_size(Build), thread_count);
+
+    int Result = finish_word_set_stage(Build);
+    stage_ms[stage] += get_ms_elapsed(start, get_wall_clock());
+
+    return Result;
+}
+
+/*
+ * Builds Set over the engine's own copy of the dictionary, one pool run
+ * per stage of word_set_build. Which thread takes which range or shard
+ * does not matter, so the table is the same for any thread_count.
+ */
+static int
+build_word_set(sch_engine* Engine, word_set* Set, uint32_t thread_count, double* stage_ms)
+{
+    word_set_build Build;
+    ctx context = {};
+    work_queue Queue = {};
+    uint32_t order_count = (WORD_SET_RANGE_COUNT > WORD_SET_SHARD_COUNT) ? WORD_SET_RANGE_COUNT : WORD_SET_SHARD_COUNT;
+    int Result = 0;
+
+    memset(stage_ms, 0, WORD_SET_STAGE_COUNT * sizeof(*stage_ms));
+    context.WordSet = &Build;
+    context.range_kernel = build_word_set_kernel;
+    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, order_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (begin_word_set_build(&Build, Set, Engine->fileContents, Engine->fileSize) &&
+        Queue.WorkOrders && create_word_heaps(&Queue, Engine->Pool.worker_count, 0) &&
+        run_word_set_build_stage(Engine, &context, &Queue, WORD_SET_STAGE_SPLIT, thread_count, stage_ms)) {
+        // NOTE: a seed fails only when some shard runs out of pilots,
+        // then every shard is rebuilt with the next one
+        while (!Result && next_word_set_seed(&Build)) {
+            Result = run_word_set_build_stage(Engine, &context, &Queue, WORD_SET_STAGE_HASH, thread_count, stage_ms) &&
+                     run_word_set_build_stage(Engine, &context, &Queue, WORD_SET_STAGE_SCATTER, thread_count, stage_ms) &&
+                     run_word_set_build_stage(Engine, &context, &Queue, WORD_SET_STAGE_PLACE, thread_count, stage_ms);
+        }
+    }
+
+    release_query_queue(&Queue);
+
+    return end_word_set_build(&Build, Result);
+}
+
+/*
+ * Builds the word set on every thread the first time anyone asks. Once
+ * built it is only read, so checks run without the lock.
+ */
+static int
+get_engine_word_set(sch_engine* Engine)
+{
+    AcquireSRWLockExclusive(&Engine->WordsLock);
+
+    if (!Engine->Words.pilots) {
+        uint64_t start = get_wall_clock();
+        uint32_t thread_count = Engine->Pool.worker_count + 1;
+
+        if (build_word_set(Engine, &Engine->Words, thread_count, Engine->words_stage_ms)) {
+            Engine->words_build_ms = get_ms_elapsed(start, get_wall_clock());
+            Engine->words_thread_count = thread_count;
+        }
+    }
+
+    int Result = Engine->Words.pilots != NULL;
+    ReleaseSRWLockExclusive(&Engine->WordsLock);
+
+    return Result;
+}
+
+sch_status
+sch_check_words(sch_engine* Engine, const char* const* words, uint32_t count, uint8_t* valid)
+{
+    if (!get_engine_word_set(Engine))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    check_words(&Engine->Words, &Engine->Alphabet, words, count, valid);
+
+    return SCH_OK;
+}
+
+sch_status
+sch_get_word_set_info(sch_engine* Engine, sch_word_set_info* Info)
+{
+    memset(Info, 0, sizeof(*Info));
+
+    if (!get_engine_word_set(Engine))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    word_set* Set = &Engine->Words;
+    Info->word_count = Set->word_count;
+    Info->duplicate_count = Set->duplicate_count;
+    Info->bucket_count = Set->bucket_count;
+    Info->slot_count = Set->slot_count;
+    Info->seed_count = Set->seed_count;
+    Info->table_bytes = get_word_set_bytes(Set);
+    Info->bytes_per_word = (double) Info->table_bytes / (double) Set->word_count;
+    Info->dictionary_bytes_per_word = (double) Engine->fileSize / (double) Set->word_count;
+    Info->shard_count = WORD_SET_SHARD_COUNT;
+    Info->checksum = get_word_set_checksum(Set);
+    Info->build_thread_count = Engine->words_thread_count;
+    Info->split_ms = Engine->words_stage_ms[WORD_SET_STAGE_SPLIT];
+    Info->hash_ms = Engine->words_stage_ms[WORD_SET_STAGE_HASH];
+    Info->scatter_ms = Engine->words_stage_ms[WORD_SET_STAGE_SCATTER];
+    Info->place_ms = Engine->words_stage_ms[WORD_SET_STAGE_PLACE];
+    Info->build_ms = Engine->words_build_ms;
+
+    return SCH_OK;
+}
+
+/*
+ * Builds throwaway word sets at 1, 2, 4, ... threads up to one per
+ * processor and times every stage. The checksums show each build gave
+ * the same table.
+ */
+sch_status
+sch_benchmark_word_set(sch_engine* Engine, uint32_t iterations)
+{
+    static const char* stage_names[WORD_SET_STAGE_COUNT] = { "split", "hash", "scatter", "place" };
+    uint32_t max_thread_count = Engine->Pool.worker_count + 1;
+    uint64_t first_checksum = 0;
+    double single_ms = 0.0;
+
+    printf("**********************************************************\n");
+    printf("** WORD SET BUILD BENCHMARK (%u ranges, %u shards, best of %u)\n", WORD_SET_RANGE_COUNT, WORD_SET_SHARD_COUNT, iterations);
+    printf("**********************************************************\n");
+
+    for (uint32_t thread_count = 1;; thread_count *= 2) {
+        double best_stage_ms[WORD_SET_STAGE_COUNT] = {};
+        double best_ms = 0.0;
+        uint64_t checksum = 0;
+
+        if (thread_count > max_thread_count)
+            thread_count = max_thread_count;
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            word_set Set;
+            double stage_ms[WORD_SET_STAGE_COUNT];
+            uint64_t start = get_wall_clock();
+
+            if (!build_word_set(Engine, &Set, thread_count, stage_ms))
+                return SCH_ERROR_OUT_OF_MEMORY;
+
+            double ms = get_ms_elapsed(start, get_wall_clock());
+            checksum = get_word_set_checksum(&Set);
+            release_word_set(&Set);
+
+            if (!i || ms < best_ms) {
+                best_ms = ms;
+                memcpy(best_stage_ms, stage_ms, sizeof(stage_ms));
+            }
+        }
+
+        if (thread_count == 1) {
+            first_checksum = checksum;
+            single_ms = best_ms;
+        }
+
+        printf("** %2u threads :", thread_count);
+
+        for (uint32_t s = 0; s < WORD_SET_STAGE_COUNT; ++s)
+            printf("  %s %7.3f ms", stage_names[s], best_stage_ms[s]);
+
+        printf("  total %8.3f ms (%.2fx)  table %016llx%s\n", best_ms, single_ms / best_ms,
+               checksum, (checksum == first_checksum) ? "" : " DIFFERS");
+
+        if (thread_count == max_thread_count)
+            break;
+    }
+
+    printf("**********************************************************\n\n");
+
+    return SCH_OK;
+}
+
+/*
+ * One allocation for the whole index: classes, the grouped words, the
+ * signature table at most half full and a streaming batch per thread.
+ */
+static int
+create_anagram_index(anagram_index* Index, uint32_t candidate_count, uint32_t output_count)
+{
+    uint32_t slot_count = 16;
+
+    while (slot_count < 2 * candidate_count)
+        slot_count *= 2;
+
+    size_t classes_size = (size_t) candidate_count * sizeof(anagram_class);
+    size_t words_size = (size_t) candidate_count * sizeof(word_t);
+    size_t slots_size = (size_t) slot_count * sizeof(uint32_t);
+    size_t outputs_size = (size_t) output_count * sizeof(anagram_output);
+    char* memory = (char*) VirtualAlloc(NULL, classes_size + words_size + slots_size + outputs_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!memory)
+        return 0;
+
+    Index->classes = (anagram_class*) memory;
+    Index->words = (word_t*) (memory + classes_size);
+    Index->slots = (uint32_t*) (memory + classes_size + words_size);
+    Index->Outputs = (anagram_output*) (memory + classes_size + words_size + slots_size);
+    Index->slot_mask = slot_count - 1;
+
+    uint64_t state = ANAGRAM_SIGNATURE_SEED;
+
+    for (uint32_t i = 0; i < MAX_ALPHABET_SIZE; ++i)
+        Index->keys[i] = get_next_random(&state);
+
+    InitializeSRWLock(&Index->OutputLock);
+
+    return 1;
+}
+
+static uint64_t
+get_candidate_signature(anagram_index* Index, word_t* Word, uint8_t* freq)
+{
+    memset(freq, 0, MAX_ALPHABET_SIZE);
+
+    for (int i = 0; i < Word->word_length; ++i)
+        freq[get_letter_index(Word->word[i])]++;
+
+    return get_anagram_signature(Index, freq);
+}
+
+/*
+ * Folds the candidates into classes by letter histogram. Candidates are
+ * sorted by length and text first, so classes come out shortest first
+ * and the same on every run, and each class lists its words in order.
+ */
+static void
+group_anagram_classes(anagram_index* Index, word_t* candidates, uint32_t candidate_count)
+{
+    alignas(64) uint8_t freq[MAX_ALPHABET_SIZE];
+
+    qsort(candidates, candidate_count, sizeof(*candidates), compare_anagram_candidates);
+
+    for (uint32_t i = 0; i < candidate_count; ++i) {
+        uint64_t signature = get_candidate_signature(Index, candidates + i, freq);
+        uint32_t c;
+
+        if (!find_anagram_class(Index, signature, freq, 0, &c)) {
+            c = Index->class_count++;
+            anagram_class* Class = Index->classes + c;
+
+            memcpy(Class->freq, freq, sizeof(freq));
+            Class->signature = signature;
+            Class->length = (uint32_t) candidates[i].word_length;
+
+            uint32_t slot = (uint32_t) signature & Index->slot_mask;
+
+            while (Index->slots[slot])
+                slot = (slot + 1) & Index->slot_mask;
+
+            Index->slots[slot] = c + 1;
+        }
+
+        ++Index->classes[c].word_count;
+    }
+
+    uint32_t first_word = 0;
+
+    for (uint32_t c = 0; c < Index->class_count; ++c) {
+        Index->classes[c].first_word = first_word;
+        first_word += Index->classes[c].word_count;
+        Index->classes[c].word_count = 0;
+    }
+
+    for (uint32_t i = 0; i < candidate_count; ++i) {
+        uint32_t c;
+        find_anagram_class(Index, get_candidate_signature(Index, candidates + i, freq), freq, 0, &c);
+
+        anagram_class* Class = Index->classes + c;
+        Index->words[Class->first_word + Class->word_count++] = candidates[i];
+    }
+}
+
+/*
+ * Join orders are runs of first classes. Only classes at most half the
+ * rack can start a combination, and the short ones do the most work, so
+ * orders stay small for the pool to balance.
+ */
+static int
+create_anagram_orders(ctx* context, work_queue* Queue, anagram_index* Index)
+{
+    uint32_t first_class_count = 0;
+
+    while (first_class_count < Index->class_count && 2 * Index->classes[first_class_count].length <= Index->rack_size)
+        ++first_class_count;
+
+    uint32_t order_count = (first_class_count + ANAGRAM_CLASSES_PER_ORDER - 1) / ANAGRAM_CLASSES_PER_ORDER;
+    Queue->WorkOrders = (work_order*) VirtualAlloc(NULL, (order_count + 1) * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Queue->WorkOrders)
+        return 0;
+
+    for (uint32_t i = 0; i < order_count; ++i) {
+        work_order* Order = Queue->WorkOrders + i;
+        Order->context = context;
+        Order->startOffset = i * ANAGRAM_CLASSES_PER_ORDER;
+        Order->endOffset = (i + 1 == order_count) ? first_class_count : (i + 1) * ANAGRAM_CLASSES_PER_ORDER;
+    }
+
+    Queue->WorkOrderCount = order_count;
+
+    return 1;
+}
+
+/*
+ * Multi-word anagrams in three stages: the subset scan keeps the words
+ * the rack can spell, those are grouped by letter histogram, and the
+ * classes are hash joined on what each leaves of the rack. The scan and
+ * the join run on the pool; combinations are streamed in batches as the
+ * join finds them, so their order varies between runs.
+ */
+sch_status
+sch_find_anagrams(sch_engine* Engine, const sch_anagram_params* Params, sch_anagram_stats* Stats)
+{
+    sch_anagram_stats Ignored;
+    uint32_t max_words = Params->max_words ? Params->max_words : 2;
+
+    if (!Stats)
+        Stats = &Ignored;
+
+    memset(Stats, 0, sizeof(*Stats));
+
+    if (!Params->rack || max_words < 2 || max_words > SCH_MAX_ANAGRAM_WORDS)
+        return SCH_ERROR_ARGUMENT;
+
+    ctx context = {};
+    context.Alphabet = &Engine->Alphabet;
+    context.jumbled_letters = Params->rack;
+    context.thread_count = Params->thread_count;
+
+    if (!prepare_query(&context))
+        return SCH_ERROR_LETTERS;
+
+    // NOTE: every tile is used exactly once, which a blank standing for
+    // any letter does not fit
+    if (context.blank_count)
+        return SCH_ERROR_ARGUMENT;
+
+    uint32_t max_thread_count = Engine->Pool.worker_count + 1;
+    query_plan Plan = plan_query(&context, Engine->fileSize, max_thread_count);
+    work_queue Filter = {};
+    work_queue Join = {};
+    anagram_index Index = {};
+    sch_status Status = SCH_OK;
+
+    uint64_t start = get_wall_clock();
+
+    if (!create_query_queue(Engine, &context, &Filter)) {
+        release_query_queue(&Filter);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    run_engine_query(Engine, &Filter, Plan.thread_count);
+    uint64_t filtered = get_wall_clock();
+
+    uint32_t candidate_count = 0;
+    uint8_t out_of_memory = 0;
+
+    for (uint32_t i = 0; i < Filter.HeapCount; ++i) {
+        candidate_count += Filter.Heaps[i].id_count;
+        out_of_memory |= Filter.Heaps[i].out_of_memory;
+    }
+
+    // NOTE: one spare entry keeps the allocation valid for racks that
+    // spell nothing
+    word_t* candidates = out_of_memory ? NULL : (word_t*) VirtualAlloc(NULL, ((size_t) candidate_count + 1) * sizeof(word_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!candidates || !create_anagram_index(&Index, candidate_count, max_thread_count)) {
+        if (candidates)
+            VirtualFree(candidates, 0, MEM_RELEASE);
+
+        release_query_queue(&Filter);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    uint32_t copied = 0;
+
+    for (uint32_t i = 0; i < Filter.HeapCount; ++i) {
+        get_words_by_id(Engine, Filter.Heaps[i].ids, Filter.Heaps[i].id_count, candidates + copied);
+        copied += Filter.Heaps[i].id_count;
+    }
+
+    Index.rack_size = Plan.rack_size;
+    Index.max_words = max_words;
+    Index.output = Params->output;
+    Index.output_user = Params->output_user;
+    Index.rack_signature = get_anagram_signature(&Index, context.jumbled_letters_freq);
+
+    Index.contents = Engine->fileContents;
+    group_anagram_classes(&Index, candidates, candidate_count);
+    VirtualFree(candidates, 0, MEM_RELEASE);
+    release_query_queue(&Filter);
+    uint64_t grouped = get_wall_clock();
+
+    // NOTE: pairs probe once per class, triples about once per pair of
+    // classes; below ANAGRAM_PARALLEL_JOIN_STEPS waking workers costs
+    // more than it saves
+    uint64_t join_steps = (max_words > 2) ? (uint64_t) Index.class_count * Index.class_count / 2 : Index.class_count;
+    uint32_t join_thread_count = Params->thread_count ? Params->thread_count : ((join_steps >= ANAGRAM_PARALLEL_JOIN_STEPS) ? max_thread_count : 1);
+
+    if (join_thread_count > max_thread_count)
+        join_thread_count = max_thread_count;
+
+    context.Anagrams = &Index;
+    context.range_kernel = (Engine->Alphabet.size > 32) ? join_anagram_classes<64> : join_anagram_classes<32>;
+
+    if (create_anagram_orders(&context, &Join, &Index) && create_word_heaps(&Join, Engine->Pool.worker_count, 0)) {
+        run_engine_query(Engine, &Join, join_thread_count);
+
+        if (Index.output) {
+            for (uint32_t i = 0; i < Join.HeapCount; ++i)
+                flush_anagram_output(&Index, Index.Outputs + i);
+        }
+    } else {
+        Status = SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    uint64_t end = get_wall_clock();
+
+    Stats->rack_size = Index.rack_size;
+    Stats->candidate_count = candidate_count;
+    Stats->class_count = Index.class_count;
+    Stats->class_combination_count = Index.ClassCombinationCount;
+    Stats->anagram_count = Join.TotalWordsFound;
+    Stats->filter_thread_count = Plan.thread_count;
+    Stats->join_thread_count = join_thread_count;
+    Stats->filter_ms = get_ms_elapsed(start, filtered);
+    Stats->group_ms = get_ms_elapsed(filtered, grouped);
+    Stats->join_ms = get_ms_elapsed(grouped, end);
+    Stats->elapsed_ms = get_ms_elapsed(start, end);
+
+    release_query_queue(&Join);
+    VirtualFree(Index.classes, 0, MEM_RELEASE);
+
+    return Status;
+}
+
+/*
+ * Times every stage of the anagram search at 1, 2, 4, ... threads up to
+ * one per processor, counting combinations without streaming them.
+ */
+sch_status
+sch_benchmark_anagrams(sch_engine* Engine, const sch_anagram_params* Params, uint32_t iterations)
+{
+    sch_anagram_params Quiet = *Params;
+    sch_anagram_stats Stats;
+    uint32_t max_thread_count = Engine->Pool.worker_count + 1;
+
+    Quiet.output = NULL;
+    Quiet.thread_count = 0;
+
+    // NOTE: also warms up caches and page tables before timing
+    sch_status Status = sch_find_anagrams(Engine, &Quiet, &Stats);
+
+    if (Status != SCH_OK)
+        return Status;
+
+    printf("**********************************************************\n");
+    printf("** MULTI-WORD ANAGRAM BENCHMARK (%u tiles, 2 to %u words, best of %u)\n", Stats.rack_size, Quiet.max_words ? Quiet.max_words : 2, iterations);
+    printf("** %u candidates, %u classes, %llu class combinations, %llu anagrams\n",
+           Stats.candidate_count, Stats.class_count, Stats.class_combination_count, Stats.anagram_count);
+    printf("**********************************************************\n");
+
+    for (uint32_t thread_count = 1;; thread_count *= 2) {
+        sch_anagram_stats Best = {};
+
+        if (thread_count > max_thread_count)
+            thread_count = max_thread_count;
+
+        Quiet.thread_count = thread_count;
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            sch_find_anagrams(Engine, &Quiet, &Stats);
+
+            if (!i || Stats.elapsed_ms < Best.elapsed_ms)
+                Best = Stats;
+        }
+
+        printf("** %2u threads :  filter %8.3f ms  group %8.3f ms  join %8.3f ms  total %8.3f ms\n",
+               thread_count, Best.filter_ms, Best.group_ms, Best.join_ms, Best.elapsed_ms);
+
+        if (thread_count == max_thread_count)
+            break;
+    }
+
+    printf("**********************************************************\n\n");
+
+    return SCH_OK;
+}
+
+/*
+ * Builds Racks one pool run per stage of rack_table_build, the same for
+ * any thread_count.
+ */
+static int
+build_rack_table(sch_engine* Engine, rack_table* Racks, uint32_t thread_count)
+{
+    rack_table_build Build;
+    ctx context = {};
+    work_queue Queue = {};
+    uint32_t order_count = (RACK_RANGE_COUNT > RACK_SHARD_COUNT) ? RACK_RANGE_COUNT : RACK_SHARD_COUNT;
+    int Result = 0;
+
+    context.RackBuild = &Build;
+    context.range_kernel = build_rack_table_kernel;
+    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, order_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (begin_rack_table_build(&Build, Racks, &Engine->Alphabet, Engine->fileContents, Engine->fileSize) &&
+        Queue.WorkOrders && create_word_heaps(&Queue, Engine->Pool.worker_count, 0)) {
+        Result = 1;
+
+        for (int stage = RACK_STAGE_SPLIT; Result && stage < RACK_STAGE_COUNT; ++stage) {
+            Build.stage = (rack_stage) stage;
+            run_build_stage(Engine, &context, &Queue, get_rack_stage_size(&Build), thread_count);
+            Result = finish_rack_stage(&Build);
+        }
+    }
+
+    release_query_queue(&Queue);
+
+    return end_rack_table_build(&Build, Result);
+}
+
+/*
+ * Builds the rack table on every thread the first time anyone simulates.
+ * Once built it is only read, so simulations run without the lock.
+ */
+static int
+get_engine_rack_table(sch_engine* Engine, double* build_ms)
+{
+    AcquireSRWLockExclusive(&Engine->RacksLock);
+    *build_ms = 0.0;
+
+    if (!Engine->Racks.entries) {
+        uint64_t start = get_wall_clock();
+
+        if (build_rack_table(Engine, &Engine->Racks, Engine->Pool.worker_count + 1)) {
+            Engine->racks_build_ms = get_ms_elapsed(start, get_wall_clock());
+            *build_ms = Engine->racks_build_ms;
+        }
+    }
+
+    int Result = Engine->Racks.entries != NULL;
+    ReleaseSRWLockExclusive(&Engine->RacksLock);
+
+    return Result;
+}
+
+/*
+ * Takes the leave out of the bag and lays the rest out as one symbol per
+ * tile, blanks as RACK_BLANK_SYMBOL. The rack table only holds multisets
+ * with up to RACK_MAX_BLANKS blanks, so a bag with more is refused rather
+ * than missing every word that needs the extra ones.
+ */
+static sch_status
+fill_simulation_bag(sch_engine* Engine, const sch_simulation_params* Params, simulation* Simulation)
+{
+    uint8_t counts[MAX_ALPHABET_SIZE + 1];
+    const char* bag = Params->bag;
+
+    if (!bag) {
+        if (strcmp(Engine->Alphabet.name, "english"))
+            return SCH_ERROR_NO_BAG;
+
+        bag = SIMULATION_ENGLISH_BAG;
+    }
+
+    if (!parse_tile_counts(&Engine->Alphabet, bag, counts))
+        return SCH_ERROR_LETTERS;
+
+    if (counts[RACK_BLANK_SYMBOL] > RACK_MAX_BLANKS)
+        return SCH_ERROR_ARGUMENT;
+
+    if (Params->leave) {
+        uint8_t codes[RACK_MAX_TILES + 1];
+        int count = get_tile_codes(&Engine->Alphabet, Params->leave, codes, RACK_MAX_TILES + 1);
+
+        if (count < 0)
+            return SCH_ERROR_LETTERS;
+
+        if ((uint32_t) count > Simulation->rack_size)
+            return SCH_ERROR_ARGUMENT;
+
+        for (int i = 0; i < count; ++i) {
+            uint8_t symbol = (codes[i] == BLANK_CODE) ? RACK_BLANK_SYMBOL : codes[i];
+
+            // NOTE: a leave can only hold tiles the bag had
+            if (!counts[symbol])
+                return SCH_ERROR_ARGUMENT;
+
+            --counts[symbol];
+            Simulation->leave[Simulation->leave_count++] = symbol;
+        }
+    }
+
+    for (uint32_t symbol = 0; symbol <= MAX_ALPHABET_SIZE; ++symbol) {
+        for (uint32_t i = 0; i < counts[symbol]; ++i)
+            Simulation->tiles[Simulation->tile_count++] = (uint8_t) symbol;
+    }
+
+    if (Simulation->tile_count < Simulation->rack_size - Simulation->leave_count)
+        return SCH_ERROR_ARGUMENT;
+
+    return SCH_OK;
+}
+
+/*
+ * Monte Carlo over racks: draws sample_count racks from the bag on top
+ * of the leave and plays each against the rack table, which answers in
+ * at most 2^rack_size probes. Every thread counts into its own
+ * histograms, added up once the pool is done.
+ */
+sch_status
+sch_simulate(sch_engine* Engine, const sch_simulation_params* Params, sch_simulation_stats* Stats)
+{
+    sch_simulation_stats Ignored;
+    uint32_t max_thread_count = Engine->Pool.worker_count + 1;
+    uint32_t thread_count = Params->thread_count ? Params->thread_count : max_thread_count;
+    uint64_t order_count = (Params->sample_count + SIMULATION_ORDER_SAMPLES - 1) / SIMULATION_ORDER_SAMPLES;
+
+    if (!Stats)
+        Stats = &Ignored;
+
+    memset(Stats, 0, sizeof(*Stats));
+
+    if (Params->rack_size > SCH_MAX_RACK_TILES || order_count > UINT32_MAX)
+        return SCH_ERROR_ARGUMENT;
+
+    if (thread_count > max_thread_count)
+        thread_count = max_thread_count;
+
+    simulation* Simulation = (simulation*) VirtualAlloc(NULL, sizeof(simulation), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Simulation)
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    Simulation->rack_size = Params->rack_size ? Params->rack_size : SCH_MAX_RACK_TILES;
+    Simulation->seed = Params->seed;
+    Simulation->sample_count = Params->sample_count;
+
+    sch_status Status = fill_simulation_bag(Engine, Params, Simulation);
+
+    if (Status != SCH_OK) {
+        VirtualFree(Simulation, 0, MEM_RELEASE);
+        return Status;
+    }
+
+    if (!get_engine_rack_table(Engine, &Stats->table_build_ms)) {
+        VirtualFree(Simulation, 0, MEM_RELEASE);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ctx context = {};
+    work_queue Queue = {};
+
+    Simulation->Table = &Engine->Racks;
+    context.Simulation = Simulation;
+    context.range_kernel = simulate_racks_kernel;
+    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, (order_count + 1) * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Queue.WorkOrders || !create_word_heaps(&Queue, Engine->Pool.worker_count, 0) ||
+        !(Simulation->Counts = (simulation_counts*) VirtualAlloc(NULL, Queue.HeapCount * sizeof(simulation_counts), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))) {
+        release_query_queue(&Queue);
+        VirtualFree(Simulation, 0, MEM_RELEASE);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < order_count; ++i) {
+        Queue.WorkOrders[i].context = &context;
+        Queue.WorkOrders[i].startOffset = i;
+        Queue.WorkOrders[i].endOffset = i + 1;
+    }
+
+    Queue.WorkOrderCount = (uint32_t) order_count;
+
+    uint64_t start = get_wall_clock();
+    run_engine_query(Engine, &Queue, thread_count);
+    uint64_t end = get_wall_clock();
+
+    uint64_t score_sum = 0;
+
+    for (uint32_t i = 0; i < Queue.HeapCount; ++i) {
+        simulation_counts* Counts = Simulation->Counts + i;
+
+        for (uint32_t l = 0; l <= RACK_MAX_TILES; ++l)
+            Stats->length_histogram[l] += Counts->length_histogram[l];
+
+        for (uint32_t b = 0; b < SCH_SIMULATION_SCORE_BUCKETS; ++b)
+            Stats->score_histogram[b] += Counts->score_histogram[b];
+
+        score_sum += Counts->score_sum;
+    }
+
+    Stats->sample_count = Queue.TotalWordsFound;
+    Stats->playable_count = Stats->sample_count - Stats->length_histogram[0];
+    Stats->bingo_count = Stats->length_histogram[Simulation->rack_size];
+    Stats->mean_best_score = Stats->sample_count ? (double) score_sum / (double) Stats->sample_count : 0.0;
+    Stats->bag_tile_count = Simulation->tile_count;
+    Stats->thread_count = thread_count;
+    Stats->table_entry_count = Engine->Racks.entry_count;
+    Stats->table_bytes = get_rack_table_bytes(&Engine->Racks);
+    Stats->elapsed_ms = get_ms_elapsed(start, end);
+    Stats->racks_per_second = Stats->elapsed_ms > 0.0 ? (double) Stats->sample_count * 1000.0 / Stats->elapsed_ms : 0.0;
+
+    VirtualFree(Simulation->Counts, 0, MEM_RELEASE);
+    VirtualFree(Simulation, 0, MEM_RELEASE);
+    release_query_queue(&Queue);
+
+    return SCH_OK;
+}
+
+/*
+ * Builds Hooks over the engine's own copy of the dictionary, one pool
+ * run per stage of hook_table_build, so the table is the same for any
+ * thread_count and the same as embed.exe's.
+ */
+static int
+build_hook_table(sch_engine* Engine, hook_table* Hooks, uint32_t thread_count)
+{
+    hook_table_build Build;
+    ctx context = {};
+    work_queue Queue = {};
+    uint32_t order_count = (HOOK_RANGE_COUNT > HOOK_SHARD_COUNT) ? HOOK_RANGE_COUNT : HOOK_SHARD_COUNT;
+    int Result = 0;
+
+    context.HookBuild = &Build;
+    context.range_kernel = build_hook_table_kernel;
+    Queue.WorkOrders = (work_order*) VirtualAlloc(NULL, order_count * sizeof(work_order), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (begin_hook_table_build(&Build, Hooks, &Engine->Alphabet, Engine->fileContents, Engine->fileSize) &&
+        Queue.WorkOrders && create_word_heaps(&Queue, Engine->Pool.worker_count, 0)) {
+        Result = 1;
+
+        for (int stage = HOOK_STAGE_SPLIT; Result && stage < HOOK_STAGE_COUNT; ++stage) {
+            Build.stage = (hook_stage) stage;
+            run_build_stage(Engine, &context, &Queue, get_hook_stage_size(&Build), thread_count);
+            Result = finish_hook_stage(&Build);
+        }
+    }
+
+    release_query_queue(&Queue);
+
+    return end_hook_table_build(&Build, Result);
+}
+
+/*
+ * Builds the hook table on every thread the first time anyone asks,
+ * unless it came with the dictionary index.
+ */
+static int
+get_engine_hook_table(sch_engine* Engine)
+{
+    AcquireSRWLockExclusive(&Engine->HooksLock);
+
+    if (!Engine->Hooks.bucket_starts) {
+        uint64_t start = get_wall_clock();
+        uint32_t thread_count = Engine->Pool.worker_count + 1;
+
+        if (build_hook_table(Engine, &Engine->Hooks, thread_count)) {
+            Engine->hooks_build_ms = get_ms_elapsed(start, get_wall_clock());
+            Engine->hooks_thread_count = thread_count;
+        }
+    }
+
+    int Result = Engine->Hooks.bucket_starts != NULL;
+    ReleaseSRWLockExclusive(&Engine->HooksLock);
+
+    return Result;
+}
+
+sch_status
+sch_cross_check(sch_engine* Engine, const char* const* before, const char* const* after, uint32_t count, uint64_t* masks)
+{
+    if (!get_engine_hook_table(Engine))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    cross_check(&Engine->Hooks, &Engine->Alphabet, before, after, count, masks);
+
+    return SCH_OK;
+}
+
+sch_status
+sch_get_hook_info(sch_engine* Engine, sch_hook_info* Info)
+{
+    memset(Info, 0, sizeof(*Info));
+
+    if (!get_engine_hook_table(Engine))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    hook_table* Hooks = &Engine->Hooks;
+    Info->pair_count = Hooks->pair_count;
+    Info->bucket_count = Hooks->bucket_count;
+    Info->mask_size = Hooks->mask_size;
+    Info->table_bytes = get_hook_block_size(Hooks->pair_count, Hooks->bucket_count, Hooks->mask_size);
+    Info->bytes_per_pair = (double) Info->table_bytes / (double) Hooks->pair_count;
+    Info->embedded = !Hooks->memory;
+    Info->build_ms = Engine->hooks_build_ms;
+    Info->build_thread_count = Engine->hooks_thread_count;
+
+    return SCH_OK;
+}
+
+int
+sch_decode_tiles(sch_engine* Engine, uint64_t mask, char* buffer, size_t size)
+{
+    size_t written = 0;
+
+    if (size)
+        buffer[0] = 0;
+
+    for (uint32_t k = 0; k < Engine->Alphabet.size; ++k) {
+        if (!(mask & ((uint64_t) 1 << k)))
+            continue;
+
+        int length = snprintf((written < size) ? buffer + written : NULL, (written < size) ? size - written : 0,
+                              written ? " %s" : "%s", Engine->Alphabet.tiles[k]);
+        written += (size_t) length;
+    }
+
+    return (int) written;
+}
+
+// NOTE: what a cross-check costs without the table, one pass over every
+// word one tile longer than the fragments
+static uint64_t
+scan_cross_check(const char* contents, uint32_t size, const char* key, uint32_t length, uint32_t gap)
+{
+    uint64_t mask = 0;
+
+    for (uint32_t i = 0; i < size;) {
+        uint32_t start = i;
+
+        while (i < size && contents[i] != '\n')
+            ++i;
+
+        if (i++ - start == length + 1 && !memcmp(contents + start, key, gap) && !memcmp(contents + start + gap + 1, key + gap, length - gap))
+            mask |= (uint64_t) 1 << (contents[start + gap] - TILE_CODE_BASE);
+    }
+
+    return mask;
+}
+
+// NOTE: fragment pairs of dictionary words queued for one batched lookup
+struct hook_batch {
+    char text[HOOK_BATCH_SIZE][HOOK_MAX_WORD_LENGTH];
+    const char* keys[HOOK_BATCH_SIZE];
+    uint32_t lengths[HOOK_BATCH_SIZE];
+    uint32_t gaps[HOOK_BATCH_SIZE];
+    uint64_t own_masks[HOOK_BATCH_SIZE];    // the tile each pair was taken from
+    uint32_t count;
+    uint64_t lookup_count;
+    uint64_t missing_count;
+    uint64_t mask_sum;
+};
+
+static void
+flush_hook_batch(hook_table* Hooks, hook_batch* Batch)
+{
+    uint64_t masks[HOOK_BATCH_SIZE];
+
+    cross_check_tiles(Hooks, Batch->keys, Batch->lengths, Batch->gaps, Batch->count, masks);
+
+    for (uint32_t i = 0; i < Batch->count; ++i) {
+        Batch->missing_count += !(masks[i] & Batch->own_masks[i]);
+        Batch->mask_sum += masks[i];
+    }
+
+    Batch->lookup_count += Batch->count;
+    Batch->count = 0;
+}
+
+static void
+add_hook_batch_pair(hook_table* Hooks, hook_batch* Batch, const char* word, uint32_t length, uint32_t gap)
+{
+    uint32_t i = Batch->count++;
+
+    memcpy(Batch->text[i], word, gap);
+    memcpy(Batch->text[i] + gap, word + gap + 1, length - gap - 1);
+    Batch->keys[i] = Batch->text[i];
+    Batch->lengths[i] = length - 1;
+    Batch->gaps[i] = gap;
+    Batch->own_masks[i] = (uint64_t) 1 << (word[gap] - TILE_CODE_BASE);
+
+    if (Batch->count == HOOK_BATCH_SIZE)
+        flush_hook_batch(Hooks, Batch);
+}
+
+/*
+ * Times a throwaway build of the hook table, then looks up every
+ * fragment pair of every word in the engine's table, each of which has
+ * to hold at least the tile it was taken from. A sample of pairs is also
+ * answered by scanning the dictionary, which the table has to match.
+ */
+sch_status
+sch_benchmark_hooks(sch_engine* Engine, uint32_t iterations)
+{
+    if (!get_engine_hook_table(Engine))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    hook_table* Hooks = &Engine->Hooks;
+    const char* contents = Engine->fileContents;
+    uint32_t size = Engine->fileSize;
+    uint64_t block_size = get_hook_block_size(Hooks->pair_count, Hooks->bucket_count, Hooks->mask_size);
+    double build_ms = 0.0;
+    int same_table = 1;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        hook_table Built;
+        uint64_t start = get_wall_clock();
+
+        if (!build_hook_table(Engine, &Built, Engine->Pool.worker_count + 1))
+            return SCH_ERROR_OUT_OF_MEMORY;
+
+        double ms = get_ms_elapsed(start, get_wall_clock());
+        same_table &= Built.pair_count == Hooks->pair_count && Built.bucket_count == Hooks->bucket_count &&
+                      Built.mask_size == Hooks->mask_size && !memcmp(Built.masks, Hooks->masks, block_size);
+        release_hook_table(&Built);
+
+        if (!i || ms < build_ms)
+            build_ms = ms;
+    }
+
+    hook_batch* Batch = (hook_batch*) VirtualAlloc(NULL, sizeof(hook_batch), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    double lookup_ms = 0.0;
+
+    if (!Batch)
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t start = get_wall_clock();
+
+        memset(Batch, 0, sizeof(*Batch));
+
+        for (uint32_t offset = 0; offset < size;) {
+            uint32_t word = offset;
+
+            while (offset < size && contents[offset] != '\n')
+                ++offset;
+
+            uint32_t length = offset++ - word;
+
+            for (uint32_t gap = 0; gap < length && length <= HOOK_MAX_WORD_LENGTH; ++gap)
+                add_hook_batch_pair(Hooks, Batch, contents + word, length, gap);
+        }
+
+        flush_hook_batch(Hooks, Batch);
+
+        double ms = get_ms_elapsed(start, get_wall_clock());
+
+        if (!i || ms < lookup_ms)
+            lookup_ms = ms;
+    }
+
+    // NOTE: every (lookup_count / HOOK_BENCHMARK_SCANS)th pair, in
+    // dictionary order, one at a time
+    uint64_t scan_step = Batch->lookup_count / HOOK_BENCHMARK_SCANS + 1;
+    uint64_t pair = 0;
+    uint32_t scan_count = 0;
+    uint32_t scan_mismatch_count = 0;
+    uint64_t scan_start = get_wall_clock();
+
+    for (uint32_t offset = 0; offset < size;) {
+        uint32_t word = offset;
+
+        while (offset < size && contents[offset] != '\n')
+            ++offset;
+
+        uint32_t length = offset++ - word;
+
+        for (uint32_t gap = 0; gap < length && length <= HOOK_MAX_WORD_LENGTH; ++gap, ++pair) {
+            if (pair % scan_step)
+                continue;
+
+            char* key = Batch->text[0];
+            const char* keys[1] = { key };
+            uint32_t key_length = length - 1;
+            uint64_t mask;
+
+            memcpy(key, contents + word, gap);
+            memcpy(key + gap, contents + word + gap + 1, key_length - gap);
+            cross_check_tiles(Hooks, keys, &key_length, &gap, 1, &mask);
+            scan_mismatch_count += scan_cross_check(contents, size, key, key_length, gap) != mask;
+            ++scan_count;
+        }
+    }
+
+    // NOTE: a dictionary with no word of up to HOOK_MAX_WORD_LENGTH letters
+    // has no pairs to look up or scan
+    double scan_elapsed_ms = get_ms_elapsed(scan_start, get_wall_clock());
+    double scan_ms = scan_count ? scan_elapsed_ms / (double) scan_count : 0.0;
+    double lookup_ns = Batch->lookup_count ? lookup_ms * 1000000.0 / (double) Batch->lookup_count : 0.0;
+
+    printf("**********************************************************\n");
+    printf("** HOOK TABLE BENCHMARK (best of %u)\n", iterations);
+    printf("**********************************************************\n");
+    printf("** Pairs           :  %u in %u buckets, %.1f MB, %s\n", Hooks->pair_count, Hooks->bucket_count,
+           (double) block_size / (1024.0 * 1024.0), Hooks->memory ? "built on first use" : "from the dictionary index");
+    printf("** Build           :  %.1f ms on %u threads, %s\n", build_ms, Engine->Pool.worker_count + 1, same_table ? "same table" : "table DIFFERS");
+    printf("** Lookups         :  %llu pairs in batches of %u, %.1f ms, %.1f ns each, %llu missing their own tile (mask sum %016llx)\n",
+           Batch->lookup_count, HOOK_BATCH_SIZE, lookup_ms, lookup_ns, Batch->missing_count, Batch->mask_sum);
+    printf("** Scans           :  %u pairs, %.3f ms each (%.0fx the lookup), %u differ from the table\n",
+           scan_count, scan_ms, lookup_ns > 0.0 ? scan_ms * 1000000.0 / lookup_ns : 0.0, scan_mismatch_count);
+    printf("**********************************************************\n\n");
+
+    VirtualFree(Batch, 0, MEM_RELEASE);
+
+    return SCH_OK;
+}
+
+/*
+ * Offline job: fills the leave table on every worker and writes it out
+ * for sch_open_leave_table.
+ */
+sch_status
+sch_build_leave_table(sch_engine* Engine, const char* path, sch_progress_fn* progress, void* progress_user, sch_leave_build_stats* Stats)
+{
+    ctx context = {};
+    work_queue Queue = {};
+    leave_table Table;
+
+    if (!create_leave_table(&Table, &Engine->Alphabet))
+        return SCH_ERROR_OUT_OF_MEMORY;
+
+    Table.Header->word_count = Engine->Normalized.word_count;
+    context.Alphabet = &Engine->Alphabet;
+    context.Leaves = &Table;
+    context.kernel = build_leaves_kernel;
+
+    if (!create_query_queue(Engine, &context, &Queue)) {
+        release_query_queue(&Queue);
+        release_leave_table(&Table);
+        return SCH_ERROR_OUT_OF_MEMORY;
+    }
+
+    Queue.progress = progress;
+    Queue.progress_user = progress_user;
+
+    uint64_t start = get_wall_clock();
+    run_engine_query(Engine, &Queue, Engine->Pool.worker_count + 1);
+    uint64_t middle = get_wall_clock();
+    int written = write_leave_table(&Table, path);
+    uint64_t end = get_wall_clock();
+
+    if (Stats) {
+        Stats->entry_count = Table.entry_count;
+        Stats->symbol_count = Table.symbol_count;
+        Stats->table_bytes = sizeof(leave_table_header) + Table.entry_count * sizeof(leave_stats);
+        Stats->words_used = Queue.TotalWordsFound;
+        Stats->thread_count = Engine->Pool.worker_count + 1;
+        Stats->build_ms = get_ms_elapsed(start, middle);
+        Stats->write_ms = get_ms_elapsed(middle, end);
+    }
+
+    release_query_queue(&Queue);
+    release_leave_table(&Table);
+
+    return written ? SCH_OK : SCH_ERROR_WRITE_FILE;
+}
+
+/*
+ * Maps a table from sch_build_leave_table; only the alphabet of Options
+ * matters, and it has to be the one the table was built with.
+ */
+sch_leave_table*
+sch_open_leave_table(const char* path, const sch_options* Options, sch_status* Status)
+{
+    sch_options Defaults = {};
+    sch_leave_table* Leaves = (sch_leave_table*) VirtualAlloc(NULL, sizeof(sch_leave_table), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    sch_status Result = SCH_ERROR_OUT_OF_MEMORY;
+
+    if (Leaves) {
+        Result = load_engine_alphabet(&Leaves->Alphabet, Options ? Options : &Defaults);
+
+        if (Result == SCH_OK && !map_leave_table(&Leaves->Table, &Leaves->Alphabet, path))
+            Result = SCH_ERROR_LEAVE_TABLE;
+
+        if (Result != SCH_OK) {
+            VirtualFree(Leaves, 0, MEM_RELEASE);
+            Leaves = NULL;
+        }
+    }
+
+    if (Status)
+        *Status = Result;
+
+    return Leaves;
+}
+
+sch_status
+sch_lookup_leave(sch_leave_table* Leaves, const char* leave, sch_leave* Leave)
+{
+    leave_stats* Stats = get_leave_stats(&Leaves->Table, &Leaves->Alphabet, leave);
+
+    if (!Stats)
+        return SCH_ERROR_LETTERS;
+
+    Leave->word_count = Stats->word_count;
+    Leave->bingo_count = Stats->bingo_count;
+    Leave->high_score_count = Stats->high_score_count;
+    Leave->best_score = Stats->best_score;
+
+    return SCH_OK;
+}
+
+void
+sch_get_leave_table_info(sch_leave_table* Leaves, uint64_t* entry_count, uint64_t* word_count)
+{
+    *entry_count = Leaves->Table.entry_count;
+    *word_count = Leaves->Table.Header->word_count;
+}
+
+void
+sch_close_leave_table(sch_leave_table* Leaves)
+{
+    if (!Leaves)
+        return;
+
+    release_leave_table(&Leaves->Table);
+    VirtualFree(Leaves, 0, MEM_RELEASE);
+}
@@ -0,0 +1,275 @@
+#if !defined(SCH_H__)
+#define SCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libsch: spellable-word search over a dictionary loaded once.
+ *
+ * An engine owns the normalized dictionary, its NUMA placement and the
+ * worker pool. sch_query may be called from any number of threads at
+ * once: every query keeps its own state, queries the cost model keeps on
+ * the calling thread run side by side, and queries that fan out take
+ * turns on the pool.
+ *
+ * Results hold 32-bit word IDs, byte offsets into the engine's
+ * dictionary, and sch_next_word resolves them to spans into it, valid
+ * until sch_close. For alphabets with digraph or accented tiles the
+ * bytes are tile codes; sch_decode_word turns them back into text.
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define SCH_MAX_TOP_COUNT 100000
+#define SCH_MAX_ANAGRAM_WORDS 3
+#define SCH_MAX_RACK_TILES 7
+#define SCH_SIMULATION_SCORE_BUCKETS 128
+
+typedef enum sch_status {
+    SCH_OK                  = 0,
+    SCH_ERROR_OPEN_FILE     = -2,
+    SCH_ERROR_FILE_SIZE     = -3,
+    SCH_ERROR_OUT_OF_MEMORY = -4,
+    SCH_ERROR_READ_FILE     = -5,
+    SCH_ERROR_ALPHABET      = -6,
+    SCH_ERROR_LETTERS       = -7,   // query letters outside the alphabet
+    SCH_ERROR_TILE_VALUES   = -8,
+    SCH_ERROR_LEAVE_TABLE   = -9,   // missing, corrupt or for another alphabet
+    SCH_ERROR_WRITE_FILE    = -10,
+    SCH_ERROR_ARGUMENT      = -11,
+    SCH_ERROR_NO_BAG        = -12,  // a simulation without a bag for an alphabet with no standard one
+} sch_status;
+
+typedef enum sch_order {
+    SCH_ORDER_NONE,
+    SCH_ORDER_LENGTH,
+    SCH_ORDER_LEXICOGRAPHIC,
+} sch_order;
+
+typedef struct sch_engine sch_engine;
+typedef struct sch_leave_table sch_leave_table;
+
+typedef struct sch_options {
+    const char* alphabet;       // built-in name or definition file, NULL for english
+    const char* tile_values;    // score overrides such as "q=10,z=10", may be NULL
+    const char* layout;         // "single", "interleaved", "replicated", NULL for the default
+    int use_large_pages;
+    int use_word_classes;       // queries test each anagram class once instead of every word
+} sch_options;
+
+typedef void sch_progress_fn(void* user, uint32_t percent);
+
+typedef struct sch_query_params {
+    const char* rack;           // '?' is a blank
+    const char* include;        // every letter must be used, may be NULL
+    const char* any_of;         // at least one of these, may be NULL
+    int allow_repeated;
+    sch_order order;            // ignored with top_count, which orders best first
+    uint32_t top_count;         // 0 returns every match
+    int rank_by_length;         // top_count ranks by tile score otherwise
+    uint32_t thread_count;      // 0 lets the cost model decide
+    sch_progress_fn* progress;  // may be NULL, called on the querying thread
+    void* progress_user;
+} sch_query_params;
+
+typedef struct sch_word {
+    const char* text;           // span into the dictionary, not NUL terminated
+    int length;
+    uint32_t rank;              // score or length with top_count, 0 otherwise
+    uint32_t id;                // offset of the word in the dictionary
+} sch_word;
+
+typedef struct sch_query_stats {
+    uint64_t words_found;       // every match, also past top_count
+    uint32_t thread_count;
+    uint32_t max_thread_count;
+    int forced;                 // thread_count came from the query
+    const char* exec_mode;
+    double estimated_us;
+    uint64_t scan_bytes;
+    uint64_t estimated_words;
+    uint64_t estimated_matches;
+    uint32_t rack_size;
+    uint32_t heap_count;        // per-thread top_count heaps merged
+    double elapsed_ms;
+    uint64_t page_faults;
+    uint64_t result_bytes;      // what the result holds, ids or bitset
+} sch_query_stats;
+
+// NOTE: read with sch_next_word; unordered results are in dictionary
+// order, and dense ones come as a bitset instead of ids
+typedef struct sch_result {
+    uint32_t count;
+    uint32_t* ids;              // NULL for a bitset
+    uint32_t* ranks;            // with top_count
+    uint64_t* bitset;           // one bit per dictionary byte, set where a word starts
+    uint32_t bitset_words;
+    sch_query_stats stats;
+} sch_result;
+
+typedef struct sch_info {
+    uint32_t core_count;
+    uint32_t worker_count;
+    uint32_t numa_node_count;
+    const char* layout;
+    size_t large_page_size;     // 0 when large pages are off or not permitted
+    uint64_t large_page_count;
+    uint64_t small_page_count;
+    const char* alphabet;
+    uint32_t alphabet_size;
+    uint64_t word_count;
+    uint64_t dropped_word_count;
+    uint32_t dictionary_bytes;
+    int dictionary_embedded;    // the index linked into the executable, no file read
+    double load_ms;             // reading and normalizing, or finding the index
+    uint32_t class_count;       // distinct letter multisets, 0 without use_word_classes
+    uint64_t class_bytes;
+    double class_build_ms;
+} sch_info;
+
+// NOTE: one combination of count words, shortest word first
+typedef void sch_anagram_fn(void* user, const sch_word* words, uint32_t count);
+
+typedef struct sch_anagram_params {
+    const char* rack;           // every tile used exactly once, no blanks
+    uint32_t max_words;         // combinations of 2 up to this many words, 0 for 2
+    uint32_t thread_count;      // 0 lets the cost model decide
+    sch_anagram_fn* output;     // may be NULL to only count; called from any
+    void* output_user;          // worker, but never from two at once
+} sch_anagram_params;
+
+typedef struct sch_anagram_stats {
+    uint32_t rack_size;
+    uint32_t candidate_count;   // words the rack can spell on their own
+    uint32_t class_count;       // distinct letter multisets among them
+    uint64_t class_combination_count;
+    uint64_t anagram_count;     // word combinations, also when not streamed
+    uint32_t filter_thread_count;
+    uint32_t join_thread_count;
+    double filter_ms;
+    double group_ms;
+    double join_ms;
+    double elapsed_ms;
+} sch_anagram_stats;
+
+typedef struct sch_word_set_info {
+    uint32_t word_count;        // distinct dictionary words
+    uint32_t duplicate_count;
+    uint32_t bucket_count;
+    uint32_t slot_count;
+    uint32_t seed_count;        // hash seeds tried while building
+    uint64_t table_bytes;       // pilots, fingerprints and offsets
+    double bytes_per_word;
+    double dictionary_bytes_per_word;   // text that hits are verified against
+    uint32_t shard_count;       // built independently, on any thread
+    uint64_t checksum;          // of the table, the same for any thread count
+    uint32_t build_thread_count;
+    double split_ms;            // find the words
+    double hash_ms;             // hash them and count them per shard
+    double scatter_ms;          // group them by shard
+    double place_ms;            // find every shard's pilots
+    double build_ms;
+} sch_word_set_info;
+
+typedef struct sch_simulation_params {
+    const char* bag;            // tile counts such as "a=9,b=2,?=2", NULL for the
+                                // standard English bag (english only); at most 2 blanks
+    const char* leave;          // tiles kept on every rack, taken out of the bag
+    uint32_t rack_size;         // 0 for SCH_MAX_RACK_TILES
+    uint64_t sample_count;
+    uint64_t seed;              // the same seed draws the same racks on any thread count
+    uint32_t thread_count;      // 0 for one per processor
+} sch_simulation_params;
+
+typedef struct sch_simulation_stats {
+    uint64_t sample_count;
+    uint64_t playable_count;    // racks with at least one word
+    uint64_t bingo_count;       // racks with a word using every tile
+    uint64_t length_histogram[SCH_MAX_RACK_TILES + 1];      // by longest word, 0 for none
+    uint64_t score_histogram[SCH_SIMULATION_SCORE_BUCKETS]; // by best score, the last
+                                                            // bucket takes anything higher
+    double mean_best_score;
+    uint32_t bag_tile_count;    // what racks are drawn from, after the leave
+    uint32_t thread_count;
+    uint32_t table_entry_count; // rack multisets that play a word
+    uint64_t table_bytes;
+    double table_build_ms;      // 0 once the engine has the table
+    double elapsed_ms;
+    double racks_per_second;
+} sch_simulation_stats;
+
+typedef struct sch_hook_info {
+    uint32_t pair_count;        // fragment pairs left by taking one tile out of a word
+    uint32_t bucket_count;
+    uint32_t mask_size;         // bytes per mask: 4 for up to 32 tiles, 8 otherwise
+    uint64_t table_bytes;
+    double bytes_per_pair;
+    int embedded;               // came with the dictionary index, nothing was built
+    uint32_t build_thread_count;
+    double build_ms;
+} sch_hook_info;
+
+typedef struct sch_leave {
+    uint32_t word_count;        // words of up to 7 tiles using every leave tile
+    uint32_t bingo_count;
+    uint32_t high_score_count;
+    uint32_t best_score;
+} sch_leave;
+
+typedef struct sch_leave_build_stats {
+    uint64_t entry_count;
+    uint32_t symbol_count;
+    uint64_t table_bytes;
+    uint64_t words_used;
+    uint32_t thread_count;
+    double build_ms;
+    double write_ms;
+} sch_leave_build_stats;
+
+extern sch_engine* sch_open(const char* dictionary_path, const sch_options* Options, sch_status* Status);
+extern void sch_close(sch_engine* Engine);
+extern void sch_get_info(sch_engine* Engine, sch_info* Info);
+
+extern sch_status sch_query(sch_engine* Engine, const sch_query_params* Query, sch_result* Result);
+extern void sch_release_result(sch_result* Result);
+// NOTE: start cursor at 0; returns 0 past the last word
+extern int sch_next_word(sch_engine* Engine, const sch_result* Result, uint64_t* cursor, sch_word* Word);
+extern int sch_decode_word(sch_engine* Engine, const sch_word* Word, char* buffer, size_t size);
+
+// NOTE: valid[i] is set to 1 or 0; the set is built on first use
+extern sch_status sch_check_words(sch_engine* Engine, const char* const* words, uint32_t count, uint8_t* valid);
+extern sch_status sch_get_word_set_info(sch_engine* Engine, sch_word_set_info* Info);
+
+extern sch_status sch_find_anagrams(sch_engine* Engine, const sch_anagram_params* Params, sch_anagram_stats* Stats);
+
+// NOTE: masks[i] gets bit k set for each tile k that makes before[i] +
+// tile + after[i] a word, like letter masks; an empty or NULL before or
+// after asks for front or back hooks. The hook table comes with the
+// dictionary index or is built on first use
+extern sch_status sch_cross_check(sch_engine* Engine, const char* const* before, const char* const* after, uint32_t count, uint64_t* masks);
+extern sch_status sch_get_hook_info(sch_engine* Engine, sch_hook_info* Info);
+extern int sch_decode_tiles(sch_engine* Engine, uint64_t mask, char* buffer, size_t size);
+
+// NOTE: the rack table is built on first use
+extern sch_status sch_simulate(sch_engine* Engine, const sch_simulation_params* Params, sch_simulation_stats* Stats);
+
+// NOTE: diagnostics, print their report to stdout
+extern sch_status sch_benchmark(sch_engine* Engine, const sch_query_params* Query, uint32_t iterations);
+extern sch_status sch_benchmark_anagrams(sch_engine* Engine, const sch_anagram_params* Params, uint32_t iterations);
+extern sch_status sch_benchmark_word_set(sch_engine* Engine, uint32_t iterations);
+extern sch_status sch_benchmark_hooks(sch_engine* Engine, uint32_t iterations);
+
+extern sch_status sch_build_leave_table(sch_engine* Engine, const char* path, sch_progress_fn* progress, void* progress_user, sch_leave_build_stats* Stats);
+extern sch_leave_table* sch_open_leave_table(const char* path, const sch_options* Options, sch_status* Status);
+extern sch_status sch_lookup_leave(sch_leave_table* Table, const char* leave, sch_leave* Leave);
+extern void sch_get_leave_table_info(sch_leave_table* Table, uint64_t* entry_count, uint64_t* word_count);
+extern void sch_close_leave_table(sch_leave_table* Table);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,542 @@
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "wordset.h"
+#include "hash.h"
+
+#define WORD_SET_BASE_SEED 0x57534554ull    // "WSET"
+
+struct word_key {
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// NOTE: the high half of the hash picks the bucket, its top bits the
+// shard, the pilot scatters the low half over the shard's slots and the
+// low byte is the fingerprint
+static uint32_t
+get_bucket(word_set* Set, uint64_t hash)
+{
+    return (uint32_t) (((hash >> 32) * Set->bucket_count) >> 32);
+}
+
+// NOTE: the same as get_bucket / shard_bucket_count, as bucket_count is
+// a multiple of WORD_SET_SHARD_COUNT
+static uint32_t
+get_shard(uint64_t hash)
+{
+    return (uint32_t) (hash >> (64 - WORD_SET_SHARD_BITS));
+}
+
+static uint32_t
+get_slot(word_set* Set, uint64_t hash, uint16_t pilot)
+{
+    uint32_t shard = get_shard(hash);
+    uint32_t first = Set->shard_slots[shard];
+    uint32_t h = (uint32_t) hash ^ (uint32_t) mix_hash(pilot + Set->seed);
+
+    return first + (uint32_t) (((uint64_t) h * (Set->shard_slots[shard + 1] - first)) >> 32);
+}
+
+static uint8_t
+get_fingerprint(uint64_t hash)
+{
+    return (uint8_t) hash;
+}
+
+static uint32_t
+get_shard_slot_count(uint32_t key_count)
+{
+    return (uint32_t) ((uint64_t) key_count * 100 / WORD_SET_LOAD_PERCENT + 1);
+}
+
+/*
+ * Drops repeated words from a bucket; equal words hash alike, so they
+ * always share one. Returns 0 if two different words share a hash,
+ * which no pilot could separate.
+ */
+static int
+remove_duplicate_keys(word_set* Set, word_key* keys, uint32_t* bucket_keys, uint32_t* size, uint32_t* duplicate_count)
+{
+    uint32_t kept = 0;
+
+    for (uint32_t k = 0; k < *size; ++k) {
+        word_key* Key = keys + bucket_keys[k];
+        uint32_t j = 0;
+
+        while (j < kept && keys[bucket_keys[j]].hash != Key->hash)
+            ++j;
+
+        if (j == kept) {
+            bucket_keys[kept++] = bucket_keys[k];
+            continue;
+        }
+
+        word_key* Kept = keys + bucket_keys[j];
+
+        if (Kept->length != Key->length || memcmp(Set->contents + Kept->offset, Set->contents + Key->offset, Key->length))
+            return 0;
+
+        ++*duplicate_count;
+    }
+
+    *size = kept;
+
+    return 1;
+}
+
+/*
+ * Places one shard's buckets biggest first, while its slots are still
+ * empty enough for them, trying pilots until every word of the bucket
+ * lands on a free slot of its own. Returns 0 if some bucket runs out of
+ * pilots.
+ */
+static int
+place_shard(word_set_build* Build, uint32_t shard, uint32_t* duplicate_count)
+{
+    word_set* Set = Build->Set;
+    uint32_t first_key = Build->shard_keys[shard];
+    uint32_t key_count = Build->shard_keys[shard + 1] - first_key;
+    uint32_t bucket_count = Set->shard_bucket_count;
+    uint32_t first_bucket = shard * bucket_count;
+    uint32_t first_slot = Set->shard_slots[shard];
+    word_key* keys = Build->sharded_keys + first_key;
+    uint32_t* bucket_keys = Build->bucket_keys + first_key;
+    uint32_t* bucket_starts = Build->bucket_starts + (size_t) shard * (bucket_count + 2);
+    uint32_t* bucket_order = Build->bucket_order + first_bucket;
+    uint64_t* taken = Build->taken + Build->shard_taken[shard];
+    uint32_t size_starts[WORD_SET_MAX_BUCKET_KEYS + 2] = {};
+    uint32_t max_bucket_size = 0;
+
+    memset(bucket_starts, 0, (bucket_count + 2) * sizeof(uint32_t));
+    memset(taken, 0, (Build->shard_taken[shard + 1] - Build->shard_taken[shard]) * sizeof(uint64_t));
+
+    // NOTE: counting sorts, keys by bucket and then buckets by size
+    for (uint32_t i = 0; i < key_count; ++i)
+        ++bucket_starts[get_bucket(Set, keys[i].hash) - first_bucket + 2];
+
+    for (uint32_t b = 0; b < bucket_count; ++b) {
+        if (bucket_starts[b + 2] > max_bucket_size)
+            max_bucket_size = bucket_starts[b + 2];
+
+        bucket_starts[b + 2] += bucket_starts[b + 1];
+    }
+
+    if (max_bucket_size > WORD_SET_MAX_BUCKET_KEYS)
+        return 0;
+
+    for (uint32_t i = 0; i < key_count; ++i)
+        bucket_keys[bucket_starts[get_bucket(Set, keys[i].hash) - first_bucket + 1]++] = i;
+
+    for (uint32_t b = 0; b < bucket_count; ++b)
+        ++size_starts[max_bucket_size - (bucket_starts[b + 1] - bucket_starts[b]) + 1];
+
+    for (uint32_t s = 1; s <= max_bucket_size + 1; ++s)
+        size_starts[s] += size_starts[s - 1];
+
+    for (uint32_t b = 0; b < bucket_count; ++b)
+        bucket_order[size_starts[max_bucket_size - (bucket_starts[b + 1] - bucket_starts[b])]++] = b;
+
+    uint32_t slots[WORD_SET_MAX_BUCKET_KEYS];
+
+    for (uint32_t i = 0; i < bucket_count; ++i) {
+        uint32_t b = bucket_order[i];
+        uint32_t first = bucket_starts[b];
+        uint32_t size = bucket_starts[b + 1] - first;
+
+        if (!size)
+            break;
+
+        if (!remove_duplicate_keys(Set, keys, bucket_keys + first, &size, duplicate_count))
+            return 0;
+
+        uint32_t pilot = 0;
+
+        for (; pilot <= WORD_SET_MAX_PILOT; ++pilot) {
+            uint32_t placed = 0;
+
+            for (; placed < size; ++placed) {
+                uint32_t slot = get_slot(Set, keys[bucket_keys[first + placed]].hash, (uint16_t) pilot) - first_slot;
+
+                if ((taken[slot / 64] >> (slot % 64)) & 1)
+                    break;
+
+                uint32_t j = 0;
+
+                while (j < placed && slots[j] != slot)
+                    ++j;
+
+                if (j < placed)
+                    break;
+
+                slots[placed] = slot;
+            }
+
+            if (placed == size)
+                break;
+        }
+
+        if (pilot > WORD_SET_MAX_PILOT)
+            return 0;
+
+        Set->pilots[first_bucket + b] = (uint16_t) pilot;
+
+        for (uint32_t k = 0; k < size; ++k) {
+            word_key* Key = keys + bucket_keys[first + k];
+
+            taken[slots[k] / 64] |= (uint64_t) 1 << (slots[k] % 64);
+            Set->fingerprints[first_slot + slots[k]] = get_fingerprint(Key->hash);
+            Set->offsets[first_slot + slots[k]] = Key->offset;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Sets up a build over a normalized dictionary, which has to stay mapped
+ * for as long as the set is used.
+ */
+int
+begin_word_set_build(word_set_build* Build, word_set* Set, const char* contents, uint32_t size)
+{
+    memset(Build, 0, sizeof(*Build));
+    memset(Set, 0, sizeof(*Set));
+    Build->Set = Set;
+    Build->contents = contents;
+    Build->size = size;
+    Set->contents = contents;
+    Set->contents_size = size;
+
+    return begin_staged_build(&Build->Stages, contents, size, WORD_SET_RANGE_COUNT, WORD_SET_SHARD_COUNT);
+}
+
+uint32_t
+get_word_set_stage_size(word_set_build* Build)
+{
+    return (Build->stage == WORD_SET_STAGE_PLACE) ? WORD_SET_SHARD_COUNT : WORD_SET_RANGE_COUNT;
+}
+
+// NOTE: index is a range for every stage but PLACE, which takes a shard
+void
+run_word_set_stage(word_set_build* Build, uint32_t index)
+{
+    const char* contents = Build->contents;
+
+    switch (Build->stage) {
+    case WORD_SET_STAGE_SPLIT: {
+        uint32_t key_count = 0;
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < Build->Stages.range_starts[index + 1]; ++i)
+            key_count += contents[i] != '\n' && (i + 1 == Build->size || contents[i + 1] == '\n');
+
+        Build->range_keys[index + 1] = key_count;
+    } break;
+
+    case WORD_SET_STAGE_HASH: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * WORD_SET_SHARD_COUNT;
+        uint32_t end = Build->Stages.range_starts[index + 1];
+        uint32_t k = Build->range_keys[index];
+
+        for (uint32_t i = Build->Stages.range_starts[index]; i < end;) {
+            while (i < end && contents[i] == '\n')
+                ++i;
+
+            uint32_t word_start = i;
+
+            while (i < end && contents[i] != '\n')
+                ++i;
+
+            if (i > word_start) {
+                word_key* Key = Build->keys + k++;
+
+                Key->offset = word_start;
+                Key->length = i - word_start;
+                Key->hash = hash_bytes(contents + word_start, Key->length, Build->Set->seed);
+                ++shard_counts[get_shard(Key->hash)];
+            }
+        }
+    } break;
+
+    case WORD_SET_STAGE_SCATTER: {
+        uint32_t* shard_counts = Build->Stages.range_shard_counts + (size_t) index * WORD_SET_SHARD_COUNT;
+
+        for (uint32_t k = Build->range_keys[index]; k < Build->range_keys[index + 1]; ++k)
+            Build->sharded_keys[shard_counts[get_shard(Build->keys[k].hash)]++] = Build->keys[k];
+    } break;
+
+    case WORD_SET_STAGE_PLACE: {
+        uint32_t duplicate_count = 0;
+
+        if (!place_shard(Build, index, &duplicate_count))
+            InterlockedIncrement(&Build->FailedShardCount);
+
+        InterlockedExchangeAdd(&Build->DuplicateCount, (LONG) duplicate_count);
+    } break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Sizes everything once the words are counted. Shards take slots by how
+ * many words they got, so the table is only allocated for the most any
+ * seed can ask for.
+ */
+static int
+allocate_word_set(word_set_build* Build)
+{
+    word_set* Set = Build->Set;
+    uint32_t key_count = Build->key_count;
+    uint32_t max_slot_count = (uint32_t) ((uint64_t) key_count * 100 / WORD_SET_LOAD_PERCENT) + 2 * WORD_SET_SHARD_COUNT;
+
+    Set->shard_bucket_count = key_count / (WORD_SET_BUCKET_SIZE * WORD_SET_SHARD_COUNT) + 1;
+    Set->bucket_count = Set->shard_bucket_count * WORD_SET_SHARD_COUNT;
+
+    size_t keys_size = ((size_t) key_count + 1) * sizeof(word_key);
+    size_t bucket_keys_size = (((size_t) key_count + 2) & ~(size_t) 1) * sizeof(uint32_t);
+    size_t bucket_starts_size = (((size_t) Set->bucket_count + 2 * WORD_SET_SHARD_COUNT + 1) & ~(size_t) 1) * sizeof(uint32_t);
+    size_t bucket_order_size = (((size_t) Set->bucket_count + 1) & ~(size_t) 1) * sizeof(uint32_t);
+    size_t taken_size = ((size_t) max_slot_count / 64 + WORD_SET_SHARD_COUNT + 1) * sizeof(uint64_t);
+
+    Build->Stages.scratch = (char*) VirtualAlloc(NULL, 2 * keys_size + bucket_keys_size + bucket_starts_size + bucket_order_size + taken_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Build->Stages.scratch)
+        return 0;
+
+    char* scratch = Build->Stages.scratch;
+    Build->keys = (word_key*) scratch;
+    Build->sharded_keys = (word_key*) (scratch += keys_size);
+    Build->bucket_keys = (uint32_t*) (scratch += keys_size);
+    Build->bucket_starts = (uint32_t*) (scratch += bucket_keys_size);
+    Build->bucket_order = (uint32_t*) (scratch += bucket_starts_size);
+    Build->taken = (uint64_t*) (scratch + bucket_order_size);
+
+    size_t shard_slots_size = ((WORD_SET_SHARD_COUNT + 1) * sizeof(uint32_t) + 63) & ~(size_t) 63;
+    size_t pilots_size = ((size_t) Set->bucket_count * sizeof(uint16_t) + 63) & ~(size_t) 63;
+    size_t fingerprints_size = ((size_t) max_slot_count + 63) & ~(size_t) 63;
+    size_t offsets_size = (size_t) max_slot_count * sizeof(uint32_t);
+
+    Build->tables = (char*) VirtualAlloc(NULL, shard_slots_size + pilots_size + fingerprints_size + offsets_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (!Build->tables)
+        return 0;
+
+    Set->shard_slots = (uint32_t*) Build->tables;
+    Set->pilots = (uint16_t*) (Build->tables + shard_slots_size);
+    Set->fingerprints = (uint8_t*) (Build->tables + shard_slots_size + pilots_size);
+    Set->offsets = (uint32_t*) (Build->tables + shard_slots_size + pilots_size + fingerprints_size);
+
+    return 1;
+}
+
+// NOTE: shards take their slots and bitmap words in shard order too
+static void
+assign_shards(word_set_build* Build)
+{
+    word_set* Set = Build->Set;
+    uint32_t slot = 0;
+    uint32_t taken = 0;
+
+    assign_shard_starts(&Build->Stages, Build->shard_keys);
+
+    for (uint32_t s = 0; s < WORD_SET_SHARD_COUNT; ++s) {
+        uint32_t slot_count = get_shard_slot_count(Build->shard_keys[s + 1] - Build->shard_keys[s]);
+
+        Build->shard_taken[s] = taken;
+        Set->shard_slots[s] = slot;
+        slot += slot_count;
+        taken += (slot_count + 63) / 64;
+    }
+
+    Build->shard_taken[WORD_SET_SHARD_COUNT] = taken;
+    Set->shard_slots[WORD_SET_SHARD_COUNT] = slot;
+    Set->slot_count = slot;
+
+    memset(Set->fingerprints, 0, slot);
+    memset(Set->offsets, 0, (size_t) slot * sizeof(uint32_t));
+}
+
+// NOTE: returns 0 when the build cannot go on with this seed
+int
+finish_word_set_stage(word_set_build* Build)
+{
+    word_set* Set = Build->Set;
+
+    switch (Build->stage) {
+    case WORD_SET_STAGE_SPLIT:
+        for (uint32_t r = 0; r < WORD_SET_RANGE_COUNT; ++r)
+            Build->range_keys[r + 1] += Build->range_keys[r];
+
+        Build->key_count = Build->range_keys[WORD_SET_RANGE_COUNT];
+
+        return allocate_word_set(Build);
+
+    case WORD_SET_STAGE_HASH:
+        assign_shards(Build);
+        return 1;
+
+    case WORD_SET_STAGE_PLACE:
+        if (Build->FailedShardCount)
+            return 0;
+
+        Set->duplicate_count = (uint32_t) Build->DuplicateCount;
+        Set->word_count = Build->key_count - Set->duplicate_count;
+
+        return 1;
+
+    default:
+        return 1;
+    }
+}
+
+/*
+ * Seeds are tried in a fixed order, so the same dictionary always gives
+ * the same table. Returns 0 once WORD_SET_MAX_SEEDS have failed.
+ */
+int
+next_word_set_seed(word_set_build* Build)
+{
+    word_set* Set = Build->Set;
+
+    if (Set->seed_count == WORD_SET_MAX_SEEDS)
+        return 0;
+
+    Set->seed = mix_hash(WORD_SET_BASE_SEED + ++Set->seed_count);
+    Build->FailedShardCount = 0;
+    Build->DuplicateCount = 0;
+    memset(Build->Stages.range_shard_counts, 0, WORD_SET_RANGE_COUNT * WORD_SET_SHARD_COUNT * sizeof(uint32_t));
+
+    return 1;
+}
+
+int
+end_word_set_build(word_set_build* Build, int succeeded)
+{
+    end_staged_build(&Build->Stages);
+
+    if (!succeeded && Build->tables)
+        VirtualFree(Build->tables, 0, MEM_RELEASE);
+
+    if (!succeeded) {
+        Build->Set->shard_slots = NULL;
+        Build->Set->pilots = NULL;
+        Build->Set->fingerprints = NULL;
+        Build->Set->offsets = NULL;
+    }
+
+    return succeeded;
+}
+
+/*
+ * Writes a query word as dictionary bytes. Returns 0 for words that
+ * cannot be in the dictionary: empty, blanks, letters outside the
+ * alphabet or longer than WORD_SET_MAX_WORD_LENGTH tiles.
+ */
+static uint32_t
+normalize_check_word(alphabet* Alphabet, const char* word, char* text)
+{
+    uint8_t codes[WORD_SET_MAX_WORD_LENGTH + 1];
+    int count = get_tile_codes(Alphabet, word, codes, sizeof(codes));
+
+    if (count <= 0 || count > WORD_SET_MAX_WORD_LENGTH)
+        return 0;
+
+    for (int i = 0; i < count; ++i) {
+        if (codes[i] == BLANK_CODE)
+            return 0;
+
+        text[i] = (char) (TILE_CODE_BASE + codes[i]);
+    }
+
+    return (uint32_t) count;
+}
+
+/*
+ * Sets valid[i] for each of the words. Lookups go in batches of
+ * WORD_SET_BATCH_SIZE, one stage at a time across the batch: every stage
+ * prefetches what the next one reads, so the cache misses of a batch
+ * overlap instead of queueing behind each other. Only words whose
+ * fingerprint matches touch the dictionary. Read-only, so any number of
+ * threads can check against one set.
+ */
+void
+check_words(word_set* Set, alphabet* Alphabet, const char* const* words, uint32_t count, uint8_t* valid)
+{
+    char text[WORD_SET_BATCH_SIZE][WORD_SET_MAX_WORD_LENGTH];
+    uint32_t lengths[WORD_SET_BATCH_SIZE];
+    uint64_t hashes[WORD_SET_BATCH_SIZE];
+    uint32_t slots[WORD_SET_BATCH_SIZE];
+
+    for (uint32_t first = 0; first < count; first += WORD_SET_BATCH_SIZE) {
+        uint32_t batch = (count - first < WORD_SET_BATCH_SIZE) ? count - first : WORD_SET_BATCH_SIZE;
+        uint8_t* batch_valid = valid + first;
+
+        for (uint32_t i = 0; i < batch; ++i) {
+            lengths[i] = normalize_check_word(Alphabet, words[first + i], text[i]);
+            hashes[i] = hash_bytes(text[i], lengths[i], Set->seed);
+            _mm_prefetch((const char*) (Set->pilots + get_bucket(Set, hashes[i])), _MM_HINT_T0);
+        }
+
+        for (uint32_t i = 0; i < batch; ++i) {
+            slots[i] = get_slot(Set, hashes[i], Set->pilots[get_bucket(Set, hashes[i])]);
+            _mm_prefetch((const char*) (Set->fingerprints + slots[i]), _MM_HINT_T0);
+            _mm_prefetch((const char*) (Set->offsets + slots[i]), _MM_HINT_T0);
+        }
+
+        for (uint32_t i = 0; i < batch; ++i) {
+            batch_valid[i] = lengths[i] && Set->fingerprints[slots[i]] == get_fingerprint(hashes[i]);
+
+            if (batch_valid[i])
+                _mm_prefetch(Set->contents + Set->offsets[slots[i]], _MM_HINT_T0);
+        }
+
+        // NOTE: empty slots compare against whatever offset they hold,
+        // which is harmless: a word equal to it would hash to its own slot
+        for (uint32_t i = 0; i < batch; ++i) {
+            if (!batch_valid[i])
+                continue;
+
+            uint32_t offset = Set->offsets[slots[i]];
+            uint32_t end = offset + lengths[i];
+
+            batch_valid[i] = end <= Set->contents_size &&
+                             !memcmp(Set->contents + offset, text[i], lengths[i]) &&
+                             (end == Set->contents_size || Set->contents[end] == '\n');
+        }
+    }
+}
+
+// NOTE: the table alone; hits are also verified against the dictionary
+uint64_t
+get_word_set_bytes(word_set* Set)
+{
+    return (uint64_t) (WORD_SET_SHARD_COUNT + 1) * sizeof(uint32_t) + (uint64_t) Set->bucket_count * sizeof(uint16_t) +
+           (uint64_t) Set->slot_count * (sizeof(uint8_t) + sizeof(uint32_t));
+}
+
+// NOTE: over everything a lookup reads, to show two builds are the same
+uint64_t
+get_word_set_checksum(word_set* Set)
+{
+    uint64_t h = hash_bytes(Set->shard_slots, (WORD_SET_SHARD_COUNT + 1) * sizeof(uint32_t), Set->seed);
+    h = hash_bytes(Set->pilots, Set->bucket_count * sizeof(uint16_t), h);
+    h = hash_bytes(Set->fingerprints, Set->slot_count, h);
+
+    return hash_bytes(Set->offsets, Set->slot_count * sizeof(uint32_t), h);
+}
+
+void
+release_word_set(word_set* Set)
+{
+    if (Set->shard_slots)
+        VirtualFree(Set->shard_slots, 0, MEM_RELEASE);
+
+    Set->shard_slots = NULL;
+    Set->pilots = NULL;
+    Set->fingerprints = NULL;
+    Set->offsets = NULL;
+}
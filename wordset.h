@@ -0,0 +1,99 @@
+#if !defined(WORDSET_H__)
+#define WORDSET_H__
+
+#include <windows.h>
+#include <stdint.h>
+#include "alphabet.h"
+#include "build.h"
+
+#define WORD_SET_BUCKET_SIZE 3          // average words per pilot
+#define WORD_SET_LOAD_PERCENT 98
+#define WORD_SET_MAX_PILOT 0xFFFF
+#define WORD_SET_MAX_SEEDS 16
+#define WORD_SET_BATCH_SIZE 32
+#define WORD_SET_MAX_WORD_LENGTH 256    // longer queries are never words
+#define WORD_SET_MAX_BUCKET_KEYS 256
+#define WORD_SET_SHARD_BITS 8
+#define WORD_SET_SHARD_COUNT (1 << WORD_SET_SHARD_BITS)
+#define WORD_SET_RANGE_COUNT 64
+
+/*
+ * Membership test for the normalized dictionary: a perfect hash in the
+ * style of hash-and-displace. Words fall into buckets, and each bucket
+ * has a pilot that sends all of its words to free slots, so a lookup is
+ * one pilot, one slot and no probing. A slot keeps an 8-bit fingerprint,
+ * which turns away almost every miss, and the dictionary offset of its
+ * word, against which a hit is compared, so answers are exact.
+ *
+ * The top WORD_SET_SHARD_BITS of a word's hash pick its shard, which owns
+ * a run of buckets and a run of slots of its own. Shards never share a
+ * slot, so they are built independently of each other.
+ */
+struct word_set {
+    uint64_t seed;
+    uint32_t word_count;            // distinct words
+    uint32_t duplicate_count;
+    uint32_t bucket_count;          // WORD_SET_SHARD_COUNT runs of shard_bucket_count
+    uint32_t shard_bucket_count;
+    uint32_t slot_count;
+    uint32_t seed_count;            // seeds tried until every pilot was found
+    uint32_t* shard_slots;          // first slot of each shard, and slot_count
+    uint16_t* pilots;
+    uint8_t* fingerprints;
+    uint32_t* offsets;
+    const char* contents;           // the dictionary the offsets point into
+    uint32_t contents_size;
+};
+
+enum word_set_stage {
+    WORD_SET_STAGE_SPLIT,       // per range: count its words
+    WORD_SET_STAGE_HASH,        // per range: hash its words, count them per shard
+    WORD_SET_STAGE_SCATTER,     // per range: copy its words to their shards
+    WORD_SET_STAGE_PLACE,       // per shard: bucket, drop duplicates, find pilots
+    WORD_SET_STAGE_COUNT
+};
+
+struct word_key;
+
+/*
+ * A word set built in stages over a staged_build. Each stage runs one
+ * item at a time, any number at once, over WORD_SET_RANGE_COUNT slices
+ * of the dictionary or WORD_SET_SHARD_COUNT shards; finish_word_set_stage
+ * does the short serial step that follows.
+ *
+ *   begin, SPLIT, then per seed: HASH, SCATTER, PLACE, until PLACE finishes
+ */
+struct word_set_build {
+    word_set* Set;
+    const char* contents;
+    uint32_t size;
+    word_set_stage stage;
+    staged_build Stages;
+    uint32_t range_keys[WORD_SET_RANGE_COUNT + 1];      // first key of each range
+    uint32_t shard_keys[WORD_SET_SHARD_COUNT + 1];      // first key of each shard
+    uint32_t shard_taken[WORD_SET_SHARD_COUNT + 1];     // first word of each shard's bitmap
+    uint32_t key_count;
+    word_key* keys;                 // dictionary order
+    word_key* sharded_keys;         // by shard, dictionary order within
+    uint32_t* bucket_keys;
+    uint32_t* bucket_starts;        // shard_bucket_count + 2 per shard
+    uint32_t* bucket_order;
+    uint64_t* taken;
+    char* tables;
+    volatile LONG FailedShardCount;
+    volatile LONG DuplicateCount;
+};
+
+extern int begin_word_set_build(word_set_build* Build, word_set* Set, const char* contents, uint32_t size);
+extern uint32_t get_word_set_stage_size(word_set_build* Build);
+extern void run_word_set_stage(word_set_build* Build, uint32_t index);
+extern int finish_word_set_stage(word_set_build* Build);
+extern int next_word_set_seed(word_set_build* Build);
+extern int end_word_set_build(word_set_build* Build, int succeeded);
+
+extern void check_words(word_set* Set, alphabet* Alphabet, const char* const* words, uint32_t count, uint8_t* valid);
+extern uint64_t get_word_set_bytes(word_set* Set);
+extern uint64_t get_word_set_checksum(word_set* Set);
+extern void release_word_set(word_set* Set);
+
+#endif